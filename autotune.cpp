@@ -0,0 +1,365 @@
+#include "benchmark.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+#if defined(USE_SSE)
+	typedef expression_template_simd::valarray<float> tuned_valarray;
+#elif defined(USE_AVX)
+	typedef expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > tuned_valarray;
+#elif defined(USE_NEON)
+	typedef expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > tuned_valarray;
+#endif
+
+//---------------------------------------------------------------------
+// Representative expressions
+//---------------------------------------------------------------------
+
+	class tuned_dot_product : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				v1x = new tuned_valarray(size, 1.0f);
+				v1y = new tuned_valarray(size, 2.0f);
+				v1z = new tuned_valarray(size, 3.0f);
+				v1w = new tuned_valarray(size, 4.0f);
+
+				v2x = new tuned_valarray(size, 5.0f);
+				v2y = new tuned_valarray(size, 6.0f);
+				v2z = new tuned_valarray(size, 7.0f);
+				v2w = new tuned_valarray(size, 8.0f);
+
+				dot_products = new tuned_valarray(size);
+			}
+
+			void run()
+			{
+				*dot_products =
+					*v1x * *v2x +
+					*v1y * *v2y +
+					*v1z * *v2z +
+					*v1w * *v2w;
+			}
+
+			void teardown()
+			{
+				delete dot_products;
+
+				delete v1x;
+				delete v1y;
+				delete v1z;
+				delete v1w;
+
+				delete v2x;
+				delete v2y;
+				delete v2z;
+				delete v2w;
+			}
+
+		private:
+
+			tuned_valarray* v1x;
+			tuned_valarray* v1y;
+			tuned_valarray* v1z;
+			tuned_valarray* v1w;
+
+			tuned_valarray* v2x;
+			tuned_valarray* v2y;
+			tuned_valarray* v2z;
+			tuned_valarray* v2w;
+
+			tuned_valarray* dot_products;
+
+	} ; // end class tuned_dot_product
+
+	class tuned_vector_length : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				v1x = new tuned_valarray(size, 1.0f);
+				v1y = new tuned_valarray(size, 2.0f);
+				v1z = new tuned_valarray(size, 3.0f);
+				v1w = new tuned_valarray(size, 4.0f);
+
+				lengths = new tuned_valarray(size);
+			}
+
+			void run()
+			{
+				*lengths =
+					sqrt(
+						*v1x * *v1x +
+						*v1y * *v1y +
+						*v1z * *v1z +
+						*v1w * *v1w
+					);
+			}
+
+			void teardown()
+			{
+				delete lengths;
+
+				delete v1x;
+				delete v1y;
+				delete v1z;
+				delete v1w;
+			}
+
+		private:
+
+			tuned_valarray* v1x;
+			tuned_valarray* v1y;
+			tuned_valarray* v1z;
+			tuned_valarray* v1w;
+
+			tuned_valarray* lengths;
+
+	} ; // end class tuned_vector_length
+
+	const performance_test_info expressions[] =
+	{
+		{ "dot_product", &create_performance_test<tuned_dot_product>, 9 * sizeof(float), 7 },
+		{ "vector_length", &create_performance_test<tuned_vector_length>, 5 * sizeof(float), 8 }
+	};
+
+	const std::size_t expression_count = sizeof(expressions) / sizeof(expressions[0]);
+
+//---------------------------------------------------------------------
+// Measurement
+//---------------------------------------------------------------------
+
+	// Total median time of the representative expressions with a profile
+	double measure(const tuning::tuning_profile& profile, std::size_t size, std::size_t repeat)
+	{
+		tuning::set_profile(profile);
+
+		benchmark_options options;
+		options.size = size;
+		options.repeat = repeat;
+		options.warmup = std::max<std::size_t>(1, repeat / 10);
+
+		double total = 0.0;
+
+		for (std::size_t i = 0; i < expression_count; ++i)
+			total += run_benchmark(expressions[i], options).median;
+
+		return total;
+	}
+
+	// Keeps the repeat count high for small sizes so each point takes a
+	// similar amount of time
+	std::size_t repeat_for(std::size_t size, std::size_t repeat, std::size_t reference)
+	{
+		return std::max<std::size_t>(5, std::min<std::size_t>(repeat * 100, repeat * reference / size));
+	}
+
+	// Smallest size from which the candidate is faster than the baseline
+	// at every larger size, or the largest representable size if never
+	std::size_t find_threshold(const std::vector<std::size_t>& sizes, const std::vector<double>& baseline, const std::vector<double>& candidate)
+	{
+		std::size_t threshold = (std::size_t)-1;
+
+		for (std::size_t i = sizes.size(); i-- > 0; )
+		{
+			if (candidate[i] >= baseline[i])
+				break;
+
+			threshold = sizes[i];
+		}
+
+		return threshold;
+	}
+
+	void print_usage(const char* program)
+	{
+		std::cout << "Usage: " << program << " [options]\n"
+		          << "  --size N         Values in the largest arrays (default 4M)\n"
+		          << "  --repeat N       Timed runs at the largest size (default 10)\n"
+		          << "  --threads N      Most threads to try (default all processors)\n"
+		          << "  --output path    Profile to write (default the loaded profile path)\n";
+	}
+}
+
+//---------------------------------------------------------------------
+// Main
+//---------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	std::size_t size = 1 << 22;
+	std::size_t repeat = 10;
+	std::size_t max_threads = threading::hardware_concurrency();
+	std::string output = tuning::get_profile_path();
+
+	// Parse the command line
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const bool has_value = (i + 1 < argc);
+
+		if ((std::strcmp(arg, "--size") == 0) && has_value)
+			size = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--repeat") == 0) && has_value)
+			repeat = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--threads") == 0) && has_value)
+			max_threads = std::max<std::size_t>(1, std::strtoul(argv[++i], 0, 10));
+		else if ((std::strcmp(arg, "--output") == 0) && has_value)
+			output = argv[++i];
+		else
+		{
+			print_usage(argv[0]);
+
+			return 1;
+		}
+	}
+
+	// Initialize the timer
+	system_time::initialize();
+
+	tuning::tuning_profile best;
+	best.host = system_info::get_host_name();
+
+	// Unrolling only shows once the loop is not waiting on memory, so it
+	// is chosen on arrays that fit in the cache
+	{
+		const std::size_t cached = 1 << 12;
+		const std::size_t unrolls[] = { 1, 2, 4, 8 };
+		double fastest = 0.0;
+
+		for (std::size_t i = 0; i < 4; ++i)
+		{
+			tuning::tuning_profile profile = best;
+			profile.unroll = unrolls[i];
+
+			const double time = measure(profile, cached, repeat_for(cached, repeat, size));
+
+			std::cout << "unroll " << profile.unroll << ": " << time * 1e6 << " us\n";
+
+			if ((i == 0) || (time < fastest))
+			{
+				fastest = time;
+				best.unroll = profile.unroll;
+			}
+		}
+	}
+
+	const std::vector<std::size_t> sizes = sweep_sizes(1 << 12, size, 1);
+
+	// Streaming stores against cached stores at each size, single threaded
+	{
+		std::vector<double> cached;
+		std::vector<double> streamed;
+
+		for (std::size_t i = 0; i < sizes.size(); ++i)
+		{
+			tuning::tuning_profile profile = best;
+			const std::size_t count = repeat_for(sizes[i], repeat, size);
+
+			profile.streaming_threshold = (std::size_t)-1;
+			cached.push_back(measure(profile, sizes[i], count));
+
+			profile.streaming_threshold = 0;
+			streamed.push_back(measure(profile, sizes[i], count));
+
+			std::cout << "streaming at " << sizes[i] << " values: " << cached.back() * 1e6 << " us cached, " << streamed.back() * 1e6 << " us streamed\n";
+		}
+
+		const std::size_t threshold = find_threshold(sizes, cached, streamed);
+
+		// The threshold is in bytes written
+		best.streaming_threshold = (threshold == (std::size_t)-1) ? threshold : threshold * sizeof(float);
+	}
+
+	// Thread count at the largest size, preferring fewer threads unless
+	// more are clearly faster
+	{
+		double fastest = 0.0;
+
+		for (std::size_t threads = 1; threads <= max_threads; ++threads)
+		{
+			tuning::tuning_profile profile = best;
+			profile.threads = threads;
+			profile.parallel_threshold = 0;
+
+			const double time = measure(profile, size, repeat);
+
+			std::cout << "threads " << threads << ": " << time * 1e6 << " us\n";
+
+			if ((threads == 1) || (time < fastest * 0.95))
+			{
+				fastest = time;
+				best.threads = threads;
+			}
+		}
+	}
+
+	if (best.threads > 1)
+	{
+		// Block size with the chosen thread count
+		const std::size_t blocks[] = { 256, 1024, 4096, 16384, 65536 };
+		double fastest = 0.0;
+
+		for (std::size_t i = 0; i < 5; ++i)
+		{
+			tuning::tuning_profile profile = best;
+			profile.block_size = blocks[i];
+			profile.parallel_threshold = 0;
+
+			const double time = measure(profile, size, repeat);
+
+			std::cout << "block size " << profile.block_size << ": " << time * 1e6 << " us\n";
+
+			if ((i == 0) || (time < fastest))
+			{
+				fastest = time;
+				best.block_size = profile.block_size;
+			}
+		}
+
+		// Smallest expression worth splitting between threads
+		std::vector<double> serial;
+		std::vector<double> parallel;
+
+		for (std::size_t i = 0; i < sizes.size(); ++i)
+		{
+			tuning::tuning_profile profile = best;
+			const std::size_t count = repeat_for(sizes[i], repeat, size);
+
+			profile.parallel_threshold = (std::size_t)-1;
+			serial.push_back(measure(profile, sizes[i], count));
+
+			profile.parallel_threshold = 0;
+			parallel.push_back(measure(profile, sizes[i], count));
+
+			std::cout << "parallel at " << sizes[i] << " values: " << serial.back() * 1e6 << " us serial, " << parallel.back() * 1e6 << " us parallel\n";
+		}
+
+		best.parallel_threshold = find_threshold(sizes, serial, parallel);
+	}
+
+	if (best.parallel_threshold == (std::size_t)-1)
+		best.threads = 1;
+
+	std::cout << "\n";
+
+	if (!tuning::write_profile(output.c_str(), best))
+	{
+		std::cerr << "Unable to write " << output << "\n";
+
+		return 1;
+	}
+
+	std::cout << "Wrote the profile for " << best.host << " to " << output << "\n";
+
+	// Terminate the timer
+	system_time::terminate();
+
+	return 0;
+}
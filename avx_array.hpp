@@ -21,6 +21,16 @@ namespace expression_template_simd
 		return _mm256_mul_ps(lhs, rhs);
 	}
 
+	INLINE __m256 sub(const __m256& lhs, const __m256& rhs)
+	{
+		return _mm256_sub_ps(lhs, rhs);
+	}
+
+	INLINE __m256 div(const __m256& lhs, const __m256& rhs)
+	{
+		return _mm256_div_ps(lhs, rhs);
+	}
+
 	INLINE __m256 madd(const __m256& a, const __m256& b, const __m256& c)
 	{
 		return _mm256_add_ps(a, _mm256_mul_ps(b, c));
@@ -31,9 +41,33 @@ namespace expression_template_simd
 		return _mm256_sqrt_ps(v);
 	}
 
+	// Store that bypasses the cache, the address must be aligned
+	INLINE void stream(__m256* address, const __m256& value)
+	{
+		_mm256_stream_ps((float*)address, value);
+	}
+
+	// Writes the lanes in order, the address need not be aligned
+	INLINE void store(float* address, const __m256& value)
+	{
+		_mm256_storeu_ps(address, value);
+	}
+
 	INLINE float get(const __m256& value, std::size_t i)
 	{
-		return value.m256_f32[i];
+		float values[8];
+		store(values, value);
+
+		return values[i];
+	}
+
+	template <typename Element>
+	Element splat(float value);
+
+	template <>
+	INLINE __m256 splat<__m256>(float value)
+	{
+		return _mm256_set1_ps(value);
 	}
 
 	template <typename Real>
@@ -75,7 +109,7 @@ namespace expression_template_simd
 				: _size(copy._size)
 				, _elements(copy._elements)
 			{
-				 _values = (element_type*)_mm_malloc(_elements, alignment());
+				 _values = (element_type*)_mm_malloc(_elements * sizeof(element_type), alignment());
 
 				 swap(copy);
 			}
@@ -101,6 +135,16 @@ namespace expression_template_simd
 				return _values[i];
 			}
 
+			INLINE const element_type* data() const
+			{
+				return _values;
+			}
+
+			INLINE element_type* data()
+			{
+				return _values;
+			}
+
 			INLINE float operator[] (std::size_t i) const
 			{
 				assert(i < _size);
@@ -149,4 +193,23 @@ namespace expression_template_simd
 
 } // end namespace expression_template_simd
 
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real>
+	struct expression_signature<expression_template_simd::valarray_rep_avx<Real> >
+	{
+		enum { bytes_per_value = sizeof(Real) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "avx";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_avx<Real> >
+}
+
+#endif
+
 #endif // end AVX_ARRAY_HPP_INCLUDED
@@ -0,0 +1,572 @@
+#include "benchmark.hpp"
+#ifdef USE_THREADS
+#include "thread_pool.hpp"
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	// Linear interpolation between the closest ranks of sorted samples
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.0;
+
+		const double rank = p * (sorted.size() - 1);
+		const std::size_t lower = (std::size_t)rank;
+		const std::size_t upper = std::min(lower + 1, sorted.size() - 1);
+		const double fraction = rank - lower;
+
+		return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+	}
+
+#ifdef USE_THREADS
+	void run_partition_task(void* context, std::size_t index, std::size_t count)
+	{
+		((performance_test*)context)->run_partition(index, count);
+	}
+#else
+	class thread_pool;
+#endif
+
+	// Runs the kernel once, split across the pool when there is one
+	inline void run_test(performance_test* test, thread_pool* pool)
+	{
+#ifdef USE_THREADS
+		if (pool)
+		{
+			pool->run(&run_partition_task, test);
+			return;
+		}
+#endif
+		test->run();
+	}
+
+	const char* cache_level(double working_set, const system_info::cache_sizes& caches)
+	{
+		if ((caches.l1 > 0) && (working_set <= caches.l1))
+			return "L1";
+		if ((caches.l2 > 0) && (working_set <= caches.l2))
+			return "L2";
+		if ((caches.l3 > 0) && (working_set <= caches.l3))
+			return "L3";
+
+		return "DRAM";
+	}
+
+	void print_bytes(std::ostream& out, double bytes)
+	{
+		if (bytes >= 1024.0 * 1024.0 * 1024.0)
+			out << bytes / (1024.0 * 1024.0 * 1024.0) << " GB";
+		else if (bytes >= 1024.0 * 1024.0)
+			out << bytes / (1024.0 * 1024.0) << " MB";
+		else
+			out << bytes / 1024.0 << " KB";
+	}
+}
+
+benchmark_result run_benchmark(const performance_test_info& info, const benchmark_options& options)
+{
+	std::vector<double> samples;
+	samples.reserve(options.repeat);
+
+	// Opened first so that the counters also cover the threads the kernel
+	// and the pool start
+	timer clock(options.counters);
+
+	// Setup the kernel once, all runs share the same buffers
+	performance_test* test = info.create();
+	test->setup(options.size);
+
+	thread_pool* pool = 0;
+
+#ifdef USE_THREADS
+	if ((options.threads > 0) && test->supports_partition())
+		pool = new thread_pool(options.threads);
+#endif
+
+	for (std::size_t i = 0; i < options.warmup; ++i)
+		run_test(test, pool);
+
+	performance_counters totals = { 0, 0, 0, 0, 0, 0 };
+
+	for (std::size_t i = 0; i < options.repeat; ++i)
+	{
+		clock.start();
+
+		run_test(test, pool);
+
+		clock.stop();
+
+		samples.push_back(clock.elapsed_time());
+
+		if (clock.has_counters())
+		{
+			const performance_counters counters = clock.counters();
+
+			totals.cycles        += counters.cycles;
+			totals.instructions  += counters.instructions;
+			totals.l1_misses     += counters.l1_misses;
+			totals.llc_misses    += counters.llc_misses;
+			totals.dtlb_misses   += counters.dtlb_misses;
+			totals.branch_misses += counters.branch_misses;
+		}
+	}
+
+	// Compute the statistics
+	benchmark_result result;
+	result.verified = test->verify();
+	result.name = info.name;
+	result.size = options.size;
+	result.repeat = options.repeat;
+	result.threads = 1;
+
+#ifdef USE_THREADS
+	if (pool)
+	{
+		result.threads = pool->size();
+		delete pool;
+	}
+#endif
+
+	test->teardown();
+	delete test;
+
+	result.working_set = info.bytes_per_element * options.size;
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (std::size_t i = 0; i < samples.size(); ++i)
+		sum += samples[i];
+
+	result.mean = samples.empty() ? 0.0 : sum / samples.size();
+
+	double variance = 0.0;
+	for (std::size_t i = 0; i < samples.size(); ++i)
+		variance += (samples[i] - result.mean) * (samples[i] - result.mean);
+
+	result.deviation = (samples.size() > 1) ? std::sqrt(variance / (samples.size() - 1)) : 0.0;
+
+	result.minimum = samples.empty() ? 0.0 : samples.front();
+	result.maximum = samples.empty() ? 0.0 : samples.back();
+	result.median  = percentile(samples, 0.50);
+	result.p5      = percentile(samples, 0.05);
+	result.p95     = percentile(samples, 0.95);
+	result.p99     = percentile(samples, 0.99);
+
+	if (result.median > 0.0)
+	{
+		result.gigabytes_per_second = (info.bytes_per_element * options.size) / result.median * 1e-9;
+		result.gigaflops = (info.flops_per_element * options.size) / result.median * 1e-9;
+	}
+	else
+	{
+		result.gigabytes_per_second = 0.0;
+		result.gigaflops = 0.0;
+	}
+
+	result.nanoseconds_per_element = (options.size > 0) ? result.median / options.size * 1e9 : 0.0;
+	result.percent_of_peak_bandwidth = 0.0;
+	result.percent_of_peak_flops = 0.0;
+
+	const double values = (double)options.size * options.repeat;
+
+	result.has_counters = clock.has_counters() && (values > 0.0);
+	result.instructions_per_cycle    = (totals.cycles > 0) ? (double)totals.instructions / totals.cycles : 0.0;
+	result.cycles_per_element        = result.has_counters ? totals.cycles / values : 0.0;
+	result.l1_misses_per_element     = result.has_counters ? totals.l1_misses / values : 0.0;
+	result.llc_misses_per_element    = result.has_counters ? totals.llc_misses / values : 0.0;
+	result.dtlb_misses_per_element   = result.has_counters ? totals.dtlb_misses / values : 0.0;
+	result.branch_misses_per_element = result.has_counters ? totals.branch_misses / values : 0.0;
+
+	return result;
+}
+
+bool matches_filter(const char* name, const std::string& filter)
+{
+	if (filter.empty())
+		return true;
+
+	const char* short_name = std::strrchr(name, '/');
+	short_name = (short_name) ? short_name + 1 : name;
+
+	std::string::size_type start = 0;
+
+	while (start <= filter.size())
+	{
+		std::string::size_type end = filter.find(',', start);
+
+		if (end == std::string::npos)
+			end = filter.size();
+
+		const std::string entry = filter.substr(start, end - start);
+
+		if ((entry == name) || (entry == short_name))
+			return true;
+
+		start = end + 1;
+	}
+
+	return false;
+}
+
+std::vector<std::size_t> sweep_sizes(std::size_t minimum, std::size_t maximum, std::size_t steps_per_octave)
+{
+	const std::size_t granularity = 16;
+
+	std::vector<std::size_t> sizes;
+
+	if (steps_per_octave == 0)
+		steps_per_octave = 1;
+
+	for (std::size_t step = 0; ; ++step)
+	{
+		const double size = minimum * std::pow(2.0, (double)step / steps_per_octave);
+
+		if (size > maximum)
+			break;
+
+		std::size_t rounded = ((std::size_t)(size + 0.5) / granularity) * granularity;
+
+		if (rounded < granularity)
+			rounded = granularity;
+
+		if (sizes.empty() || (rounded != sizes.back()))
+			sizes.push_back(rounded);
+	}
+
+	return sizes;
+}
+
+void apply_machine_peak(std::vector<benchmark_result>& results, const machine_peak& peak)
+{
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		benchmark_result& result = results[i];
+
+		result.percent_of_peak_bandwidth = (peak.gigabytes_per_second > 0.0) ? result.gigabytes_per_second / peak.gigabytes_per_second * 100.0 : 0.0;
+		result.percent_of_peak_flops = (peak.gigaflops > 0.0) ? result.gigaflops / peak.gigaflops * 100.0 : 0.0;
+	}
+}
+
+void print_machine_peak(std::ostream& out, const machine_peak& peak)
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out.setf(std::ios::fixed, std::ios::floatfield);
+
+	out << std::setprecision(2)
+	    << "STREAM GB/s: copy " << peak.bandwidth[0]
+	    << ", scale " << peak.bandwidth[1]
+	    << ", add " << peak.bandwidth[2]
+	    << ", triad " << peak.bandwidth[3]
+	    << "; peak GFLOP/s " << peak.gigaflops << "\n";
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void print_results(std::ostream& out, const std::vector<benchmark_result>& results)
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out.setf(std::ios::fixed, std::ios::floatfield);
+
+	bool has_peak = false;
+	for (std::size_t i = 0; i < results.size(); ++i)
+		has_peak = has_peak || (results[i].percent_of_peak_bandwidth > 0.0) || (results[i].percent_of_peak_flops > 0.0);
+
+	out << std::left << std::setw(44) << "Kernel" << std::right
+	    << std::setw(12) << "median us"
+	    << std::setw(12) << "p5 us"
+	    << std::setw(12) << "p95 us"
+	    << std::setw(12) << "p99 us"
+	    << std::setw(10) << "stddev %"
+	    << std::setw(10) << "GB/s"
+	    << std::setw(10) << "GFLOP/s"
+	    << std::setw(10) << "ns/elem";
+
+	if (has_peak)
+		out << std::setw(10) << "% BW" << std::setw(10) << "% FLOP";
+
+	out << "\n";
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const benchmark_result& result = results[i];
+
+		out << std::left << std::setw(44) << result.name << std::right << std::setprecision(2)
+		    << std::setw(12) << result.median * 1e6
+		    << std::setw(12) << result.p5 * 1e6
+		    << std::setw(12) << result.p95 * 1e6
+		    << std::setw(12) << result.p99 * 1e6
+		    << std::setw(10) << ((result.mean > 0.0) ? result.deviation / result.mean * 100.0 : 0.0)
+		    << std::setw(10) << result.gigabytes_per_second
+		    << std::setw(10) << result.gigaflops
+		    << std::setprecision(4)
+		    << std::setw(10) << result.nanoseconds_per_element;
+
+		if (has_peak)
+		{
+			out << std::setprecision(1)
+			    << std::setw(10) << result.percent_of_peak_bandwidth
+			    << std::setw(10) << result.percent_of_peak_flops;
+		}
+
+		out << "\n";
+	}
+
+	bool has_counters = false;
+	for (std::size_t i = 0; i < results.size(); ++i)
+		has_counters = has_counters || results[i].has_counters;
+
+	if (has_counters)
+	{
+		out << "\n" << std::left << std::setw(44) << "Hardware counters per element" << std::right
+		    << std::setw(10) << "IPC"
+		    << std::setw(12) << "cycles"
+		    << std::setw(12) << "L1 miss"
+		    << std::setw(12) << "LLC miss"
+		    << std::setw(12) << "dTLB miss"
+		    << std::setw(12) << "br miss" << "\n";
+
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			const benchmark_result& result = results[i];
+
+			if (!result.has_counters)
+				continue;
+
+			out << std::left << std::setw(44) << result.name << std::right << std::setprecision(2)
+			    << std::setw(10) << result.instructions_per_cycle
+			    << std::setprecision(4)
+			    << std::setw(12) << result.cycles_per_element
+			    << std::setw(12) << result.l1_misses_per_element
+			    << std::setw(12) << result.llc_misses_per_element
+			    << std::setw(12) << result.dtlb_misses_per_element
+			    << std::setw(12) << result.branch_misses_per_element << "\n";
+		}
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void print_sweep(std::ostream& out, const std::vector<benchmark_result>& results, const system_info::cache_sizes& caches)
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out.setf(std::ios::fixed, std::ios::floatfield);
+	out << std::setprecision(2);
+
+	out << "Cache sizes: L1 ";
+	print_bytes(out, (double)caches.l1);
+	out << ", L2 ";
+	print_bytes(out, (double)caches.l2);
+	out << ", L3 ";
+	print_bytes(out, (double)caches.l3);
+	out << "\n";
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const benchmark_result& result = results[i];
+		const bool first = (i == 0) || (results[i - 1].name != result.name);
+		const char* level = cache_level(result.working_set, caches);
+
+		if (first)
+		{
+			out << "\n" << result.name << "\n"
+			    << std::setw(12) << "elements"
+			    << std::setw(14) << "working set"
+			    << std::setw(8) << "level"
+			    << std::setw(12) << "median us"
+			    << std::setw(10) << "GB/s"
+			    << std::setw(10) << "GFLOP/s"
+			    << std::setw(10) << "ns/elem" << "\n";
+		}
+		else if (std::strcmp(level, cache_level(results[i - 1].working_set, caches)) != 0)
+		{
+			out << "  ---- working set exceeds " << cache_level(results[i - 1].working_set, caches) << " ----\n";
+		}
+
+		std::ostringstream working_set;
+		working_set.setf(std::ios::fixed, std::ios::floatfield);
+		working_set << std::setprecision(1);
+		print_bytes(working_set, result.working_set);
+
+		out << std::setw(12) << result.size
+		    << std::setw(14) << working_set.str()
+		    << std::setw(8) << level
+		    << std::setw(12) << result.median * 1e6
+		    << std::setw(10) << result.gigabytes_per_second
+		    << std::setw(10) << result.gigaflops
+		    << std::setprecision(4)
+		    << std::setw(10) << result.nanoseconds_per_element << "\n"
+		    << std::setprecision(2);
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void print_scaling(std::ostream& out, const std::vector<benchmark_result>& results, const std::vector<benchmark_result>& triad)
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out.setf(std::ios::fixed, std::ios::floatfield);
+	out << std::setprecision(2);
+
+	std::size_t baseline = 0;
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const benchmark_result& result = results[i];
+
+		if ((i == 0) || (results[i - 1].name != result.name))
+		{
+			baseline = i;
+
+			out << "\n" << result.name << "\n"
+			    << std::setw(8) << "threads"
+			    << std::setw(12) << "median us"
+			    << std::setw(10) << "speedup"
+			    << std::setw(14) << "efficiency %"
+			    << std::setw(10) << "GB/s"
+			    << std::setw(12) << "triad GB/s"
+			    << std::setw(10) << "% triad" << "\n";
+		}
+
+		// Speedup is relative to the first run, on a single thread
+		const double speedup = (result.median > 0.0) ? results[baseline].median / result.median : 0.0;
+
+		double triad_bandwidth = 0.0;
+
+		for (std::size_t j = 0; j < triad.size(); ++j)
+		{
+			if (triad[j].threads == result.threads)
+				triad_bandwidth = triad[j].gigabytes_per_second;
+		}
+
+		out << std::setw(8) << result.threads
+		    << std::setw(12) << result.median * 1e6
+		    << std::setw(10) << speedup
+		    << std::setw(14) << speedup / result.threads * 100.0
+		    << std::setw(10) << result.gigabytes_per_second
+		    << std::setw(12) << triad_bandwidth
+		    << std::setw(10) << ((triad_bandwidth > 0.0) ? result.gigabytes_per_second / triad_bandwidth * 100.0 : 0.0) << "\n";
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+bool write_json(const char* path, const std::vector<benchmark_result>& results)
+{
+	std::ofstream out(path);
+
+	if (!out)
+		return false;
+
+	out.precision(12);
+
+	out << "[\n";
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const benchmark_result& result = results[i];
+
+		out << "\t{\n"
+		    << "\t\t\"name\": \"" << result.name << "\",\n"
+		    << "\t\t\"size\": " << result.size << ",\n"
+		    << "\t\t\"repeat\": " << result.repeat << ",\n"
+		    << "\t\t\"threads\": " << result.threads << ",\n"
+		    << "\t\t\"working_set\": " << result.working_set << ",\n"
+		    << "\t\t\"min\": " << result.minimum << ",\n"
+		    << "\t\t\"max\": " << result.maximum << ",\n"
+		    << "\t\t\"mean\": " << result.mean << ",\n"
+		    << "\t\t\"stddev\": " << result.deviation << ",\n"
+		    << "\t\t\"median\": " << result.median << ",\n"
+		    << "\t\t\"p5\": " << result.p5 << ",\n"
+		    << "\t\t\"p95\": " << result.p95 << ",\n"
+		    << "\t\t\"p99\": " << result.p99 << ",\n"
+		    << "\t\t\"gb_per_s\": " << result.gigabytes_per_second << ",\n"
+		    << "\t\t\"gflop_per_s\": " << result.gigaflops << ",\n"
+		    << "\t\t\"ns_per_element\": " << result.nanoseconds_per_element << ",\n"
+		    << "\t\t\"percent_of_peak_bandwidth\": " << result.percent_of_peak_bandwidth << ",\n"
+		    << "\t\t\"percent_of_peak_flops\": " << result.percent_of_peak_flops;
+
+		if (result.has_counters)
+		{
+			out << ",\n"
+			    << "\t\t\"ipc\": " << result.instructions_per_cycle << ",\n"
+			    << "\t\t\"cycles_per_element\": " << result.cycles_per_element << ",\n"
+			    << "\t\t\"l1_misses_per_element\": " << result.l1_misses_per_element << ",\n"
+			    << "\t\t\"llc_misses_per_element\": " << result.llc_misses_per_element << ",\n"
+			    << "\t\t\"dtlb_misses_per_element\": " << result.dtlb_misses_per_element << ",\n"
+			    << "\t\t\"branch_misses_per_element\": " << result.branch_misses_per_element;
+		}
+
+		out << "\n"
+		    << "\t}" << ((i + 1 < results.size()) ? "," : "") << "\n";
+	}
+
+	out << "]\n";
+
+	return out.good();
+}
+
+bool write_csv(const char* path, const std::vector<benchmark_result>& results)
+{
+	std::ofstream out(path);
+
+	if (!out)
+		return false;
+
+	out.precision(12);
+
+	out << "name,size,repeat,threads,working_set,min,max,mean,stddev,median,p5,p95,p99,gb_per_s,gflop_per_s,ns_per_element,percent_of_peak_bandwidth,percent_of_peak_flops,"
+	       "ipc,cycles_per_element,l1_misses_per_element,llc_misses_per_element,dtlb_misses_per_element,branch_misses_per_element\n";
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const benchmark_result& result = results[i];
+
+		out << result.name << ','
+		    << result.size << ','
+		    << result.repeat << ','
+		    << result.threads << ','
+		    << result.working_set << ','
+		    << result.minimum << ','
+		    << result.maximum << ','
+		    << result.mean << ','
+		    << result.deviation << ','
+		    << result.median << ','
+		    << result.p5 << ','
+		    << result.p95 << ','
+		    << result.p99 << ','
+		    << result.gigabytes_per_second << ','
+		    << result.gigaflops << ','
+		    << result.nanoseconds_per_element << ','
+		    << result.percent_of_peak_bandwidth << ','
+		    << result.percent_of_peak_flops << ','
+		    << result.instructions_per_cycle << ','
+		    << result.cycles_per_element << ','
+		    << result.l1_misses_per_element << ','
+		    << result.llc_misses_per_element << ','
+		    << result.dtlb_misses_per_element << ','
+		    << result.branch_misses_per_element << '\n';
+	}
+
+	return out.good();
+}
@@ -0,0 +1,120 @@
+#ifndef BENCHMARK_HPP_INCLUDED
+#define BENCHMARK_HPP_INCLUDED
+
+#include "performance_test.hpp"
+#include "system_info.hpp"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Benchmark harness
+//---------------------------------------------------------------------
+
+struct benchmark_options
+{
+	std::size_t size;
+	std::size_t repeat;
+	std::size_t warmup;
+	bool counters;
+	// Zero runs the kernel directly, otherwise partitioned kernels are run
+	// on a pool of this many pinned threads
+	std::size_t threads;
+
+	benchmark_options()
+		: size(1000000)
+		, repeat(100)
+		, warmup(10)
+		, counters(false)
+		, threads(0)
+	{ }
+
+} ; // end struct benchmark_options
+
+// Measured limits of the machine, see measure_machine_peak(). Bytes are
+// counted without write allocation, as STREAM does, so kernels that mostly
+// read can go past 100% of the peak bandwidth.
+struct machine_peak
+{
+	// GB/s of the STREAM copy, scale, add and triad kernels
+	double bandwidth[4];
+	// Best of the four
+	double gigabytes_per_second;
+	// Single threaded multiply-add rate
+	double gigaflops;
+
+} ; // end struct machine_peak
+
+// Timing statistics for one kernel. Times are in seconds and the derived
+// rates are computed from the median.
+struct benchmark_result
+{
+	std::string name;
+	std::size_t size;
+	std::size_t repeat;
+	std::size_t threads;
+	double working_set;
+
+	double minimum;
+	double maximum;
+	double mean;
+	double deviation;
+	double median;
+	double p5;
+	double p95;
+	double p99;
+
+	double gigabytes_per_second;
+	double gigaflops;
+	double nanoseconds_per_element;
+
+	// Zero until set by apply_machine_peak()
+	double percent_of_peak_bandwidth;
+	double percent_of_peak_flops;
+
+	// Hardware counters averaged over the timed runs, per value
+	bool has_counters;
+	double instructions_per_cycle;
+	double cycles_per_element;
+	double l1_misses_per_element;
+	double llc_misses_per_element;
+	double dtlb_misses_per_element;
+	double branch_misses_per_element;
+
+	// False if the kernel found its results were wrong
+	bool verified;
+
+} ; // end struct benchmark_result
+
+// Runs the kernel warmup times, then times repeat runs over the same buffers
+benchmark_result run_benchmark(const performance_test_info& info, const benchmark_options& options);
+
+// True if the name matches any entry of a comma separated list. An entry
+// matches the full name or the part after the '/'.
+bool matches_filter(const char* name, const std::string& filter);
+
+// Geometrically spaced sizes from minimum to maximum, rounded to a multiple
+// of the widest SIMD register so every element is fully populated
+std::vector<std::size_t> sweep_sizes(std::size_t minimum, std::size_t maximum, std::size_t steps_per_octave);
+
+// Fills in the percent of peak for each result
+void apply_machine_peak(std::vector<benchmark_result>& results, const machine_peak& peak);
+
+void print_machine_peak(std::ostream& out, const machine_peak& peak);
+
+void print_results(std::ostream& out, const std::vector<benchmark_result>& results);
+
+// Prints a throughput curve for each kernel, marking where the working set
+// no longer fits in each level of the cache
+void print_sweep(std::ostream& out, const std::vector<benchmark_result>& results, const system_info::cache_sizes& caches);
+
+// Prints speedup and parallel efficiency for each kernel over the thread
+// counts it was run at, against the STREAM triad at the same thread count.
+// The triad results are matched to the kernel results by thread count.
+void print_scaling(std::ostream& out, const std::vector<benchmark_result>& results, const std::vector<benchmark_result>& triad);
+
+bool write_json(const char* path, const std::vector<benchmark_result>& results);
+
+bool write_csv(const char* path, const std::vector<benchmark_result>& results);
+
+#endif // end BENCHMARK_HPP_INCLUDED
@@ -7,6 +7,14 @@
 //#define USE_AVX
 // Uncomment/comment to enable/disable NEON computations
 //#define USE_NEON
+// Uncomment/comment to enable/disable F16C IEEE half precision storage
+//#define USE_F16C
+// Uncomment/comment to enable/disable the multithreaded benchmark modes
+#define USE_THREADS
+// Uncomment/comment to enable/disable recording every expression evaluated
+//#define USE_PROFILING
+// Uncomment/comment to enable/disable native code for runtime formulas
+#define USE_JIT
 
 #ifdef _WIN32
 #define INLINE __forceinline
@@ -15,9 +23,13 @@
 #endif
 
 #include "timer.hpp"
+#ifdef USE_PROFILING
+	#include "profiling.hpp"
+#endif
 #include "naive_implementation.hpp"
 #include "expression_template.hpp"
-#include "expression_template_simd.hpp"
+// The SIMD kernels must be declared ahead of the expression nodes that
+// call them, since the vector types have no namespace for ADL to find.
 #ifdef USE_SSE
 	#include "sse_array.hpp"
 #endif
@@ -27,5 +39,30 @@
 #ifdef USE_NEON
 	#include "neon_array.hpp"
 #endif
+#include "threading.hpp"
+#ifdef USE_THREADS
+	#include "thread_pool.hpp"
+	#include "scheduler.hpp"
+#endif
+#include "expression_template_simd.hpp"
+#include "tuning.hpp"
+#include "snapshot.hpp"
+#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_NEON)
+	#include "evaluation.hpp"
+	#include "pipeline.hpp"
+	#include "reduction.hpp"
+	#include "formula.hpp"
+	#include "jit.hpp"
+	#include "fixed_array.hpp"
+	#include "small_array.hpp"
+	#include "generator.hpp"
+	#include "rewrite.hpp"
+	#include "tracking.hpp"
+	#include "memo.hpp"
+#endif
+#ifdef USE_SSE
+	#include "quantized_array.hpp"
+	#include "half_array.hpp"
+#endif
 
 #endif
@@ -0,0 +1,433 @@
+#ifndef EVALUATION_HPP_INCLUDED
+#define EVALUATION_HPP_INCLUDED
+
+#include <cstddef>
+
+namespace expression_template_simd
+{
+	template <bool Streaming>
+	struct valarray_store
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest& dest, const Src& src, std::size_t i)
+		{
+			dest(i) = src(i);
+		}
+
+	} ; // end valarray_store<Streaming>
+
+	template <>
+	struct valarray_store<true>
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest& dest, const Src& src, std::size_t i)
+		{
+			stream(&dest(i), src(i));
+		}
+
+	} ; // end valarray_store<true>
+
+	template <std::size_t Index, std::size_t Count, bool Streaming>
+	struct valarray_step
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest& dest, const Src& src, std::size_t base)
+		{
+			valarray_store<Streaming>::assign(dest, src, base + Index);
+
+			valarray_step<Index + 1, Count, Streaming>::assign(dest, src, base);
+		}
+
+	} ; // end valarray_step<Index, Count, Streaming>
+
+	template <std::size_t Count, bool Streaming>
+	struct valarray_step<Count, Count, Streaming>
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest&, const Src&, std::size_t)
+		{ }
+
+	} ; // end valarray_step<Count, Count, Streaming>
+
+	// Evaluates [begin, end) Unroll elements per iteration
+	template <std::size_t Unroll, bool Streaming>
+	struct valarray_block
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest& dest, const Src& src, std::size_t begin, std::size_t end)
+		{
+			std::size_t i = begin;
+
+			for (; i + Unroll <= end; i += Unroll)
+				valarray_step<0, Unroll, Streaming>::assign(dest, src, i);
+
+			for (; i < end; ++i)
+				valarray_store<Streaming>::assign(dest, src, i);
+		}
+
+	} ; // end valarray_block<Unroll, Streaming>
+
+	template <bool Streaming, typename Dest, typename Src>
+	INLINE void evaluate_block(Dest& dest, const Src& src, std::size_t begin, std::size_t end, std::size_t unroll)
+	{
+		switch (unroll)
+		{
+			case 8:  valarray_block<8, Streaming>::assign(dest, src, begin, end); break;
+			case 4:  valarray_block<4, Streaming>::assign(dest, src, begin, end); break;
+			case 2:  valarray_block<2, Streaming>::assign(dest, src, begin, end); break;
+			default: valarray_block<1, Streaming>::assign(dest, src, begin, end); break;
+		}
+	}
+
+	template <typename Dest, typename Src>
+	INLINE void evaluate_block(Dest& dest, const Src& src, std::size_t begin, std::size_t end, std::size_t unroll, bool streaming)
+	{
+		if (streaming)
+			evaluate_block<true>(dest, src, begin, end, unroll);
+		else
+			evaluate_block<false>(dest, src, begin, end, unroll);
+	}
+
+	INLINE void stream_fence()
+	{
+#if defined(USE_SSE) || defined(USE_AVX)
+		_mm_sfence();
+#endif
+	}
+
+#ifdef USE_THREADS
+	// Threads take blocks from a shared counter until none are left, so a
+	// slow thread does not hold up the others
+	template <typename Dest, typename Src>
+	struct valarray_parallel_task
+	{
+		Dest* dest;
+		const Src* src;
+		std::size_t elements;
+		std::size_t block_size;
+		std::size_t unroll;
+		bool streaming;
+		volatile std::size_t next;
+
+		static void run(void* context, std::size_t, std::size_t)
+		{
+			valarray_parallel_task& task = *(valarray_parallel_task*)context;
+
+			for (;;)
+			{
+				const std::size_t begin = threading::fetch_add(&task.next, task.block_size);
+
+				if (begin >= task.elements)
+					break;
+
+				const std::size_t end = (begin + task.block_size < task.elements) ? begin + task.block_size : task.elements;
+
+				evaluate_block(*task.dest, *task.src, begin, end, task.unroll, task.streaming);
+			}
+
+			if (task.streaming)
+				stream_fence();
+		}
+
+	} ; // end valarray_parallel_task<Dest, Src>
+#endif
+
+	// Evaluation loop driven by the tuning profile: blocks of the expression
+	// are split between threads once it is large enough, each block is
+	// unrolled, and stores bypass the cache past the streaming threshold.
+	template <typename Dest, typename Src>
+	void evaluate_tuned(Dest& dest, const Src& src)
+	{
+		const tuning::tuning_profile& profile = tuning::get_profile();
+
+		const std::size_t elements = dest.elements();
+		const bool streaming = elements * sizeof(typename Dest::element_type) >= profile.streaming_threshold;
+
+#ifdef USE_THREADS
+		if (dest.size() >= profile.parallel_threshold)
+		{
+			thread_pool* pool = tuning::acquire_thread_pool();
+
+			if (pool)
+			{
+				valarray_parallel_task<Dest, Src> task;
+				task.dest = &dest;
+				task.src = &src;
+				task.elements = elements;
+				task.block_size = profile.block_size;
+				task.unroll = profile.unroll;
+				task.streaming = streaming;
+				task.next = 0;
+
+				pool->run(&valarray_parallel_task<Dest, Src>::run, &task);
+
+				tuning::release_thread_pool();
+
+				return;
+			}
+		}
+#endif
+
+		evaluate_block(dest, src, 0, elements, profile.unroll, streaming);
+
+		if (streaming)
+			stream_fence();
+	}
+
+#ifdef USE_THREADS
+	// Assignment of [begin, end) of an expression. Ranges longer than the
+	// grain keep handing their upper half to the scheduler, so idle workers
+	// steal large pieces first and the owner works down to a single grain.
+	template <typename Dest, typename Src>
+	class valarray_range_task : public scheduler_task
+	{
+		public:
+
+			valarray_range_task(task_group& group, Dest& dest, const Src& src, std::size_t begin, std::size_t end, std::size_t grain, std::size_t unroll, bool streaming)
+				: scheduler_task(group)
+				, _dest(&dest)
+				, _src(src)
+				, _begin(begin)
+				, _end(end)
+				, _grain(grain)
+				, _unroll(unroll)
+				, _streaming(streaming)
+			{ }
+
+			void run(task_scheduler& scheduler, std::size_t worker)
+			{
+				while (_end - _begin > _grain)
+				{
+					const std::size_t middle = _begin + (_end - _begin) / 2;
+
+					scheduler.spawn(new valarray_range_task(group(), *_dest, _src, middle, _end, _grain, _unroll, _streaming), worker);
+
+					_end = middle;
+				}
+
+				evaluate_block(*_dest, _src, _begin, _end, _unroll, _streaming);
+
+				if (_streaming)
+					stream_fence();
+			}
+
+		private:
+
+			Dest* _dest;
+			typename valarray_operand<Src>::type _src;
+			std::size_t _begin;
+			std::size_t _end;
+			std::size_t _grain;
+			std::size_t _unroll;
+			bool _streaming;
+
+	} ; // end class valarray_range_task<Dest, Src>
+
+	// Queues dest = src on the scheduler as part of group
+	template <typename Real, typename Rep, typename Rep2>
+	void submit_assignment(task_scheduler& scheduler, task_group& group, valarray<Real, Rep>& dest, const valarray<Real, Rep2>& src, std::size_t grain)
+	{
+		assert(dest.elements() == src.elements());
+
+		typedef valarray<Real, Rep> dest_type;
+
+		const tuning::tuning_profile& profile = tuning::get_profile();
+
+		const std::size_t elements = dest.elements();
+		const bool streaming = elements * sizeof(typename dest_type::element_type) >= profile.streaming_threshold;
+
+		if (grain == 0)
+			grain = profile.block_size;
+
+		scheduler.submit(new valarray_range_task<dest_type, Rep2>(group, dest, src.rep(), 0, elements, grain, profile.unroll, streaming));
+	}
+
+	// A set of independent assignments evaluated together on a scheduler.
+	// The expressions are copied, but the arrays they read and write must
+	// stay alive and unchanged until wait() returns.
+	class expression_batch
+	{
+		public:
+
+			// Grain is the fewest SIMD elements a task is split down to,
+			// zero takes the block size of the tuning profile
+			explicit expression_batch(task_scheduler& scheduler, std::size_t grain = 0)
+				: _scheduler(scheduler)
+				, _grain(grain)
+			{ }
+
+			~expression_batch()
+			{
+				wait();
+			}
+
+			template <typename Real, typename Rep, typename Rep2>
+			void assign(valarray<Real, Rep>& dest, const valarray<Real, Rep2>& src)
+			{
+				submit_assignment(_scheduler, _group, dest, src, _grain);
+			}
+
+			// Runs tasks on the calling thread until the batch is done
+			void wait()
+			{
+				_scheduler.wait(_group);
+			}
+
+		private:
+
+			expression_batch(const expression_batch&);
+			expression_batch& operator= (const expression_batch&);
+
+			task_scheduler& _scheduler;
+			task_group _group;
+			std::size_t _grain;
+
+	} ; // end class expression_batch
+
+	// Handle to an evaluation started by evaluate_async(). Copies share the
+	// evaluation, and the last copy to go waits for it to finish.
+	class evaluation_future
+	{
+		public:
+
+			evaluation_future(task_scheduler& scheduler, const void* dest)
+				: _state(new state)
+			{
+				_state->scheduler = &scheduler;
+				_state->dest = dest;
+				_state->references = 1;
+			}
+
+			evaluation_future(const evaluation_future& copy)
+				: _state(copy._state)
+			{
+				threading::fetch_add(&_state->references, 1);
+			}
+
+			~evaluation_future()
+			{
+				release();
+			}
+
+			evaluation_future& operator= (const evaluation_future& copy)
+			{
+				threading::fetch_add(&copy._state->references, 1);
+
+				release();
+
+				_state = copy._state;
+
+				return *this;
+			}
+
+			// True once the destination holds the result
+			bool poll() const
+			{
+				return _state->group.finished();
+			}
+
+			// Runs tasks on the calling thread until the evaluation is done
+			void wait() const
+			{
+				_state->scheduler->wait(_state->group);
+			}
+
+			task_scheduler& scheduler() const
+			{
+				return *_state->scheduler;
+			}
+
+			task_group& group() const
+			{
+				return _state->group;
+			}
+
+		private:
+
+			struct state
+			{
+				task_scheduler* scheduler;
+				task_group group;
+				const void* dest;
+				volatile std::size_t references;
+			} ;
+
+			void release()
+			{
+				if (threading::fetch_add(&_state->references, (std::size_t)-1) != 1)
+					return;
+
+				wait();
+
+				clear_in_flight(_state->dest, _state->group);
+
+				delete _state;
+			}
+
+			state* _state;
+
+	} ; // end class evaluation_future
+
+	// Starts dest = src on the scheduler and returns without waiting. Until
+	// the future reports completion dest must not be read, and the arrays
+	// src reads must stay alive and unchanged. Assigning dest meanwhile, or
+	// evaluating into it again, waits for the evaluation to finish.
+	template <typename Real, typename Rep, typename Rep2>
+	evaluation_future evaluate_async(valarray<Real, Rep>& dest, const valarray<Real, Rep2>& src, task_scheduler& scheduler = task_scheduler::get_default())
+	{
+		evaluation_future future(scheduler, &dest);
+
+		// An earlier evaluation into dest has to finish first. Another thread
+		// may start one in between, so marking is retried.
+		while (!mark_in_flight(&dest, future.group()))
+			wait_in_flight(&dest);
+
+		submit_assignment(scheduler, future.group(), dest, src, 0);
+
+		return future;
+	}
+#endif
+
+	// The heap allocated arrays go through the tuned loop
+#ifdef USE_SSE
+	template <typename Real>
+	struct valarray_assign<valarray_rep_sse<Real> >
+	{
+		template <typename Src>
+		static INLINE void apply(valarray_rep_sse<Real>& dest, const Src& src)
+		{
+			evaluate_tuned(dest, src);
+		}
+
+	} ; // end valarray_assign<valarray_rep_sse<Real> >
+#endif
+
+#ifdef USE_AVX
+	template <typename Real>
+	struct valarray_assign<valarray_rep_avx<Real> >
+	{
+		template <typename Src>
+		static INLINE void apply(valarray_rep_avx<Real>& dest, const Src& src)
+		{
+			evaluate_tuned(dest, src);
+		}
+
+	} ; // end valarray_assign<valarray_rep_avx<Real> >
+#endif
+
+#ifdef USE_NEON
+	template <typename Real>
+	struct valarray_assign<valarray_rep_neon<Real> >
+	{
+		template <typename Src>
+		static INLINE void apply(valarray_rep_neon<Real>& dest, const Src& src)
+		{
+			evaluate_tuned(dest, src);
+		}
+
+	} ; // end valarray_assign<valarray_rep_neon<Real> >
+#endif
+
+} // end namespace expression_template_simd
+
+#endif // end EVALUATION_HPP_INCLUDED
@@ -79,6 +79,8 @@ namespace expression_template
 	{
 		public:
 
+			typedef Real element_type;
+
 			explicit valarray(std::size_t size)
 				: _rep(size)
 			{ }
@@ -107,11 +109,28 @@ namespace expression_template
 				return *this;
 			}
 
+			// Evaluates values [begin, end) only, so that disjoint ranges
+			// of one expression can be computed on separate threads
+			template <typename Rep2>
+			INLINE void assign(const valarray<Real, Rep2>& copy, std::size_t begin, std::size_t end)
+			{
+				assert((size() == copy.size()) && (end <= size()));
+
+				for (std::size_t i = begin; i < end; ++i)
+					_rep[i] = copy[i];
+			}
+
 			INLINE std::size_t size() const
 			{
 				return _rep.size();
 			}
 
+			// Values are evaluated one at a time
+			INLINE std::size_t elements() const
+			{
+				return _rep.size();
+			}
+
 			INLINE Real operator[] (std::size_t i) const
 			{
 				return _rep[i];
@@ -9,6 +9,70 @@ namespace expression_template_simd
 	template <typename Real>
 	class valarray_rep_sse;
 
+	// Evaluation loop used by valarray::operator=. Reps that know their
+	// element count at compile time specialize this to unroll the loop.
+	template <typename Rep>
+	struct valarray_assign
+	{
+		template <typename Src>
+		static INLINE void apply(Rep& dest, const Src& src)
+		{
+			for (std::size_t i = 0, count = dest.elements(); i < count; ++i)
+				dest(i) = src(i);
+		}
+
+	} ; // end valarray_assign<Rep>
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_add;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_mul;
+
+	template <typename Real, typename Op>
+	struct valarray_sqrt;
+
+	template <typename Real, typename Op>
+	struct valarray_square;
+
+	// How a node holds its operands. Arrays are held by reference, while
+	// nodes are copied so a tree can outlive the statement that built it
+	// and be evaluated later, on another thread.
+	template <typename Op>
+	struct valarray_operand
+	{
+		typedef const Op& type;
+
+	} ; // end valarray_operand<Op>
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_operand<valarray_add<Real, Op1, Op2> >
+	{
+		typedef const valarray_add<Real, Op1, Op2> type;
+
+	} ; // end valarray_operand<valarray_add<Real, Op1, Op2> >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_operand<valarray_mul<Real, Op1, Op2> >
+	{
+		typedef const valarray_mul<Real, Op1, Op2> type;
+
+	} ; // end valarray_operand<valarray_mul<Real, Op1, Op2> >
+
+	template <typename Real, typename Op>
+	struct valarray_operand<valarray_sqrt<Real, Op> >
+	{
+		typedef const valarray_sqrt<Real, Op> type;
+
+	} ; // end valarray_operand<valarray_sqrt<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct valarray_operand<valarray_square<Real, Op> >
+	{
+		typedef const valarray_square<Real, Op> type;
+
+	} ; // end valarray_operand<valarray_square<Real, Op> >
+
 	template <typename Real, typename Rep = valarray_rep_sse<Real> >
 	class valarray
 	{
@@ -37,13 +101,35 @@ namespace expression_template_simd
 			INLINE valarray& operator= (const valarray<Real, Rep2>& copy)
 			{
 				assert(elements() == copy.elements());
+#ifdef USE_THREADS
+				// Let an asynchronous evaluation into this array finish first
+				wait_in_flight(this);
+#endif
 
-				for (std::size_t i = 0, count = elements(); i < count; ++i)
-					_rep(i) = copy(i);
+#ifdef USE_PROFILING
+				const profiling::expression_scope<Real, Rep, Rep2> profile(size());
+#endif
+
+				valarray_assign<Rep>::apply(_rep, copy);
 
 				return *this;
 			}
 
+			// Evaluates elements [begin, end) only, so that disjoint ranges
+			// of one expression can be computed on separate threads
+			template <typename Rep2>
+			INLINE void assign(const valarray<Real, Rep2>& copy, std::size_t begin, std::size_t end)
+			{
+				assert((elements() == copy.elements()) && (end <= elements()));
+
+#ifdef USE_PROFILING
+				const profiling::expression_scope<Real, Rep, Rep2> profile((end - begin) * (sizeof(element_type) / sizeof(Real)));
+#endif
+
+				for (std::size_t i = begin; i < end; ++i)
+					_rep(i) = copy(i);
+			}
+
 			INLINE std::size_t size() const
 			{
 				return _rep.size();
@@ -74,6 +160,23 @@ namespace expression_template_simd
 				return _rep;
 			}
 
+			// For code that runs the assignment loop of the rep itself
+			INLINE Rep& rep()
+			{
+				return _rep;
+			}
+
+			// Only for reps that store their elements contiguously
+			INLINE const element_type* data() const
+			{
+				return _rep.data();
+			}
+
+			INLINE element_type* data()
+			{
+				return _rep.data();
+			}
+
 		private:
 
 			Rep _rep;
@@ -106,8 +209,8 @@ namespace expression_template_simd
 			return _op1.elements();
 		}
 
-		const Op1& _op1;
-		const Op2& _op2;
+		typename valarray_operand<Op1>::type _op1;
+		typename valarray_operand<Op2>::type _op2;
 
 	} ; // end valarray_add<Real, Op1, Op2>
 
@@ -137,8 +240,8 @@ namespace expression_template_simd
 			return _op1.elements();
 		}
 
-		const Op1& _op1;
-		const Op2& _op2;
+		typename valarray_operand<Op1>::type _op1;
+		typename valarray_operand<Op2>::type _op2;
 
 	} ; // end valarray_mul<Real, Op1, Op2>
 
@@ -169,11 +272,45 @@ namespace expression_template_simd
 			return _op1.elements();
 		}
 
-		const Op1& _op1;
-		const Op2& _op2;
-		const Op3& _op3;
+		typename valarray_operand<Op1>::type _op1;
+		typename valarray_operand<Op2>::type _op2;
+		typename valarray_operand<Op3>::type _op3;
 	} ;
 
+	// a + b * b, with b read once
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_add<Real, Op1, valarray_square<Real, Op2> >
+	{
+		typedef Real value_type;
+		typedef typename Op1::element_type element_type;
+
+		INLINE valarray_add(const Op1& a, const valarray_square<Real, Op2>& b)
+			: _op1(a)
+			, _op2(b._op)
+		{ }
+
+		INLINE element_type operator() (std::size_t i) const
+		{
+			const element_type b = _op2(i);
+
+			return madd(_op1(i), b, b);
+		}
+
+		INLINE std::size_t size() const
+		{
+			return _op1.size();
+		}
+
+		INLINE std::size_t elements() const
+		{
+			return _op1.elements();
+		}
+
+		typename valarray_operand<Op1>::type _op1;
+		typename valarray_operand<Op2>::type _op2;
+
+	} ; // end valarray_add<Real, Op1, valarray_square<Real, Op2> >
+
 	template <typename Real, typename Op>
 	struct valarray_sqrt
 	{
@@ -199,10 +336,42 @@ namespace expression_template_simd
 			return _op.elements();
 		}
 
-		const Op& _op;
+		typename valarray_operand<Op>::type _op;
 
 	} ; // end valarray_sqrt<Real, Op>
 
+	// a * a, with a read once
+	template <typename Real, typename Op>
+	struct valarray_square
+	{
+		typedef Real value_type;
+		typedef typename Op::element_type element_type;
+
+		INLINE valarray_square(const Op& a)
+			: _op(a)
+		{ }
+
+		INLINE element_type operator() (std::size_t i) const
+		{
+			const element_type a = _op(i);
+
+			return mul(a, a);
+		}
+
+		INLINE std::size_t size() const
+		{
+			return _op.size();
+		}
+
+		INLINE std::size_t elements() const
+		{
+			return _op.elements();
+		}
+
+		typename valarray_operand<Op>::type _op;
+
+	} ; // end valarray_square<Real, Op>
+
 	template <typename Real, typename Lhs, typename Rhs>
 	INLINE valarray<Real, valarray_add<Real, Lhs, Rhs> > operator+ (const valarray<Real, Lhs>& lhs, const valarray<Real, Rhs>& rhs)
 	{
@@ -221,6 +390,115 @@ namespace expression_template_simd
 		return valarray<Real, valarray_sqrt<Real, Op> >(valarray_sqrt<Real, Op>(value.rep()));
 	}
 
+	template <typename Real, typename Op>
+	INLINE valarray<Real, valarray_square<Real, Op> > square(const valarray<Real, Op>& value)
+	{
+		return valarray<Real, valarray_square<Real, Op> >(valarray_square<Real, Op>(value.rep()));
+	}
+
 } // end namespace expression_template_simd
 
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, typename Op1, typename Op2>
+	struct expression_signature<expression_template_simd::valarray_add<Real, Op1, Op2> >
+	{
+		enum { bytes_per_value = expression_signature<Op1>::bytes_per_value + expression_signature<Op2>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "add(";
+			expression_signature<Op1>::append(signature);
+			signature += ", ";
+			expression_signature<Op2>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_add<Real, Op1, Op2> >
+
+	template <typename Real, typename Op1, typename Op2, typename Op3>
+	struct expression_signature<expression_template_simd::valarray_add<Real, Op1, expression_template_simd::valarray_mul<Real, Op2, Op3> > >
+	{
+		enum { bytes_per_value = expression_signature<Op1>::bytes_per_value + expression_signature<Op2>::bytes_per_value + expression_signature<Op3>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "madd(";
+			expression_signature<Op1>::append(signature);
+			signature += ", ";
+			expression_signature<Op2>::append(signature);
+			signature += ", ";
+			expression_signature<Op3>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct expression_signature<expression_template_simd::valarray_add<Real, Op1, expression_template_simd::valarray_square<Real, Op2> > >
+	{
+		enum { bytes_per_value = expression_signature<Op1>::bytes_per_value + expression_signature<Op2>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "madd(";
+			expression_signature<Op1>::append(signature);
+			signature += ", ";
+			expression_signature<Op2>::append(signature);
+			signature += ", ";
+			expression_signature<Op2>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct expression_signature<expression_template_simd::valarray_mul<Real, Op1, Op2> >
+	{
+		enum { bytes_per_value = expression_signature<Op1>::bytes_per_value + expression_signature<Op2>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "mul(";
+			expression_signature<Op1>::append(signature);
+			signature += ", ";
+			expression_signature<Op2>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_mul<Real, Op1, Op2> >
+
+	template <typename Real, typename Op>
+	struct expression_signature<expression_template_simd::valarray_sqrt<Real, Op> >
+	{
+		enum { bytes_per_value = expression_signature<Op>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "sqrt(";
+			expression_signature<Op>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_sqrt<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct expression_signature<expression_template_simd::valarray_square<Real, Op> >
+	{
+		enum { bytes_per_value = expression_signature<Op>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "square(";
+			expression_signature<Op>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_square<Real, Op> >
+}
+
+#endif
+
 #endif // end EXPRESSION_TEMPLATE_SIMD_HPP_INCLUDED
@@ -0,0 +1,224 @@
+#ifndef FIXED_ARRAY_HPP_INCLUDED
+#define FIXED_ARRAY_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+
+namespace expression_template_simd
+{
+	// The widest register of the build, used by the fixed size arrays
+#if defined(USE_AVX)
+	typedef __m256 fixed_element_type;
+#elif defined(USE_SSE)
+	typedef __m128 fixed_element_type;
+#elif defined(USE_NEON)
+	typedef float32x4_t fixed_element_type;
+#endif
+
+	// The register of valarray's default rep, used by the reps that are
+	// evaluated alongside it
+#if defined(USE_SSE)
+	typedef __m128 default_element_type;
+#elif defined(USE_AVX)
+	typedef __m256 default_element_type;
+#elif defined(USE_NEON)
+	typedef float32x4_t default_element_type;
+#endif
+
+	// Element type of the fixed size reps. Void picks the widest register
+	// of the build, so the default argument does not pass a vector type as
+	// a template argument, which loses its alignment attribute.
+	template <typename Element>
+	struct fixed_element
+	{
+		typedef Element type;
+
+	} ; // end fixed_element<Element>
+
+	template <>
+	struct fixed_element<void>
+	{
+		typedef fixed_element_type type;
+
+	} ; // end fixed_element<void>
+
+	// Element type of the other reps, where void picks the register of
+	// valarray's default rep
+	template <typename Element>
+	struct default_element
+	{
+		typedef Element type;
+
+	} ; // end default_element<Element>
+
+	template <>
+	struct default_element<void>
+	{
+		typedef default_element_type type;
+
+	} ; // end default_element<void>
+
+	template <std::size_t Index, std::size_t Count>
+	struct valarray_unroll
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest& dest, const Src& src)
+		{
+			dest(Index) = src(Index);
+
+			valarray_unroll<Index + 1, Count>::assign(dest, src);
+		}
+
+	} ; // end valarray_unroll<Index, Count>
+
+	template <std::size_t Count>
+	struct valarray_unroll<Count, Count>
+	{
+		template <typename Dest, typename Src>
+		static INLINE void assign(Dest&, const Src&)
+		{ }
+
+	} ; // end valarray_unroll<Count, Count>
+
+	// Storage for N values held inline rather than on the heap. The last
+	// element is padded out to a full SIMD register so the evaluation
+	// loop never needs to handle a partial element.
+	template <typename Real, std::size_t N, typename Element>
+	class valarray_rep_fixed
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename fixed_element<Element>::type element_type;
+
+			enum
+			{
+				lanes = sizeof(element_type) / sizeof(value_type),
+				element_count = (N / lanes) + ((N % lanes == 0) ? 0 : 1)
+			} ;
+
+			INLINE valarray_rep_fixed()
+			{ }
+
+			INLINE explicit valarray_rep_fixed(std::size_t size)
+			{
+				assert(size == N);
+			}
+
+			INLINE valarray_rep_fixed(std::size_t size, value_type value)
+			{
+				assert(size == N);
+
+				value_type* values = reinterpret_cast<value_type*>(_values);
+
+				for (std::size_t i = 0; i < element_count * lanes; ++i)
+					values[i] = value;
+			}
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				assert(i < element_count);
+
+				return _values[i];
+			}
+
+			INLINE element_type& operator() (std::size_t i)
+			{
+				assert(i < element_count);
+
+				return _values[i];
+			}
+
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				assert(i < N);
+
+				return reinterpret_cast<const value_type*>(_values)[i];
+			}
+
+			INLINE static std::size_t size()
+			{
+				return N;
+			}
+
+			INLINE static std::size_t elements()
+			{
+				return element_count;
+			}
+
+			INLINE static std::size_t alignment()
+			{
+				return sizeof(element_type);
+			}
+
+			INLINE static std::size_t element_size()
+			{
+				return lanes;
+			}
+
+		private:
+
+			element_type _values[element_count];
+
+	} ; // end class valarray_rep_fixed<Real, N, Element>
+
+	template <typename Real, std::size_t N, typename Element>
+	struct valarray_assign<valarray_rep_fixed<Real, N, Element> >
+	{
+		template <typename Src>
+		static INLINE void apply(valarray_rep_fixed<Real, N, Element>& dest, const Src& src)
+		{
+			valarray_unroll<0, valarray_rep_fixed<Real, N, Element>::element_count>::assign(dest, src);
+		}
+
+	} ; // end valarray_assign<valarray_rep_fixed<Real, N, Element> >
+
+	template <typename Real, std::size_t N, typename Element = void>
+	class fixed_valarray : public valarray<Real, valarray_rep_fixed<Real, N, Element> >
+	{
+		public:
+
+			typedef valarray<Real, valarray_rep_fixed<Real, N, Element> > base_type;
+
+			INLINE fixed_valarray()
+				: base_type(N)
+			{ }
+
+			INLINE explicit fixed_valarray(Real value)
+				: base_type(N, value)
+			{ }
+
+			template <typename Rep2>
+			INLINE fixed_valarray& operator= (const valarray<Real, Rep2>& copy)
+			{
+				base_type::operator=(copy);
+
+				return *this;
+			}
+
+	} ; // end class fixed_valarray<Real, N, Element>
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, std::size_t N, typename Element>
+	struct expression_signature<expression_template_simd::valarray_rep_fixed<Real, N, Element> >
+	{
+		enum { bytes_per_value = sizeof(Real) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "fixed<";
+			append_number(signature, N);
+			signature += ">";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_fixed<Real, N, Element> >
+}
+
+#endif
+
+#endif // end FIXED_ARRAY_HPP_INCLUDED
@@ -0,0 +1,534 @@
+#include "config.hpp"
+#include "formula.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+	// Square root of a folded constant, taken with the interpreter's kernel
+	// so that folding does not change the result
+	float fold_square_root(float value)
+	{
+		using namespace expression_template_simd;
+
+		return get(square_root(splat<default_element_type>(value)), 0);
+	}
+
+	// Bitwise, so that a folded NaN still finds its slot
+	bool same_constant(float a, float b)
+	{
+		return std::memcmp(&a, &b, sizeof(float)) == 0;
+	}
+
+	// Parse tree, nodes refer to their operands by index
+	struct node
+	{
+		enum node_kind
+		{
+			constant,
+			input,
+			negate,
+			binary,
+			square_root
+		} ;
+
+		node_kind kind;
+		char op;
+		float value;
+		std::size_t index;
+		std::size_t left;
+		std::size_t right;
+
+	} ; // end struct node
+
+	// Recursive descent over
+	//   sum     := product (('+' | '-') product)*
+	//   product := unary (('*' | '/') unary)*
+	//   unary   := '-' unary | primary
+	//   primary := number | name | name '(' sum ')' | '(' sum ')'
+	class parser
+	{
+		public:
+
+			parser(const std::string& text, const std::vector<std::string>& inputs, std::vector<node>& nodes)
+				: _text(text)
+				, _inputs(inputs)
+				, _nodes(nodes)
+				, _position(0)
+			{ }
+
+			bool parse(std::size_t& root, std::string& error)
+			{
+				if (!parse_sum(root) || !expect('\0'))
+				{
+					std::ostringstream message;
+					message << _error << " at position " << _position;
+
+					error = message.str();
+
+					return false;
+				}
+
+				return true;
+			}
+
+		private:
+
+			char peek()
+			{
+				while ((_position < _text.size()) && std::isspace((unsigned char)_text[_position]))
+					++_position;
+
+				return (_position < _text.size()) ? _text[_position] : '\0';
+			}
+
+			bool expect(char c)
+			{
+				if (peek() != c)
+				{
+					_error = (c == '\0') ? "unexpected text" : std::string("expected '") + c + "'";
+
+					return false;
+				}
+
+				++_position;
+
+				return true;
+			}
+
+			std::size_t add_node(node::node_kind kind, char op, std::size_t left, std::size_t right)
+			{
+				node n;
+				n.kind = kind;
+				n.op = op;
+				n.value = 0.0f;
+				n.index = 0;
+				n.left = left;
+				n.right = right;
+
+				_nodes.push_back(n);
+
+				return _nodes.size() - 1;
+			}
+
+			bool parse_sum(std::size_t& result)
+			{
+				if (!parse_product(result))
+					return false;
+
+				for (char op = peek(); (op == '+') || (op == '-'); op = peek())
+				{
+					++_position;
+
+					std::size_t right;
+
+					if (!parse_product(right))
+						return false;
+
+					result = add_node(node::binary, op, result, right);
+				}
+
+				return true;
+			}
+
+			bool parse_product(std::size_t& result)
+			{
+				if (!parse_unary(result))
+					return false;
+
+				for (char op = peek(); (op == '*') || (op == '/'); op = peek())
+				{
+					++_position;
+
+					std::size_t right;
+
+					if (!parse_unary(right))
+						return false;
+
+					result = add_node(node::binary, op, result, right);
+				}
+
+				return true;
+			}
+
+			bool parse_unary(std::size_t& result)
+			{
+				if (peek() != '-')
+					return parse_primary(result);
+
+				++_position;
+
+				std::size_t operand;
+
+				if (!parse_unary(operand))
+					return false;
+
+				result = add_node(node::negate, '-', operand, 0);
+
+				return true;
+			}
+
+			bool parse_primary(std::size_t& result)
+			{
+				const char c = peek();
+
+				if (c == '(')
+				{
+					++_position;
+
+					return parse_sum(result) && expect(')');
+				}
+
+				if (std::isdigit((unsigned char)c) || (c == '.'))
+				{
+					const char* begin = _text.c_str() + _position;
+					char* end = 0;
+
+					const double value = std::strtod(begin, &end);
+
+					_position += end - begin;
+
+					result = add_node(node::constant, 0, 0, 0);
+					_nodes[result].value = (float)value;
+
+					return true;
+				}
+
+				if (!std::isalpha((unsigned char)c) && (c != '_'))
+				{
+					_error = "expected a number, a name or '('";
+
+					return false;
+				}
+
+				const std::size_t begin = _position;
+
+				while ((_position < _text.size()) && (std::isalnum((unsigned char)_text[_position]) || (_text[_position] == '_')))
+					++_position;
+
+				const std::string name = _text.substr(begin, _position - begin);
+
+				if (peek() == '(')
+				{
+					if (name != "sqrt")
+					{
+						_position = begin;
+						_error = "unknown function '" + name + "'";
+
+						return false;
+					}
+
+					++_position;
+
+					std::size_t operand;
+
+					if (!parse_sum(operand) || !expect(')'))
+						return false;
+
+					result = add_node(node::square_root, 0, operand, 0);
+
+					return true;
+				}
+
+				for (std::size_t i = 0; i < _inputs.size(); ++i)
+				{
+					if (_inputs[i] == name)
+					{
+						result = add_node(node::input, 0, 0, 0);
+						_nodes[result].index = i;
+
+						return true;
+					}
+				}
+
+				_position = begin;
+				_error = "unknown input '" + name + "'";
+
+				return false;
+			}
+
+			const std::string& _text;
+			const std::vector<std::string>& _inputs;
+			std::vector<node>& _nodes;
+			std::size_t _position;
+			std::string _error;
+
+	} ; // end class parser
+
+	// Replaces operations on constants by their value
+	void fold_constants(std::vector<node>& nodes, std::size_t index)
+	{
+		node& n = nodes[index];
+
+		if ((n.kind == node::constant) || (n.kind == node::input))
+			return;
+
+		fold_constants(nodes, n.left);
+
+		if (n.kind == node::binary)
+			fold_constants(nodes, n.right);
+
+		const node& left = nodes[n.left];
+
+		if (left.kind != node::constant)
+			return;
+
+		if (n.kind == node::negate)
+		{
+			n.value = -left.value;
+		}
+		else if (n.kind == node::square_root)
+		{
+			n.value = fold_square_root(left.value);
+		}
+		else
+		{
+			const node& right = nodes[n.right];
+
+			if (right.kind != node::constant)
+				return;
+
+			switch (n.op)
+			{
+				case '+': n.value = left.value + right.value; break;
+				case '-': n.value = left.value - right.value; break;
+				case '*': n.value = left.value * right.value; break;
+				default:  n.value = left.value / right.value; break;
+			}
+		}
+
+		n.kind = node::constant;
+	}
+
+	// Emits the instructions for a tree. Leaves need no code, operations
+	// write register depth so each operand can use the registers above it.
+	class generator
+	{
+		public:
+
+			generator(const std::vector<node>& nodes, std::size_t inputs, std::vector<float>& constants, std::vector<formula::instruction>& code)
+				: _nodes(nodes)
+				, _inputs(inputs)
+				, _constants(constants)
+				, _code(code)
+				, _registers(0)
+			{ }
+
+			// Every constant needs a slot before the registers are placed
+			void collect_constants(std::size_t index)
+			{
+				const node& n = _nodes[index];
+
+				if (n.kind == node::constant)
+				{
+					for (std::size_t i = 0; i < _constants.size(); ++i)
+					{
+						if (same_constant(_constants[i], n.value))
+							return;
+					}
+
+					_constants.push_back(n.value);
+				}
+				else if (n.kind != node::input)
+				{
+					collect_constants(n.left);
+
+					if (n.kind == node::binary)
+						collect_constants(n.right);
+				}
+			}
+
+			// Returns the slot holding the value of the node
+			std::size_t generate(std::size_t index, std::size_t depth)
+			{
+				const node& n = _nodes[index];
+
+				if (n.kind == node::input)
+					return n.index;
+
+				if (n.kind == node::constant)
+					return constant_slot(n.value);
+
+				formula::instruction ins;
+				ins.a = ins.b = ins.c = 0;
+
+				if ((n.kind == node::binary) && (n.op == '+') && (is_product(n.left) || is_product(n.right)))
+				{
+					// a + b * c maps onto the multiply-add kernel
+					const std::size_t product = is_product(n.right) ? n.right : n.left;
+					const std::size_t addend = (product == n.right) ? n.left : n.right;
+
+					ins.op = formula::op_madd;
+					ins.a = (unsigned char)generate(addend, depth);
+					ins.b = (unsigned char)generate(_nodes[product].left, depth + 1);
+					ins.c = (unsigned char)generate(_nodes[product].right, depth + 2);
+				}
+				else if (n.kind == node::binary)
+				{
+					switch (n.op)
+					{
+						case '+': ins.op = formula::op_add; break;
+						case '-': ins.op = formula::op_sub; break;
+						case '*': ins.op = formula::op_mul; break;
+						default:  ins.op = formula::op_div; break;
+					}
+
+					ins.a = (unsigned char)generate(n.left, depth);
+					ins.b = (unsigned char)generate(n.right, depth + 1);
+				}
+				else
+				{
+					ins.op = (n.kind == node::negate) ? formula::op_negate : formula::op_sqrt;
+					ins.a = (unsigned char)generate(n.left, depth);
+				}
+
+				if (depth + 1 > _registers)
+					_registers = depth + 1;
+
+				ins.dest = (unsigned char)register_slot(depth);
+
+				_code.push_back(ins);
+
+				return ins.dest;
+			}
+
+			std::size_t registers() const
+			{
+				return _registers;
+			}
+
+		private:
+
+			bool is_product(std::size_t index) const
+			{
+				return (_nodes[index].kind == node::binary) && (_nodes[index].op == '*');
+			}
+
+			std::size_t constant_slot(float value) const
+			{
+				std::size_t i = 0;
+
+				while (!same_constant(_constants[i], value))
+					++i;
+
+				return _inputs + i;
+			}
+
+			std::size_t register_slot(std::size_t depth) const
+			{
+				return _inputs + _constants.size() + depth;
+			}
+
+			const std::vector<node>& _nodes;
+			std::size_t _inputs;
+			std::vector<float>& _constants;
+			std::vector<formula::instruction>& _code;
+			std::size_t _registers;
+
+	} ; // end class generator
+
+	const char* opcode_name(unsigned char op)
+	{
+		static const char* names[] = { "copy", "add", "sub", "mul", "div", "madd", "negate", "sqrt" };
+
+		return (op < sizeof(names) / sizeof(names[0])) ? names[op] : "?";
+	}
+
+	std::size_t operand_count(unsigned char op)
+	{
+		switch (op)
+		{
+			case formula::op_copy:
+			case formula::op_negate:
+			case formula::op_sqrt:
+				return 1;
+			case formula::op_madd:
+				return 3;
+			default:
+				return 2;
+		}
+	}
+}
+
+formula::program::program()
+	: _inputs(0)
+	, _registers(0)
+{ }
+
+bool formula::program::compile(const std::string& text, const std::vector<std::string>& inputs, std::string& error)
+{
+	_inputs = 0;
+	_registers = 0;
+	_constants.clear();
+	_code.clear();
+
+	std::vector<node> nodes;
+	std::size_t root = 0;
+
+	parser reader(text, inputs, nodes);
+
+	if (!reader.parse(root, error))
+		return false;
+
+	fold_constants(nodes, root);
+
+	std::vector<float> constants;
+	std::vector<instruction> code;
+
+	generator writer(nodes, inputs.size(), constants, code);
+	writer.collect_constants(root);
+
+	const std::size_t result = writer.generate(root, 0);
+
+	if (inputs.size() + constants.size() + writer.registers() + 1 > max_slots)
+	{
+		error = "formula needs too many slots";
+
+		return false;
+	}
+
+	const std::size_t result_slot = inputs.size() + constants.size() + writer.registers();
+
+	if (code.empty() || (code.back().dest != result))
+	{
+		// The formula is a single input or constant
+		instruction copy;
+		copy.op = op_copy;
+		copy.a = (unsigned char)result;
+		copy.b = copy.c = 0;
+
+		code.push_back(copy);
+	}
+
+	// The last instruction writes the result rather than a register
+	code.back().dest = (unsigned char)result_slot;
+
+	_inputs = inputs.size();
+	_registers = writer.registers();
+	_constants.swap(constants);
+	_code.swap(code);
+
+	return true;
+}
+
+std::string formula::program::disassemble() const
+{
+	std::ostringstream out;
+
+	for (std::size_t i = 0; i < _code.size(); ++i)
+	{
+		const instruction& ins = _code[i];
+		const unsigned char operands[] = { ins.a, ins.b, ins.c };
+
+		out << opcode_name(ins.op) << " s" << (int)ins.dest;
+
+		for (std::size_t j = 0; j < operand_count(ins.op); ++j)
+			out << ", s" << (int)operands[j];
+
+		out << "\n";
+	}
+
+	return out.str();
+}
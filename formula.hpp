@@ -0,0 +1,206 @@
+#ifndef FORMULA_HPP_INCLUDED
+#define FORMULA_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Runtime formulas
+//---------------------------------------------------------------------
+
+// Formulas such as "sqrt(x*x + y*y)" that are only known at run time are
+// compiled to a short register program. The interpreter runs one
+// instruction at a time over a block of SIMD elements small enough for the
+// registers to stay in the L1 cache, using the same kernels as the
+// expression templates.
+namespace formula
+{
+	enum opcode
+	{
+		op_copy,
+		op_add,
+		op_sub,
+		op_mul,
+		op_div,
+		op_madd,
+		op_negate,
+		op_sqrt
+	} ;
+
+	// Operands are slots: the inputs come first, then the constants, then
+	// the registers, and the last slot is the result
+	struct instruction
+	{
+		unsigned char op;
+		unsigned char dest;
+		unsigned char a;
+		unsigned char b;
+		unsigned char c;
+
+	} ; // end struct instruction
+
+	// Values in the block each instruction is run over
+	const std::size_t block_values = 1024;
+
+	// Slots are addressed with a byte
+	const std::size_t max_slots = 256;
+
+	class program
+	{
+		public:
+
+			program();
+
+			// Compiles a formula over the named inputs. The formula may use
+			// + - * / and parentheses, numbers, the input names and sqrt().
+			// Returns false and describes the problem in error if the text
+			// could not be compiled.
+			bool compile(const std::string& text, const std::vector<std::string>& inputs, std::string& error);
+
+			std::size_t inputs() const
+			{
+				return _inputs;
+			}
+
+			const std::vector<float>& constants() const
+			{
+				return _constants;
+			}
+
+			std::size_t registers() const
+			{
+				return _registers;
+			}
+
+			std::size_t result_slot() const
+			{
+				return _inputs + _constants.size() + _registers;
+			}
+
+			const std::vector<instruction>& code() const
+			{
+				return _code;
+			}
+
+			// Readable listing of the instructions
+			std::string disassemble() const;
+
+		private:
+
+			std::size_t _inputs;
+			std::size_t _registers;
+			std::vector<float> _constants;
+			std::vector<instruction> _code;
+
+	} ; // end class program
+
+	// Runs each instruction over count elements
+	template <typename Element>
+	void execute(const program& code, Element* const* slots, std::size_t count)
+	{
+		const std::vector<instruction>& instructions = code.code();
+
+		for (std::size_t n = 0; n < instructions.size(); ++n)
+		{
+			const instruction& ins = instructions[n];
+
+			Element* dest = slots[ins.dest];
+			const Element* a = slots[ins.a];
+			const Element* b = slots[ins.b];
+			const Element* c = slots[ins.c];
+
+			switch (ins.op)
+			{
+				case op_copy:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = a[i];
+					break;
+				case op_add:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::add(a[i], b[i]);
+					break;
+				case op_sub:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::sub(a[i], b[i]);
+					break;
+				case op_mul:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::mul(a[i], b[i]);
+					break;
+				case op_div:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::div(a[i], b[i]);
+					break;
+				case op_madd:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::madd(a[i], b[i], c[i]);
+					break;
+				case op_negate:
+				{
+					const Element zero = expression_template_simd::splat<Element>(0.0f);
+
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::sub(zero, a[i]);
+					break;
+				}
+				case op_sqrt:
+					for (std::size_t i = 0; i < count; ++i)
+						dest[i] = expression_template_simd::square_root(a[i]);
+					break;
+			}
+		}
+	}
+
+	// Evaluates the program into dest. Inputs are in the order of the names
+	// the program was compiled with, and must be the size of dest.
+	template <typename Rep>
+	void evaluate(const program& code, expression_template_simd::valarray<float, Rep>& dest, const std::vector<const expression_template_simd::valarray<float, Rep>*>& inputs)
+	{
+		typedef typename Rep::element_type element_type;
+
+		assert(inputs.size() == code.inputs());
+
+		const std::size_t lanes = sizeof(element_type) / sizeof(float);
+		const std::size_t block = block_values / lanes;
+		const std::size_t constants = code.constants().size();
+		const std::size_t elements = dest.elements();
+
+		// Constants are splatted over a whole block once, registers are
+		// reused by every block
+		Rep scratch((constants + code.registers() > 0) ? (constants + code.registers()) * block_values : lanes);
+		element_type* storage = scratch.data();
+
+		for (std::size_t j = 0; j < constants; ++j)
+		{
+			const element_type value = expression_template_simd::splat<element_type>(code.constants()[j]);
+
+			for (std::size_t i = 0; i < block; ++i)
+				storage[j * block + i] = value;
+		}
+
+		element_type* slots[max_slots];
+
+		for (std::size_t j = 0; j < constants + code.registers(); ++j)
+			slots[code.inputs() + j] = storage + j * block;
+
+		for (std::size_t begin = 0; begin < elements; begin += block)
+		{
+			const std::size_t count = (begin + block < elements) ? block : elements - begin;
+
+			for (std::size_t j = 0; j < code.inputs(); ++j)
+			{
+				assert(inputs[j]->elements() == elements);
+
+				slots[j] = const_cast<element_type*>(inputs[j]->data()) + begin;
+			}
+
+			slots[code.result_slot()] = dest.data() + begin;
+
+			execute(code, slots, count);
+		}
+	}
+}
+
+#endif // end FORMULA_HPP_INCLUDED
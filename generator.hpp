@@ -0,0 +1,465 @@
+#ifndef GENERATOR_HPP_INCLUDED
+#define GENERATOR_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+namespace expression_template_simd
+{
+	// Leaves that compute their elements from the index instead of reading
+	// them from memory. They can be used anywhere a valarray rep is, but
+	// cannot be assigned to.
+
+	template <typename Real, typename Element = void>
+	class valarray_constant
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename default_element<Element>::type element_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			INLINE valarray_constant(std::size_t size, value_type value)
+				: _size(size)
+				, _elements((size / lanes) + ((size % lanes == 0) ? 0 : 1))
+				, _value(value)
+				, _lanes(splat<element_type>(value))
+			{ }
+
+			INLINE element_type operator() (std::size_t) const
+			{
+				return _lanes;
+			}
+
+			INLINE value_type operator[] (std::size_t) const
+			{
+				return _value;
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+		private:
+
+			std::size_t _size;
+			std::size_t _elements;
+			value_type _value;
+			element_type _lanes;
+
+	} ; // end class valarray_constant<Real, Element>
+
+	// Constant whose value is part of the type, so that rewriting can drop
+	// the zeros of sums and the ones of products
+	template <typename Real, int Value, typename Element = void>
+	class valarray_literal
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename default_element<Element>::type element_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			INLINE explicit valarray_literal(std::size_t size)
+				: _size(size)
+				, _elements((size / lanes) + ((size % lanes == 0) ? 0 : 1))
+			{ }
+
+			INLINE element_type operator() (std::size_t) const
+			{
+				return splat<element_type>((value_type)Value);
+			}
+
+			INLINE value_type operator[] (std::size_t) const
+			{
+				return (value_type)Value;
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+		private:
+
+			std::size_t _size;
+			std::size_t _elements;
+
+	} ; // end class valarray_literal<Real, Value, Element>
+
+	// Arithmetic sequence start, start + step, start + 2 * step, ...
+	template <typename Real, typename Element = void>
+	class valarray_ramp
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename default_element<Element>::type element_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			INLINE valarray_ramp(std::size_t size, value_type start = 0, value_type step = 1)
+				: _size(size)
+				, _elements((size / lanes) + ((size % lanes == 0) ? 0 : 1))
+				, _start(start)
+				, _step(step)
+			{
+				value_type* offsets = reinterpret_cast<value_type*>(&_offsets);
+
+				for (std::size_t i = 0; i < lanes; ++i)
+					offsets[i] = start + (value_type)i * step;
+			}
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				return add(splat<element_type>((value_type)(i * lanes) * _step), _offsets);
+			}
+
+			// Taken from the SIMD element, so that both round the same way
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				const element_type element = (*this)(i / lanes);
+
+				return reinterpret_cast<const value_type*>(&element)[i % lanes];
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+		private:
+
+			std::size_t _size;
+			std::size_t _elements;
+			value_type _start;
+			value_type _step;
+			element_type _offsets;
+
+	} ; // end class valarray_ramp<Real, Element>
+
+#if defined(USE_SSE) || defined(USE_AVX)
+	// Multiplies the 32 bit lanes, which SSE2 has no instruction for
+	INLINE __m128i mul_lanes(const __m128i& lhs, const __m128i& rhs)
+	{
+		const __m128i even = _mm_mul_epu32(lhs, rhs);
+		const __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(lhs, 32), _mm_srli_epi64(rhs, 32));
+
+		return _mm_unpacklo_epi32(
+			_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	// The hash of valarray_random on four lanes
+	INLINE __m128i hash_lanes(__m128i x)
+	{
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		x = mul_lanes(x, _mm_set1_epi32((int)0x7feb352du));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+		x = mul_lanes(x, _mm_set1_epi32((int)0x846ca68bu));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+
+		return _mm_srli_epi32(x, 8);
+	}
+#endif
+
+#ifdef USE_SSE
+	// The top 24 bits of the hashes of first, first + 1, ... in each lane
+	INLINE void random_lanes(uint32_t first, __m128& out)
+	{
+		const __m128i x = _mm_add_epi32(_mm_set1_epi32((int)first), _mm_setr_epi32(0, 1, 2, 3));
+
+		out = _mm_cvtepi32_ps(hash_lanes(x));
+	}
+#endif
+
+#ifdef USE_AVX
+	INLINE void random_lanes(uint32_t first, __m256& out)
+	{
+		const __m128i base = _mm_set1_epi32((int)first);
+
+		const __m128i low  = hash_lanes(_mm_add_epi32(base, _mm_setr_epi32(0, 1, 2, 3)));
+		const __m128i high = hash_lanes(_mm_add_epi32(base, _mm_setr_epi32(4, 5, 6, 7)));
+
+		out = _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+	}
+#endif
+
+#ifdef USE_NEON
+	INLINE void random_lanes(uint32_t first, float32x4_t& out)
+	{
+		const uint32_t offsets[4] = { 0, 1, 2, 3 };
+
+		uint32x4_t x = vaddq_u32(vdupq_n_u32(first), vld1q_u32(offsets));
+
+		x = veorq_u32(x, vshrq_n_u32(x, 16));
+		x = vmulq_u32(x, vdupq_n_u32(0x7feb352du));
+		x = veorq_u32(x, vshrq_n_u32(x, 15));
+		x = vmulq_u32(x, vdupq_n_u32(0x846ca68bu));
+		x = veorq_u32(x, vshrq_n_u32(x, 16));
+
+		out = vcvtq_f32_u32(vshrq_n_u32(x, 8));
+	}
+#endif
+
+	// Uniformly distributed values in [low, high). Each value is a hash of
+	// its index and the seed, so any element can be produced on its own and
+	// the stream is the same however it is traversed. The lanes of an
+	// element are hashed together in vector registers.
+	template <typename Real, typename Element = void>
+	class valarray_random
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename default_element<Element>::type element_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			INLINE valarray_random(std::size_t size, uint32_t seed = 0, value_type low = 0, value_type high = 1)
+				: _size(size)
+				, _elements((size / lanes) + ((size % lanes == 0) ? 0 : 1))
+				, _key(seed * 0x9e3779b9u)
+				, _low(splat<element_type>(low))
+				, _scale(splat<element_type>((high - low) / 16777216.0f))
+			{ }
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				const uint64_t first = (uint64_t)i * lanes;
+
+				element_type hashes;
+				random_lanes((uint32_t)first + key(first), hashes);
+
+				return add(_low, mul(hashes, _scale));
+			}
+
+			// Taken from the SIMD element, so that both round the same way
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				const element_type element = (*this)(i / lanes);
+
+				return reinterpret_cast<const value_type*>(&element)[i % lanes];
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+		private:
+
+			// The lanes of an element share their top 32 index bits, which
+			// are mixed into the key so the stream does not repeat after 4G
+			// values
+			INLINE uint32_t key(uint64_t first) const
+			{
+				const uint32_t high = (uint32_t)(first >> 32);
+
+				return (high == 0) ? _key : hash(_key ^ high);
+			}
+
+			static uint32_t hash(uint32_t x)
+			{
+				x ^= x >> 16;
+				x *= 0x7feb352du;
+				x ^= x >> 15;
+				x *= 0x846ca68bu;
+				x ^= x >> 16;
+
+				return x;
+			}
+
+			std::size_t _size;
+			std::size_t _elements;
+			uint32_t _key;
+			element_type _low;
+			element_type _scale;
+
+	} ; // end class valarray_random<Real, Element>
+
+	// Generators are built in the same statement as the tree that uses them
+	template <typename Real, typename Element>
+	struct valarray_operand<valarray_constant<Real, Element> >
+	{
+		typedef const valarray_constant<Real, Element> type;
+
+	} ; // end valarray_operand<valarray_constant<Real, Element> >
+
+	template <typename Real, typename Element>
+	struct valarray_operand<valarray_ramp<Real, Element> >
+	{
+		typedef const valarray_ramp<Real, Element> type;
+
+	} ; // end valarray_operand<valarray_ramp<Real, Element> >
+
+	template <typename Real, int Value, typename Element>
+	struct valarray_operand<valarray_literal<Real, Value, Element> >
+	{
+		typedef const valarray_literal<Real, Value, Element> type;
+
+	} ; // end valarray_operand<valarray_literal<Real, Value, Element> >
+
+	template <typename Real, typename Element>
+	struct valarray_operand<valarray_random<Real, Element> >
+	{
+		typedef const valarray_random<Real, Element> type;
+
+	} ; // end valarray_operand<valarray_random<Real, Element> >
+
+	// The functions without an element type make the register type of the
+	// build, the templates take it explicitly
+
+	INLINE valarray<float, valarray_constant<float> > constant(std::size_t size, float value)
+	{
+		return valarray<float, valarray_constant<float> >(valarray_constant<float>(size, value));
+	}
+
+	INLINE valarray<float, valarray_literal<float, 0> > zeros(std::size_t size)
+	{
+		return valarray<float, valarray_literal<float, 0> >(valarray_literal<float, 0>(size));
+	}
+
+	INLINE valarray<float, valarray_literal<float, 1> > ones(std::size_t size)
+	{
+		return valarray<float, valarray_literal<float, 1> >(valarray_literal<float, 1>(size));
+	}
+
+	INLINE valarray<float, valarray_ramp<float> > iota(std::size_t size, float start = 0.0f, float step = 1.0f)
+	{
+		return valarray<float, valarray_ramp<float> >(valarray_ramp<float>(size, start, step));
+	}
+
+	INLINE valarray<float, valarray_ramp<float> > linspace(std::size_t size, float first, float last)
+	{
+		const float step = (size > 1) ? (last - first) / (float)(size - 1) : 0.0f;
+
+		return valarray<float, valarray_ramp<float> >(valarray_ramp<float>(size, first, step));
+	}
+
+	INLINE valarray<float, valarray_random<float> > random_uniform(std::size_t size, uint32_t seed, float low = 0.0f, float high = 1.0f)
+	{
+		return valarray<float, valarray_random<float> >(valarray_random<float>(size, seed, low, high));
+	}
+
+	template <typename Element>
+	INLINE valarray<float, valarray_constant<float, Element> > constant(std::size_t size, float value)
+	{
+		return valarray<float, valarray_constant<float, Element> >(valarray_constant<float, Element>(size, value));
+	}
+
+	template <typename Element>
+	INLINE valarray<float, valarray_literal<float, 0, Element> > zeros(std::size_t size)
+	{
+		return valarray<float, valarray_literal<float, 0, Element> >(valarray_literal<float, 0, Element>(size));
+	}
+
+	template <typename Element>
+	INLINE valarray<float, valarray_literal<float, 1, Element> > ones(std::size_t size)
+	{
+		return valarray<float, valarray_literal<float, 1, Element> >(valarray_literal<float, 1, Element>(size));
+	}
+
+	template <typename Element>
+	INLINE valarray<float, valarray_ramp<float, Element> > iota(std::size_t size, float start = 0.0f, float step = 1.0f)
+	{
+		return valarray<float, valarray_ramp<float, Element> >(valarray_ramp<float, Element>(size, start, step));
+	}
+
+	template <typename Element>
+	INLINE valarray<float, valarray_ramp<float, Element> > linspace(std::size_t size, float first, float last)
+	{
+		const float step = (size > 1) ? (last - first) / (float)(size - 1) : 0.0f;
+
+		return valarray<float, valarray_ramp<float, Element> >(valarray_ramp<float, Element>(size, first, step));
+	}
+
+	template <typename Element>
+	INLINE valarray<float, valarray_random<float, Element> > random_uniform(std::size_t size, uint32_t seed, float low = 0.0f, float high = 1.0f)
+	{
+		return valarray<float, valarray_random<float, Element> >(valarray_random<float, Element>(size, seed, low, high));
+	}
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	// Generated values are never read from memory
+	template <typename Real, typename Element>
+	struct expression_signature<expression_template_simd::valarray_constant<Real, Element> >
+	{
+		enum { bytes_per_value = 0 } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "constant";
+		}
+
+	} ; // end struct expression_signature<valarray_constant<Real, Element> >
+
+	template <typename Real, int Value, typename Element>
+	struct expression_signature<expression_template_simd::valarray_literal<Real, Value, Element> >
+	{
+		enum { bytes_per_value = 0 } ;
+
+		static void append(std::string& signature)
+		{
+			signature += (Value == 0) ? "zero" : (Value == 1) ? "one" : "literal";
+		}
+
+	} ; // end struct expression_signature<valarray_literal<Real, Value, Element> >
+
+	template <typename Real, typename Element>
+	struct expression_signature<expression_template_simd::valarray_ramp<Real, Element> >
+	{
+		enum { bytes_per_value = 0 } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "ramp";
+		}
+
+	} ; // end struct expression_signature<valarray_ramp<Real, Element> >
+
+	template <typename Real, typename Element>
+	struct expression_signature<expression_template_simd::valarray_random<Real, Element> >
+	{
+		enum { bytes_per_value = 0 } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "random";
+		}
+
+	} ; // end struct expression_signature<valarray_random<Real, Element> >
+}
+
+#endif
+
+#endif // end GENERATOR_HPP_INCLUDED
@@ -0,0 +1,305 @@
+#ifndef HALF_ARRAY_HPP_INCLUDED
+#define HALF_ARRAY_HPP_INCLUDED
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace expression_template_simd
+{
+#ifdef USE_F16C
+	// IEEE half precision storage, converted with the F16C instructions.
+	struct half_fp16
+	{
+		static INLINE void load(const uint16_t* values, __m128& out)
+		{
+			out = _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)values));
+		}
+
+		static INLINE void store(uint16_t* values, const __m128& value)
+		{
+			_mm_storel_epi64((__m128i*)values, _mm_cvtps_ph(value, 0));
+		}
+
+	#ifdef USE_AVX
+		static INLINE void load(const uint16_t* values, __m256& out)
+		{
+			out = _mm256_cvtph_ps(_mm_load_si128((const __m128i*)values));
+		}
+
+		static INLINE void store(uint16_t* values, const __m256& value)
+		{
+			_mm_store_si128((__m128i*)values, _mm256_cvtps_ph(value, 0));
+		}
+	#endif
+
+		static INLINE float to_float(uint16_t value)
+		{
+			return _cvtsh_ss(value);
+		}
+
+		static INLINE uint16_t from_float(float value)
+		{
+			return _cvtss_sh(value, 0);
+		}
+
+		static const char* name()
+		{
+			return "fp16";
+		}
+
+	} ; // end half_fp16
+#endif
+
+	// bfloat16 storage. Widening is a shift into the high half of each lane,
+	// narrowing rounds to nearest even and keeps NaNs quiet.
+	struct half_bf16
+	{
+		static INLINE void load(const uint16_t* values, __m128& out)
+		{
+			out = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i*)values)));
+		}
+
+		static INLINE void store(uint16_t* values, const __m128& value)
+		{
+			_mm_storel_epi64((__m128i*)values, narrow(value));
+		}
+
+	#ifdef USE_AVX
+		static INLINE void load(const uint16_t* values, __m256& out)
+		{
+			const __m128i packed = _mm_load_si128((const __m128i*)values);
+
+			const __m128 low  = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), packed));
+			const __m128 high = _mm_castsi128_ps(_mm_unpackhi_epi16(_mm_setzero_si128(), packed));
+
+			out = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+		}
+
+		static INLINE void store(uint16_t* values, const __m256& value)
+		{
+			const __m128i low  = narrow(_mm256_castps256_ps128(value));
+			const __m128i high = narrow(_mm256_extractf128_ps(value, 1));
+
+			_mm_store_si128((__m128i*)values, _mm_unpacklo_epi64(low, high));
+		}
+	#endif
+
+		static INLINE float to_float(uint16_t value)
+		{
+			const uint32_t bits = (uint32_t)value << 16;
+
+			float result;
+			std::memcpy(&result, &bits, sizeof(result));
+
+			return result;
+		}
+
+		static INLINE uint16_t from_float(float value)
+		{
+			return (uint16_t)_mm_cvtsi128_si32(narrow(_mm_set_ss(value)));
+		}
+
+		// Returns the four narrowed values packed into the low 64 bits
+		static INLINE __m128i narrow(const __m128& value)
+		{
+			const __m128i bits = _mm_castps_si128(value);
+			const __m128i lsb  = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+			const __m128i round = _mm_add_epi32(bits, _mm_add_epi32(lsb, _mm_set1_epi32(0x7fff)));
+
+			const __m128i nan = _mm_castps_si128(_mm_cmpunord_ps(value, value));
+			const __m128i quiet = _mm_or_si128(_mm_srai_epi32(bits, 16), _mm_set1_epi32(0x40));
+
+			const __m128i high = _mm_or_si128(
+				_mm_and_si128(nan, quiet),
+				_mm_andnot_si128(nan, _mm_srai_epi32(round, 16)));
+
+			return _mm_packs_epi32(high, high);
+		}
+
+		static const char* name()
+		{
+			return "bf16";
+		}
+
+	} ; // end half_bf16
+
+	// IEEE half precision where the build has F16C, bfloat16 otherwise
+#ifdef USE_F16C
+	typedef half_fp16 default_half_format;
+#else
+	typedef half_bf16 default_half_format;
+#endif
+
+	template <typename Real, typename Format = default_half_format, typename Element = void>
+	class valarray_rep_half;
+
+	// Stores each value in 16 bits and widens to float lanes on load, so the
+	// rep can take part in any float expression. Writes go through a proxy
+	// that narrows the computed element back to the storage format.
+	template <typename Format, typename Element>
+	class valarray_rep_half<float, Format, Element>
+	{
+		public:
+
+			typedef float value_type;
+			typedef typename default_element<Element>::type element_type;
+			typedef uint16_t storage_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			class reference
+			{
+				public:
+
+					INLINE explicit reference(storage_type* values)
+						: _values(values)
+					{ }
+
+					INLINE reference& operator= (const element_type& value)
+					{
+						Format::store(_values, value);
+
+						return *this;
+					}
+
+					INLINE operator element_type() const
+					{
+						element_type value;
+						Format::load(_values, value);
+
+						return value;
+					}
+
+				private:
+
+					storage_type* _values;
+
+			} ; // end class reference
+
+			INLINE valarray_rep_half(std::size_t size)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes * sizeof(storage_type), alignment());
+			}
+
+			INLINE valarray_rep_half(std::size_t size, value_type value)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes * sizeof(storage_type), alignment());
+
+				const storage_type narrowed = Format::from_float(value);
+
+				for (std::size_t i = 0, count = _elements * lanes; i < count; ++i)
+					_values[i] = narrowed;
+			}
+
+			INLINE ~valarray_rep_half()
+			{
+				_mm_free(_values);
+			}
+
+			INLINE valarray_rep_half(const valarray_rep_half& copy)
+				: _size(copy._size)
+				, _elements(copy._elements)
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes * sizeof(storage_type), alignment());
+
+				swap(copy);
+			}
+
+			INLINE valarray_rep_half& operator= (const valarray_rep_half& copy)
+			{
+				swap(copy);
+
+				return *this;
+			}
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				assert(i < _elements);
+
+				element_type value;
+				Format::load(_values + i * lanes, value);
+
+				return value;
+			}
+
+			INLINE reference operator() (std::size_t i)
+			{
+				assert(i < _elements);
+
+				return reference(_values + i * lanes);
+			}
+
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				assert(i < _size);
+
+				return Format::to_float(_values[i]);
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+			INLINE static std::size_t alignment()
+			{
+				return sizeof(element_type);
+			}
+
+			INLINE static std::size_t element_size()
+			{
+				return lanes;
+			}
+
+			INLINE void swap(const valarray_rep_half& copy)
+			{
+				assert(_size == copy._size);
+
+				std::memcpy(_values, copy._values, _elements * lanes * sizeof(storage_type));
+			}
+
+		private:
+
+			std::size_t _size;
+			std::size_t _elements;
+			storage_type* _values;
+
+	} ; // end class valarray_rep_half<float, Format, Element>
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, typename Format, typename Element>
+	struct expression_signature<expression_template_simd::valarray_rep_half<Real, Format, Element> >
+	{
+		enum { bytes_per_value = sizeof(uint16_t) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += Format::name();
+		}
+
+	} ; // end struct expression_signature<valarray_rep_half<Real, Format, Element> >
+}
+
+#endif
+
+#endif // end HALF_ARRAY_HPP_INCLUDED
@@ -0,0 +1,660 @@
+#include "config.hpp"
+#include "jit.hpp"
+
+#if defined(USE_JIT) && (defined(_M_X64) || defined(__x86_64__))
+#define HAS_JIT
+#endif
+
+#ifdef HAS_JIT
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	enum
+	{
+		rax = 0,
+		rcx = 1,
+		rdx = 2,
+		rsp = 4,
+		rsi = 6,
+		rdi = 7,
+		r8 = 8,
+		r9 = 9,
+		r10 = 10,
+		r11 = 11
+	} ;
+
+	// Registers of the generated code. Formula registers and constants take
+	// ymm0 upwards, the result is built in ymm12 and inputs are loaded into
+	// the scratch registers.
+	enum
+	{
+		inputs_register = r10,
+		output_register = r11,
+		blocks_register = r8,
+		quads_register = r9,
+		offset_register = rax,
+		pointer_register = rcx,
+
+		result_vector = 12,
+		scratch_vector = 13,
+		vector_registers = 12
+	} ;
+
+	// VEX opcode maps and implied prefixes
+	enum
+	{
+		map_0f = 1,
+		map_0f38 = 2,
+
+		prefix_none = 0,
+		prefix_66 = 1
+	} ;
+
+	bool has_fma = false;
+
+	bool detect_avx()
+	{
+		unsigned int info[4];
+
+#ifdef _WIN32
+		__cpuid((int*)info, 1);
+#else
+		if (!__get_cpuid(1, &info[0], &info[1], &info[2], &info[3]))
+			return false;
+#endif
+
+		const unsigned int ecx = info[2];
+
+		// The OS has to save the ymm registers on a context switch
+		if (!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+			return false;
+
+#ifdef _WIN32
+		const unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+		const unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+
+		if ((xcr0 & 6) != 6)
+			return false;
+
+		has_fma = (ecx & (1 << 12)) != 0;
+
+		return true;
+	}
+
+	const bool __avx_supported = detect_avx();
+
+	class assembler
+	{
+		public:
+
+			std::size_t size() const
+			{
+				return _bytes.size();
+			}
+
+			const unsigned char* bytes() const
+			{
+				return &_bytes[0];
+			}
+
+			// op ymm reg, ymm vvvv, ymm rm
+			void vex(int map, int prefix, int length, int opcode, int reg, int vvvv, int rm)
+			{
+				vex_prefix(map, prefix, length, reg, 0, rm, vvvv);
+				emit(opcode);
+				emit(0xc0 | ((reg & 7) << 3) | (rm & 7));
+			}
+
+			// op ymm reg, ymm vvvv, [base + index + disp], index may be -1
+			void vex_memory(int map, int prefix, int length, int opcode, int reg, int vvvv, int base, int index, int disp)
+			{
+				vex_prefix(map, prefix, length, reg, (index < 0) ? 0 : index, base, vvvv);
+				emit(opcode);
+				address(reg, base, index, disp);
+			}
+
+			void vzeroupper()
+			{
+				emit(0xc5);
+				emit(0xf8);
+				emit(0x77);
+			}
+
+			// mov dest, src
+			void mov(int dest, int src)
+			{
+				emit(0x48 | ((src >> 3) << 2) | (dest >> 3));
+				emit(0x89);
+				emit(0xc0 | ((src & 7) << 3) | (dest & 7));
+			}
+
+			// mov dest, [base + disp]
+			void load(int dest, int base, int disp)
+			{
+				emit(0x48 | ((dest >> 3) << 2) | (base >> 3));
+				emit(0x8b);
+				address(dest, base, -1, disp);
+			}
+
+			// mov dest, value, returns the position of the value
+			std::size_t load_immediate(int dest, unsigned long long value)
+			{
+				emit(0x48 | (dest >> 3));
+				emit(0xb8 | (dest & 7));
+
+				const std::size_t position = size();
+
+				for (int i = 0; i < 8; ++i)
+					emit((int)(value >> (8 * i)) & 0xff);
+
+				return position;
+			}
+
+			void patch_immediate(std::size_t position, unsigned long long value)
+			{
+				for (int i = 0; i < 8; ++i)
+					_bytes[position + i] = (unsigned char)(value >> (8 * i));
+			}
+
+			// xor eax, eax
+			void clear_rax()
+			{
+				emit(0x31);
+				emit(0xc0);
+			}
+
+			// test reg, reg
+			void test(int reg)
+			{
+				emit(0x48 | ((reg >> 3) << 2) | (reg >> 3));
+				emit(0x85);
+				emit(0xc0 | ((reg & 7) << 3) | (reg & 7));
+			}
+
+			// add reg, value
+			void add(int reg, int value)
+			{
+				emit(0x48 | (reg >> 3));
+				emit(0x83);
+				emit(0xc0 | (reg & 7));
+				emit(value & 0xff);
+			}
+
+			// sub rsp, value or add rsp, value
+			void adjust_stack(int value)
+			{
+				emit(0x48);
+				emit(0x81);
+				emit((value < 0) ? 0xec : 0xc4);
+				immediate32((value < 0) ? -value : value);
+			}
+
+			// dec reg
+			void decrement(int reg)
+			{
+				emit(0x48 | (reg >> 3));
+				emit(0xff);
+				emit(0xc8 | (reg & 7));
+			}
+
+			// jz or jnz to a target patched in later, returns the position
+			// of the displacement
+			std::size_t jump(bool if_zero)
+			{
+				emit(0x0f);
+				emit(if_zero ? 0x84 : 0x85);
+
+				const std::size_t position = size();
+				immediate32(0);
+
+				return position;
+			}
+
+			void patch_jump(std::size_t position, std::size_t target)
+			{
+				const int displacement = (int)target - (int)(position + 4);
+
+				for (int i = 0; i < 4; ++i)
+					_bytes[position + i] = (unsigned char)(displacement >> (8 * i));
+			}
+
+			void ret()
+			{
+				emit(0xc3);
+			}
+
+			void emit(int byte)
+			{
+				_bytes.push_back((unsigned char)byte);
+			}
+
+		private:
+
+			// Three byte form, which encodes every register
+			void vex_prefix(int map, int prefix, int length, int reg, int index, int rm, int vvvv)
+			{
+				emit(0xc4);
+				emit(((~reg & 8) << 4) | ((~index & 8) << 3) | ((~rm & 8) << 2) | map);
+				emit(((~vvvv & 15) << 3) | (length << 2) | prefix);
+			}
+
+			void address(int reg, int base, int index, int disp)
+			{
+				int mod;
+
+				if ((disp == 0) && ((base & 7) != 5))
+					mod = 0;
+				else if ((disp >= -128) && (disp < 128))
+					mod = 1;
+				else
+					mod = 2;
+
+				if ((index >= 0) || ((base & 7) == 4))
+				{
+					emit((mod << 6) | ((reg & 7) << 3) | 4);
+					emit((index >= 0) ? (((index & 7) << 3) | (base & 7)) : 0x24);
+				}
+				else
+				{
+					emit((mod << 6) | ((reg & 7) << 3) | (base & 7));
+				}
+
+				if (mod == 1)
+					emit(disp & 0xff);
+				else if (mod == 2)
+					immediate32(disp);
+			}
+
+			void immediate32(int value)
+			{
+				for (int i = 0; i < 4; ++i)
+					emit((value >> (8 * i)) & 0xff);
+			}
+
+			std::vector<unsigned char> _bytes;
+
+	} ; // end class assembler
+
+	// Emits the formula over one group of values, eight floats when length
+	// is one and four when it is zero
+	class translator
+	{
+		public:
+
+			translator(const formula::program& code, assembler& out)
+				: _code(code)
+				, _out(out)
+			{ }
+
+			void emit_body(int length)
+			{
+				const std::vector<formula::instruction>& instructions = _code.code();
+
+				for (std::size_t n = 0; n < instructions.size(); ++n)
+				{
+					const formula::instruction& ins = instructions[n];
+					const int dest = vector(ins.dest);
+
+					switch (ins.op)
+					{
+						case formula::op_copy:
+							_out.vex(map_0f, prefix_none, length, 0x28, dest, 0, operand(ins.a, 0, length));
+							break;
+						case formula::op_add:
+							binary(0x58, dest, ins, length);
+							break;
+						case formula::op_sub:
+							binary(0x5c, dest, ins, length);
+							break;
+						case formula::op_mul:
+							binary(0x59, dest, ins, length);
+							break;
+						case formula::op_div:
+							binary(0x5e, dest, ins, length);
+							break;
+						case formula::op_madd:
+						{
+							// The addend is never in the register of a
+							// product operand, so it can be copied first
+							const int a = operand(ins.a, 0, length);
+							const int b = operand(ins.b, 1, length);
+							const int c = operand(ins.c, 2, length);
+
+							if (has_fma)
+							{
+								if (dest != a)
+									_out.vex(map_0f, prefix_none, length, 0x28, dest, 0, a);
+
+								// vfmadd231ps dest, b, c
+								_out.vex(map_0f38, prefix_66, length, 0xb8, dest, b, c);
+							}
+							else
+							{
+								_out.vex(map_0f, prefix_none, length, 0x59, scratch_vector + 2, b, c);
+								_out.vex(map_0f, prefix_none, length, 0x58, dest, a, scratch_vector + 2);
+							}
+							break;
+						}
+						case formula::op_negate:
+						{
+							const int a = operand(ins.a, 0, length);
+
+							_out.vex(map_0f, prefix_none, length, 0x57, scratch_vector + 1, scratch_vector + 1, scratch_vector + 1);
+							_out.vex(map_0f, prefix_none, length, 0x5c, dest, scratch_vector + 1, a);
+							break;
+						}
+						case formula::op_sqrt:
+							_out.vex(map_0f, prefix_none, length, 0x51, dest, 0, operand(ins.a, 0, length));
+							break;
+					}
+
+					if (ins.dest == _code.result_slot())
+						_out.vex_memory(map_0f, prefix_none, length, 0x11, result_vector, 0, output_register, offset_register, 0);
+				}
+			}
+
+			// Broadcasts every constant into its register
+			void emit_constants(std::size_t& table)
+			{
+				table = _out.load_immediate(pointer_register, 0);
+
+				for (std::size_t j = 0; j < _code.constants().size(); ++j)
+					_out.vex_memory(map_0f38, prefix_66, 1, 0x18, vector(_code.inputs() + j), 0, pointer_register, -1, (int)(4 * j));
+			}
+
+		private:
+
+			void binary(int opcode, int dest, const formula::instruction& ins, int length)
+			{
+				const int a = operand(ins.a, 0, length);
+				const int b = operand(ins.b, 1, length);
+
+				_out.vex(map_0f, prefix_none, length, opcode, dest, a, b);
+			}
+
+			// Vector register of a slot that is not an input
+			int vector(std::size_t slot) const
+			{
+				const std::size_t constants = _code.constants().size();
+
+				if (slot == _code.result_slot())
+					return result_vector;
+
+				if (slot < _code.inputs() + constants)
+					return (int)(_code.registers() + slot - _code.inputs());
+
+				return (int)(slot - _code.inputs() - constants);
+			}
+
+			// Register holding a slot, inputs are loaded into scratch
+			int operand(std::size_t slot, int scratch, int length)
+			{
+				if (slot >= _code.inputs())
+					return vector(slot);
+
+				_out.load(pointer_register, inputs_register, (int)(8 * slot));
+				_out.vex_memory(map_0f, prefix_none, length, 0x10, scratch_vector + scratch, 0, pointer_register, offset_register, 0);
+
+				return scratch_vector + scratch;
+			}
+
+			const formula::program& _code;
+			assembler& _out;
+
+	} ; // end class translator
+
+	bool is_supported(const formula::program& code)
+	{
+		if (code.registers() + code.constants().size() > vector_registers)
+			return false;
+
+		const std::vector<formula::instruction>& instructions = code.code();
+
+		for (std::size_t n = 0; n < instructions.size(); ++n)
+		{
+			if (instructions[n].op > formula::op_sqrt)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Memory is writable while the code is copied in, then executable
+	void* allocate_writable(std::size_t size)
+	{
+#ifdef _WIN32
+		return VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+		void* memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+		return (memory == MAP_FAILED) ? 0 : memory;
+#endif
+	}
+
+	bool make_executable(void* memory, std::size_t size)
+	{
+#ifdef _WIN32
+		DWORD old;
+
+		if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &old))
+		{
+			VirtualFree(memory, 0, MEM_RELEASE);
+			return false;
+		}
+
+		FlushInstructionCache(GetCurrentProcess(), memory, size);
+
+		return true;
+#else
+		if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+		{
+			munmap(memory, size);
+			return false;
+		}
+
+		return true;
+#endif
+	}
+
+	formula::jit_function translate(const formula::program& code)
+	{
+		assembler out;
+		translator body(code, out);
+
+#ifdef _WIN32
+		// xmm6 to xmm15 belong to the caller, the arguments arrive in rcx,
+		// rdx, r8 and r9
+		out.adjust_stack(-168);
+
+		for (int i = 0; i < 10; ++i)
+			out.vex_memory(map_0f, prefix_none, 0, 0x11, 6 + i, 0, rsp, -1, 16 * i);
+
+		out.mov(inputs_register, rcx);
+		out.mov(output_register, rdx);
+#else
+		out.mov(inputs_register, rdi);
+		out.mov(output_register, rsi);
+		out.mov(blocks_register, rdx);
+		out.mov(quads_register, rcx);
+#endif
+
+		std::size_t table = 0;
+
+		if (!code.constants().empty())
+			body.emit_constants(table);
+
+		out.clear_rax();
+
+		// Groups of eight floats
+		out.test(blocks_register);
+		const std::size_t skip_blocks = out.jump(true);
+
+		const std::size_t loop = out.size();
+		body.emit_body(1);
+		out.add(offset_register, 32);
+		out.decrement(blocks_register);
+		out.patch_jump(out.jump(false), loop);
+
+		out.patch_jump(skip_blocks, out.size());
+
+		// A last group of four
+		out.test(quads_register);
+		const std::size_t skip_quad = out.jump(true);
+		body.emit_body(0);
+
+		out.patch_jump(skip_quad, out.size());
+
+		out.vzeroupper();
+
+#ifdef _WIN32
+		for (int i = 0; i < 10; ++i)
+			out.vex_memory(map_0f, prefix_none, 0, 0x10, 6 + i, 0, rsp, -1, 16 * i);
+
+		out.adjust_stack(168);
+#endif
+
+		out.ret();
+
+		// The constants follow the code in the same block
+		while (out.size() % sizeof(float) != 0)
+			out.emit(0xcc);
+
+		const std::size_t constants = out.size();
+
+		for (std::size_t j = 0; j < code.constants().size(); ++j)
+		{
+			unsigned char value[sizeof(float)];
+			std::memcpy(value, &code.constants()[j], sizeof(float));
+
+			for (std::size_t i = 0; i < sizeof(float); ++i)
+				out.emit(value[i]);
+		}
+
+		unsigned char* memory = (unsigned char*)allocate_writable(out.size());
+
+		if (!memory)
+			return 0;
+
+		if (!code.constants().empty())
+			out.patch_immediate(table, (unsigned long long)(memory + constants));
+
+		std::memcpy(memory, out.bytes(), out.size());
+
+		if (!make_executable(memory, out.size()))
+			return 0;
+
+		return (formula::jit_function)memory;
+	}
+
+	// Everything that affects the generated code
+	std::vector<unsigned char> program_key(const formula::program& code)
+	{
+		std::vector<unsigned char> key;
+
+		key.push_back((unsigned char)code.inputs());
+		key.push_back((unsigned char)code.registers());
+		key.push_back((unsigned char)code.constants().size());
+
+		for (std::size_t j = 0; j < code.constants().size(); ++j)
+		{
+			unsigned char value[sizeof(float)];
+			std::memcpy(value, &code.constants()[j], sizeof(float));
+
+			key.insert(key.end(), value, value + sizeof(float));
+		}
+
+		const std::vector<formula::instruction>& instructions = code.code();
+
+		for (std::size_t n = 0; n < instructions.size(); ++n)
+		{
+			key.push_back(instructions[n].op);
+			key.push_back(instructions[n].dest);
+			key.push_back(instructions[n].a);
+			key.push_back(instructions[n].b);
+			key.push_back(instructions[n].c);
+		}
+
+		return key;
+	}
+
+	// FNV-1a
+	std::size_t hash_key(const std::vector<unsigned char>& key)
+	{
+		unsigned int hash = 2166136261u;
+
+		for (std::size_t i = 0; i < key.size(); ++i)
+			hash = (hash ^ key[i]) * 16777619u;
+
+		return hash;
+	}
+
+	struct compiled_program
+	{
+		std::size_t hash;
+		std::vector<unsigned char> key;
+		// Null when the program could not be translated
+		formula::jit_function function;
+	} ;
+
+	threading::mutex __jit_lock;
+	std::vector<compiled_program> __jit_cache;
+}
+
+#endif
+
+bool formula::jit_supported()
+{
+#ifdef HAS_JIT
+	return __avx_supported;
+#else
+	return false;
+#endif
+}
+
+formula::jit_function formula::jit_compile(const program& code)
+{
+#ifdef HAS_JIT
+	if (!__avx_supported || code.code().empty())
+		return 0;
+
+	const std::vector<unsigned char> key = program_key(code);
+	const std::size_t hash = hash_key(key);
+
+	threading::scoped_lock lock(__jit_lock);
+
+	for (std::size_t i = 0; i < __jit_cache.size(); ++i)
+	{
+		if ((__jit_cache[i].hash == hash) && (__jit_cache[i].key == key))
+			return __jit_cache[i].function;
+	}
+
+	// Failures are cached too, so the interpreter is picked straight away
+	// the next time
+	compiled_program compiled;
+	compiled.hash = hash;
+	compiled.key = key;
+	compiled.function = is_supported(code) ? translate(code) : 0;
+
+	__jit_cache.push_back(compiled);
+
+	return compiled.function;
+#else
+	(void)code;
+	return 0;
+#endif
+}
@@ -0,0 +1,67 @@
+#ifndef JIT_HPP_INCLUDED
+#define JIT_HPP_INCLUDED
+
+#include "formula.hpp"
+#include <cstddef>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Native code for runtime formulas
+//---------------------------------------------------------------------
+
+// Translates a compiled formula into x86-64 AVX code in executable memory,
+// so a runtime formula runs as one fused loop like the expression
+// templates instead of one instruction at a time. Registers and constants
+// live in vector registers for the whole loop. Programs that cannot be
+// translated run on the interpreter instead.
+namespace formula
+{
+	// Reads inputs[i][v] for every v below 8 * blocks + 4 * quads and writes
+	// output[v]. Quads is zero or one.
+	typedef void (*jit_function)(const float* const* inputs, float* output, std::size_t blocks, std::size_t quads);
+
+	// True when the processor and the operating system support the AVX
+	// code the compiler emits
+	bool jit_supported();
+
+	// Native code for the program, or null if it cannot be translated. Code
+	// is cached by the contents of the program and lives until exit.
+	jit_function jit_compile(const program& code);
+
+	// Evaluates the program into dest with native code where possible, and
+	// with formula::evaluate otherwise. The values may differ from the
+	// interpreter in the last bits, as madd is fused and sqrt is exact.
+	template <typename Rep>
+	void evaluate_jit(const program& code, expression_template_simd::valarray<float, Rep>& dest, const std::vector<const expression_template_simd::valarray<float, Rep>*>& inputs)
+	{
+		typedef typename Rep::element_type element_type;
+
+		const std::size_t lanes = sizeof(element_type) / sizeof(float);
+
+		// The native loop covers groups of four floats
+		jit_function kernel = (lanes % 4 == 0) ? jit_compile(code) : 0;
+
+		if (!kernel)
+		{
+			evaluate(code, dest, inputs);
+			return;
+		}
+
+		assert(inputs.size() == code.inputs());
+
+		const std::size_t values = dest.elements() * lanes;
+
+		std::vector<const float*> pointers(inputs.size() + 1);
+
+		for (std::size_t i = 0; i < inputs.size(); ++i)
+		{
+			assert(inputs[i]->elements() == dest.elements());
+
+			pointers[i] = (const float*)inputs[i]->data();
+		}
+
+		kernel(&pointers[0], (float*)dest.data(), values / 8, (values % 8) / 4);
+	}
+}
+
+#endif // end JIT_HPP_INCLUDED
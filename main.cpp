@@ -1,5 +1,41 @@
-#include "performance_test.hpp"
+#include "benchmark.hpp"
+#include "stream.hpp"
+#include "threading.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+
+namespace
+{
+	void print_usage(const char* program)
+	{
+		std::cout << "Usage: " << program << " [size] [repeat] [options]\n"
+		          << "  --size N         Number of elements in each array\n"
+		          << "  --repeat N       Number of timed runs per kernel\n"
+		          << "  --warmup N       Number of untimed runs before timing\n"
+		          << "  --kernel a,b     Only run the named kernels\n"
+		          << "  --json path      Write the results as JSON\n"
+		          << "  --csv path       Write the results as CSV\n"
+		          << "  --counters       Report hardware counters (Linux perf events)\n"
+		          << "  --no-peak        Skip measuring peak bandwidth and FLOP rate at startup\n"
+		          << "  --tsc            Time with the invariant TSC instead of the OS clock\n"
+		          << "  --list           List the available kernels\n"
+		          << "  --sweep          Run over geometrically spaced sizes\n"
+		          << "  --sweep-min N    Smallest size in the sweep (default 1K)\n"
+		          << "  --sweep-max N    Largest size in the sweep (default 1G)\n"
+		          << "  --steps N        Sizes per doubling in the sweep (default 2)\n"
+#ifdef USE_PROFILING
+		          << "  --profile        Print the time spent in each expression type\n"
+#endif
+#ifdef USE_THREADS
+		          << "  --scaling        Run each kernel on 1 to N pinned threads\n"
+		          << "  --threads N      Most threads used for scaling (default all processors)\n"
+#endif
+		          ;
+	}
+}
 
 //---------------------------------------------------------------------
 // Main
@@ -7,83 +43,255 @@
 
 int main(int argc, char *argv[])
 {
+	benchmark_options options;
+	std::string filter;
+	const char* json_path = 0;
+	const char* csv_path = 0;
+	std::size_t positional = 0;
+	bool sweep = false;
+	system_time::clock_source source = system_time::default_clock;
+	std::size_t sweep_min = 1 << 10;
+	std::size_t sweep_max = 1 << 30;
+	std::size_t steps = 2;
+	bool scaling = false;
+	bool peak = true;
+#ifdef USE_PROFILING
+	bool profile = false;
+#endif
+	std::size_t max_threads = threading::hardware_concurrency();
+
+	// Parse the command line
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const bool has_value = (i + 1 < argc);
+
+		if ((std::strcmp(arg, "--size") == 0) && has_value)
+			options.size = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--repeat") == 0) && has_value)
+			options.repeat = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--warmup") == 0) && has_value)
+			options.warmup = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--kernel") == 0) && has_value)
+			filter = argv[++i];
+		else if ((std::strcmp(arg, "--json") == 0) && has_value)
+			json_path = argv[++i];
+		else if ((std::strcmp(arg, "--csv") == 0) && has_value)
+			csv_path = argv[++i];
+		else if (std::strcmp(arg, "--counters") == 0)
+			options.counters = true;
+		else if (std::strcmp(arg, "--no-peak") == 0)
+			peak = false;
+		else if (std::strcmp(arg, "--tsc") == 0)
+			source = system_time::cycle_counter;
+		else if (std::strcmp(arg, "--sweep") == 0)
+			sweep = true;
+		else if ((std::strcmp(arg, "--sweep-min") == 0) && has_value)
+			sweep_min = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--sweep-max") == 0) && has_value)
+			sweep_max = std::strtoul(argv[++i], 0, 10);
+		else if ((std::strcmp(arg, "--steps") == 0) && has_value)
+			steps = std::strtoul(argv[++i], 0, 10);
+#ifdef USE_PROFILING
+		else if (std::strcmp(arg, "--profile") == 0)
+			profile = true;
+#endif
+#ifdef USE_THREADS
+		else if (std::strcmp(arg, "--scaling") == 0)
+			scaling = true;
+		else if ((std::strcmp(arg, "--threads") == 0) && has_value)
+			max_threads = std::max<std::size_t>(1, std::strtoul(argv[++i], 0, 10));
+#endif
+		else if (std::strcmp(arg, "--list") == 0)
+		{
+			for (std::size_t j = 0; j < performance_test_count(); ++j)
+				std::cout << get_performance_test(j).name << "\n";
+
+			return 0;
+		}
+		else if ((arg[0] != '-') && (positional < 2))
+		{
+			// Size and repetitions may still be given positionally
+			if (positional++ == 0)
+				options.size = std::strtoul(arg, 0, 10);
+			else
+				options.repeat = std::strtoul(arg, 0, 10);
+		}
+		else
+		{
+			print_usage(argv[0]);
+
+			return 1;
+		}
+	}
+
 	// Initialize the timer
-	system_time::initialize();
-
-	// Initialize the total times
-	double accum_float_arrays_time        = 0.0;
-	double accum_sse_arrays_time          = 0.0;
-	double accum_avx_arrays_time          = 0.0;
-	double accum_neon_arrays_time         = 0.0;
-	double accum_naive_array_time         = 0.0;
-	double accum_expr_template_float_time = 0.0;
-	double accum_expr_template_sse_time   = 0.0;
-	double accum_expr_template_avx_time   = 0.0;
-	double accum_expr_template_neon_time  = 0.0;
-
-	// Get the size of the arrays and the
-	// number of repetitions
-	std::size_t size = 1000000;
-	std::size_t repeat = 100;
-
-	if (argc >= 3)
+	system_time::initialize(source);
+
+	if ((source == system_time::cycle_counter) && (system_time::get_clock_source() != source))
+		std::cerr << "No invariant TSC, using the default clock\n";
+
+	if (options.counters)
 	{
-		size = atoi(argv[1]);
-		repeat = atoi(argv[2]);
+		const std::string error = timer::counters_error();
+
+		if (!error.empty())
+			std::cerr << "Hardware counters unavailable, " << error << "\n";
 	}
-	else if (argc == 2)
+
+	if (tuning::is_profile_loaded())
 	{
-		size = atoi(argv[0]);
+		const tuning::tuning_profile& profile = tuning::get_profile();
+
+		std::cout << "Tuning profile " << tuning::get_profile_path() << ": " << profile.threads << " threads, unroll "
+		          << profile.unroll << ", block " << profile.block_size << "\n";
 	}
 
+	std::cout << "Timer resolution " << system_time::get_resolution() * 1e9 << " ns, overhead "
+	          << system_time::get_overhead() * system_time::get_resolution() * 1e9 << " ns\n";
+
+	// Measure the limits the kernels are compared against, the scaling
+	// mode runs its own triad at each thread count instead
+	machine_peak limits = machine_peak();
+
+	if (peak && !scaling)
+		limits = measure_machine_peak(options);
+
 	// Run the tests
-	for (std::size_t i = 0; i < repeat; ++i)
+	std::vector<benchmark_result> results;
+
+	if (scaling)
 	{
-		// C array implementations
-		accum_float_arrays_time     += time_float_arrays(size);
-		accum_sse_arrays_time       += time_sse_arrays(size);
-		accum_avx_arrays_time       += time_avx_arrays(size);
-		accum_neon_arrays_time      += time_neon_arrays(size);
-
-		// valarray implementations
-		accum_naive_array_time          += time_naive_array(size);
-		accum_expr_template_float_time  += time_expr_template_float(size);
-		accum_expr_template_sse_time    += time_expr_template_sse(size);
-		accum_expr_template_avx_time    += time_expr_template_avx(size);
-		accum_expr_template_neon_time   += time_expr_template_neon(size);
+		std::vector<benchmark_result> triad;
+
+		for (std::size_t threads = 1; threads <= max_threads; ++threads)
+		{
+			benchmark_options point = options;
+			point.threads = threads;
+
+			triad.push_back(run_benchmark(stream_info(stream_triad), point));
+		}
+
+		for (std::size_t i = 0; i < performance_test_count(); ++i)
+		{
+			const performance_test_info& info = get_performance_test(i);
+
+			if (!matches_filter(info.name, filter))
+				continue;
+
+			// Only kernels that can split their work are scaled
+			performance_test* test = info.create();
+			const bool partitioned = test->supports_partition();
+			delete test;
+
+			if (!partitioned)
+				continue;
+
+			for (std::size_t threads = 1; threads <= max_threads; ++threads)
+			{
+				benchmark_options point = options;
+				point.threads = threads;
+
+				results.push_back(run_benchmark(info, point));
+			}
+		}
+
+		std::cout << "Thread scaling for " << options.size << " elements computed " << options.repeat
+		          << " times after " << options.warmup << " warm-up runs\n";
+
+		print_scaling(std::cout, results, triad);
+	}
+	else if (sweep)
+	{
+		const std::vector<std::size_t> sizes = sweep_sizes(sweep_min, sweep_max, steps);
+		const uint64_t memory = system_info::get_physical_memory();
+
+		for (std::size_t i = 0; i < performance_test_count(); ++i)
+		{
+			const performance_test_info& info = get_performance_test(i);
+
+			if (!matches_filter(info.name, filter))
+				continue;
+
+			for (std::size_t j = 0; j < sizes.size(); ++j)
+			{
+				// Leave room for the rest of the system
+				if ((memory > 0) && (info.bytes_per_element * sizes[j] > memory / 2))
+				{
+					std::cerr << "Skipping " << info.name << " at " << sizes[j] << " elements, not enough memory\n";
+					break;
+				}
+
+				// Keep the time spent at each point roughly constant
+				benchmark_options point = options;
+				point.size = sizes[j];
+				point.repeat = std::max<std::size_t>(3, std::min(options.repeat, options.repeat * options.size / sizes[j]));
+				point.warmup = std::max<std::size_t>(1, std::min(options.warmup, options.warmup * options.size / sizes[j]));
+
+				results.push_back(run_benchmark(info, point));
+			}
+		}
+
+		if (peak)
+		{
+			apply_machine_peak(results, limits);
+			print_machine_peak(std::cout, limits);
+		}
+
+		print_sweep(std::cout, results, system_info::get_cache_sizes());
 	}
+	else
+	{
+		for (std::size_t i = 0; i < performance_test_count(); ++i)
+		{
+			const performance_test_info& info = get_performance_test(i);
+
+			if (matches_filter(info.name, filter))
+				results.push_back(run_benchmark(info, options));
+		}
 
-	// Print out results
-	std::cout << "Results for " << size << " elements computed " << repeat << " times\n";
-	std::cout.precision(12);
-	std::cout.setf(std::ios::fixed, std::ios::floatfield);
-
-	// Print out total times
-	std::cout << "\nTotal times\n";
-	std::cout << "------------------------\n";
-	std::cout << "   Float array time: " << accum_float_arrays_time        << " secs\n";
-	std::cout << "     SSE array time: " << accum_sse_arrays_time          << " secs\n";
-	std::cout << "     AVX array time: " << accum_avx_arrays_time          << " secs\n";
-	std::cout << "    NEON array time: " << accum_neon_arrays_time         << " secs\n";
-	std::cout << "Naive valarray time: " << accum_naive_array_time         << " secs\n";
-	std::cout << "Float valarray time: " << accum_expr_template_float_time << " secs\n";
-	std::cout << "  SSE valarray time: " << accum_expr_template_sse_time   << " secs\n";
-	std::cout << "  AVX valarray time: " << accum_expr_template_avx_time   << " secs\n";
-	std::cout << " NEON valarray time: " << accum_expr_template_neon_time  << " secs\n";
-
-	// Print out average times
-	std::cout << "\nAverage times\n";
-	std::cout << "------------------------\n";
-	std::cout << "   Float array time: " << accum_float_arrays_time        / repeat << " secs\n";
-	std::cout << "     SSE array time: " << accum_sse_arrays_time          / repeat << " secs\n";
-	std::cout << "     AVX array time: " << accum_avx_arrays_time          / repeat << " secs\n";
-	std::cout << "    NEON array time: " << accum_neon_arrays_time         / repeat << " secs\n";
-	std::cout << "Naive valarray time: " << accum_naive_array_time         / repeat << " secs\n";
-	std::cout << "Float valarray time: " << accum_expr_template_float_time / repeat << " secs\n";
-	std::cout << "  SSE valarray time: " << accum_expr_template_sse_time   / repeat << " secs\n";
-	std::cout << "  AVX valarray time: " << accum_expr_template_avx_time   / repeat << " secs\n";
-	std::cout << " NEON valarray time: " << accum_expr_template_neon_time  / repeat << " secs\n";
+		// Print out results
+		std::cout << "Results for " << options.size << " elements computed " << options.repeat
+		          << " times after " << options.warmup << " warm-up runs\n\n";
+
+		if (peak)
+		{
+			apply_machine_peak(results, limits);
+			print_machine_peak(std::cout, limits);
+			std::cout << "\n";
+		}
+
+		print_results(std::cout, results);
+	}
+
+#ifdef USE_PROFILING
+	if (profile)
+	{
+		std::cout << "\nExpression profile\n";
+		profiling::dump(std::cout);
+	}
+#endif
+
+	if (json_path && !write_json(json_path, results))
+		std::cerr << "Unable to write " << json_path << "\n";
+
+	if (csv_path && !write_csv(csv_path, results))
+		std::cerr << "Unable to write " << csv_path << "\n";
+
+	// A kernel that computed the wrong values fails the run
+	int status = 0;
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		if (!results[i].verified)
+		{
+			std::cerr << results[i].name << " computed the wrong values\n";
+			status = 1;
+		}
+	}
 
 	// Terminate the timer
 	system_time::terminate();
+
+	return status;
 }
@@ -0,0 +1,667 @@
+#ifndef MEMO_HPP_INCLUDED
+#define MEMO_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Shared intermediate results
+//---------------------------------------------------------------------
+
+// A memo_graph holds named intermediate expressions and the outputs that
+// read them. Running the graph evaluates every output in order, and
+// computes each intermediate at most once on the way:
+//   - intermediates are either recomputed inline by every reader or
+//     materialised into a pooled buffer, whichever the cost model finds
+//     cheaper for the number of readers
+//   - a buffer goes back to the pool once the last output reading it has
+//     run, so it can be reused by the next intermediate
+//   - a buffer that nothing else took keeps its values, and when every
+//     input of the intermediate is tracked and unchanged, the next run
+//     reads it without recomputing
+namespace expression_template_simd
+{
+	enum memo_policy
+	{
+		// Chosen by the cost model
+		memo_auto,
+		memo_inline,
+		memo_materialise
+	} ;
+
+	enum
+	{
+		// Relative cost per value of an operation, of reading a value from
+		// memory, and of writing a value to a buffer
+		memo_flop_cost = 1,
+		memo_load_cost = 4,
+		memo_store_cost = 8
+	} ;
+
+	// Operations and memory reads per value of an expression
+	template <typename Op>
+	struct valarray_cost
+	{
+		enum { flops = 0, loads = 1 } ;
+	} ;
+
+	template <typename Real, typename Element>
+	struct valarray_cost<valarray_constant<Real, Element> >
+	{
+		enum { flops = 0, loads = 0 } ;
+	} ;
+
+	template <typename Real, int Value, typename Element>
+	struct valarray_cost<valarray_literal<Real, Value, Element> >
+	{
+		enum { flops = 0, loads = 0 } ;
+	} ;
+
+	template <typename Real, typename Element>
+	struct valarray_cost<valarray_ramp<Real, Element> >
+	{
+		enum { flops = 1, loads = 0 } ;
+	} ;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_cost<valarray_add<Real, Op1, Op2> >
+	{
+		enum { flops = valarray_cost<Op1>::flops + valarray_cost<Op2>::flops + 1 } ;
+		enum { loads = valarray_cost<Op1>::loads + valarray_cost<Op2>::loads } ;
+	} ;
+
+	template <typename Real, typename Op1, typename Op2, typename Op3>
+	struct valarray_cost<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+	{
+		enum { flops = valarray_cost<Op1>::flops + valarray_cost<Op2>::flops + valarray_cost<Op3>::flops + 2 } ;
+		enum { loads = valarray_cost<Op1>::loads + valarray_cost<Op2>::loads + valarray_cost<Op3>::loads } ;
+	} ;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_cost<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+	{
+		enum { flops = valarray_cost<Op1>::flops + valarray_cost<Op2>::flops + 2 } ;
+		enum { loads = valarray_cost<Op1>::loads + valarray_cost<Op2>::loads } ;
+	} ;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_cost<valarray_mul<Real, Op1, Op2> >
+	{
+		enum { flops = valarray_cost<Op1>::flops + valarray_cost<Op2>::flops + 1 } ;
+		enum { loads = valarray_cost<Op1>::loads + valarray_cost<Op2>::loads } ;
+	} ;
+
+	template <typename Real, typename Op>
+	struct valarray_cost<valarray_sqrt<Real, Op> >
+	{
+		enum { flops = valarray_cost<Op>::flops + 1 } ;
+		enum { loads = valarray_cost<Op>::loads } ;
+	} ;
+
+	template <typename Real, typename Op>
+	struct valarray_cost<valarray_square<Real, Op> >
+	{
+		enum { flops = valarray_cost<Op>::flops + 1 } ;
+		enum { loads = valarray_cost<Op>::loads } ;
+	} ;
+
+	template <typename Real, typename Op>
+	struct valarray_cost<valarray_rewritten<Real, Op> >
+		: valarray_cost<typename valarray_rewritten<Real, Op>::node_type>
+	{ } ;
+
+	// Intermediate of a graph, seen by the graph and the trees reading it
+	template <typename Real, typename Rep>
+	class memo_state
+	{
+		public:
+
+			typedef typename Rep::element_type element_type;
+
+			memo_state(std::size_t size, memo_policy policy, std::size_t flops, std::size_t loads)
+				: size(size)
+				, policy(policy)
+				, flops(flops)
+				, loads(loads)
+				, consumers(0)
+				, pending(0)
+				, buffer(0)
+				, last(0)
+				, tracked(false)
+				, _values(0)
+			{ }
+
+			virtual ~memo_state()
+			{ }
+
+			virtual void evaluate(Rep& dest) const = 0;
+
+			// Materialised values, null while the readers compute them
+			INLINE const element_type* values() const
+			{
+				return _values;
+			}
+
+			void set_values(const element_type* values)
+			{
+				_values = values;
+			}
+
+			// True unless every input is tracked and no block of one was
+			// written since the versions were recorded
+			bool changed() const
+			{
+				if (!tracked)
+					return true;
+
+				for (std::size_t i = 0; i < inputs.size(); ++i)
+				{
+					for (std::size_t block = 0; block < inputs[i]->blocks(); ++block)
+					{
+						if (inputs[i]->block_version(block) > seen[i])
+							return true;
+					}
+				}
+
+				return false;
+			}
+
+			void record_versions()
+			{
+				for (std::size_t i = 0; i < inputs.size(); ++i)
+					seen[i] = inputs[i]->advance();
+			}
+
+			struct pooled_buffer
+			{
+				Rep values;
+				// Intermediate whose values the buffer last held
+				memo_state* owner;
+
+				explicit pooled_buffer(std::size_t size)
+					: values(size)
+					, owner(0)
+				{ }
+			} ;
+
+			std::size_t size;
+			memo_policy policy;
+			std::size_t flops;
+			std::size_t loads;
+
+			// Outputs reading the intermediate, and those still to run
+			std::size_t consumers;
+			std::size_t pending;
+
+			pooled_buffer* buffer;
+			pooled_buffer* last;
+
+			bool tracked;
+			std::vector<const valarray_tracking*> inputs;
+			std::vector<std::size_t> seen;
+
+		private:
+
+			memo_state(const memo_state&);
+			memo_state& operator= (const memo_state&);
+
+			const element_type* _values;
+
+	} ; // end class memo_state<Real, Rep>
+
+	template <typename Real, typename Rep, typename Src>
+	class memo_state_impl : public memo_state<Real, Rep>
+	{
+		public:
+
+			memo_state_impl(const Src& src, memo_policy policy)
+				: memo_state<Real, Rep>(src.size(), policy, valarray_cost<Src>::flops, valarray_cost<Src>::loads)
+				, _src(src)
+			{
+				this->tracked = valarray_dependencies<Src>::collect(src, this->inputs);
+				this->seen.resize(this->inputs.size(), 0);
+			}
+
+			void evaluate(Rep& dest) const
+			{
+				valarray_assign<Rep>::apply(dest, _src);
+			}
+
+			INLINE typename valarray_operand<Src>::type source() const
+			{
+				return _src;
+			}
+
+		private:
+
+			typename valarray_operand<Src>::type _src;
+
+	} ; // end class memo_state_impl<Real, Rep, Src>
+
+	// Leaf that reads an intermediate, from its buffer when it has one and
+	// by computing it otherwise. The test is the same for every element.
+	template <typename Real, typename Rep, typename Src>
+	struct valarray_memo
+	{
+		typedef Real value_type;
+		typedef typename Rep::element_type element_type;
+
+		INLINE valarray_memo(const memo_state_impl<Real, Rep, Src>* state)
+			: _state(state)
+			, _src(state->source())
+		{ }
+
+		INLINE element_type operator() (std::size_t i) const
+		{
+			const element_type* values = _state->values();
+
+			return values ? values[i] : _src(i);
+		}
+
+		INLINE std::size_t size() const
+		{
+			return _src.size();
+		}
+
+		INLINE std::size_t elements() const
+		{
+			return _src.elements();
+		}
+
+		const memo_state_impl<Real, Rep, Src>* _state;
+		typename valarray_operand<Src>::type _src;
+
+	} ; // end valarray_memo<Real, Rep, Src>
+
+	template <typename Real, typename Rep, typename Src>
+	struct valarray_operand<valarray_memo<Real, Rep, Src> >
+	{
+		typedef const valarray_memo<Real, Rep, Src> type;
+
+	} ; // end valarray_operand<valarray_memo<Real, Rep, Src> >
+
+	// Reading an intermediate costs a load when it is materialised
+	template <typename Real, typename Rep, typename Src>
+	struct valarray_cost<valarray_memo<Real, Rep, Src> >
+	{
+		enum { flops = 0, loads = 1 } ;
+	} ;
+
+	// Its values change with the inputs of its expression
+	template <typename Real, typename Rep, typename Src>
+	struct valarray_dependencies<valarray_memo<Real, Rep, Src> >
+	{
+		static INLINE bool collect(const valarray_memo<Real, Rep, Src>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Src>::collect(op._src, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_memo<Real, Rep, Src> >
+
+	// Gathers the intermediates a tree reads
+	template <typename Op>
+	struct valarray_memo_reads
+	{
+		template <typename State>
+		static INLINE void collect(const Op&, std::vector<State*>&)
+		{ }
+
+	} ; // end valarray_memo_reads<Op>
+
+	template <typename Real, typename Rep, typename Src>
+	struct valarray_memo_reads<valarray_memo<Real, Rep, Src> >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_memo<Real, Rep, Src>& op, std::vector<State*>& reads)
+		{
+			State* state = const_cast<memo_state_impl<Real, Rep, Src>*>(op._state);
+
+			for (std::size_t i = 0; i < reads.size(); ++i)
+			{
+				if (reads[i] == state)
+					return;
+			}
+
+			reads.push_back(state);
+		}
+
+	} ; // end valarray_memo_reads<valarray_memo<Real, Rep, Src> >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_memo_reads<valarray_add<Real, Op1, Op2> >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_add<Real, Op1, Op2>& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<Op1>::collect(op._op1, reads);
+			valarray_memo_reads<Op2>::collect(op._op2, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_add<Real, Op1, Op2> >
+
+	template <typename Real, typename Op1, typename Op2, typename Op3>
+	struct valarray_memo_reads<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> >& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<Op1>::collect(op._op1, reads);
+			valarray_memo_reads<Op2>::collect(op._op2, reads);
+			valarray_memo_reads<Op3>::collect(op._op3, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_memo_reads<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_add<Real, Op1, valarray_square<Real, Op2> >& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<Op1>::collect(op._op1, reads);
+			valarray_memo_reads<Op2>::collect(op._op2, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_memo_reads<valarray_mul<Real, Op1, Op2> >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_mul<Real, Op1, Op2>& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<Op1>::collect(op._op1, reads);
+			valarray_memo_reads<Op2>::collect(op._op2, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_mul<Real, Op1, Op2> >
+
+	template <typename Real, typename Op>
+	struct valarray_memo_reads<valarray_sqrt<Real, Op> >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_sqrt<Real, Op>& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<Op>::collect(op._op, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_sqrt<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct valarray_memo_reads<valarray_square<Real, Op> >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_square<Real, Op>& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<Op>::collect(op._op, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_square<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct valarray_memo_reads<valarray_rewritten<Real, Op> >
+	{
+		template <typename State>
+		static INLINE void collect(const valarray_rewritten<Real, Op>& op, std::vector<State*>& reads)
+		{
+			valarray_memo_reads<typename valarray_rewritten<Real, Op>::node_type>::collect(op._node, reads);
+		}
+
+	} ; // end valarray_memo_reads<valarray_rewritten<Real, Op> >
+
+	// Statement of a graph
+	template <typename Real, typename Rep>
+	class memo_output
+	{
+		public:
+
+			virtual ~memo_output()
+			{ }
+
+			virtual void evaluate() = 0;
+
+			std::vector<memo_state<Real, Rep>*> reads;
+
+	} ; // end class memo_output<Real, Rep>
+
+	template <typename Real, typename Rep, typename DestRep, typename Src>
+	class memo_output_impl : public memo_output<Real, Rep>
+	{
+		public:
+
+			memo_output_impl(valarray<Real, DestRep>& dest, const Src& src)
+				: _dest(dest)
+				, _src(src)
+			{ }
+
+			// Through the assignment loop of the destination, which for the
+			// heap arrays is the tuned loop
+			void evaluate()
+			{
+				valarray_assign<DestRep>::apply(_dest.rep(), _src);
+			}
+
+		private:
+
+			valarray<Real, DestRep>& _dest;
+			typename valarray_operand<Src>::type _src;
+
+	} ; // end class memo_output_impl<Real, Rep, DestRep, Src>
+
+	template <typename Real, typename Rep = valarray_rep_sse<Real> >
+	class memo_graph
+	{
+		public:
+
+			typedef memo_state<Real, Rep> state_type;
+			typedef typename state_type::pooled_buffer buffer_type;
+
+			memo_graph()
+			{ }
+
+			~memo_graph()
+			{
+				for (std::size_t i = 0; i < _outputs.size(); ++i)
+					delete _outputs[i];
+
+				for (std::size_t i = 0; i < _states.size(); ++i)
+					delete _states[i];
+
+				for (std::size_t i = 0; i < _buffers.size(); ++i)
+					delete _buffers[i];
+			}
+
+			// Names an intermediate. The result is used in the expressions
+			// of outputs, and must not be read by other intermediates. The
+			// arrays it reads must outlive the graph.
+			template <typename Src>
+			valarray<Real, valarray_memo<Real, Rep, Src> > intermediate(const valarray<Real, Src>& expr, memo_policy policy = memo_auto)
+			{
+				std::vector<state_type*> reads;
+				valarray_memo_reads<Src>::collect(expr.rep(), reads);
+
+				assert(reads.empty());
+
+				memo_state_impl<Real, Rep, Src>* state = new memo_state_impl<Real, Rep, Src>(expr.rep(), policy);
+				_states.push_back(state);
+
+				return valarray<Real, valarray_memo<Real, Rep, Src> >(valarray_memo<Real, Rep, Src>(state));
+			}
+
+			// Adds dest = expr, run after the outputs added before it. The
+			// arrays it reads are read when the graph runs, and must outlive
+			// the graph.
+			template <typename DestRep, typename Src>
+			void output(valarray<Real, DestRep>& dest, const valarray<Real, Src>& expr)
+			{
+				memo_output<Real, Rep>* statement = new memo_output_impl<Real, Rep, DestRep, Src>(dest, expr.rep());
+				valarray_memo_reads<Src>::collect(expr.rep(), statement->reads);
+
+				for (std::size_t i = 0; i < statement->reads.size(); ++i)
+					++statement->reads[i]->consumers;
+
+				_outputs.push_back(statement);
+			}
+
+			// Evaluates every output and returns the number of intermediates
+			// that were computed into a buffer
+			std::size_t run()
+			{
+				std::size_t computed = 0;
+
+				for (std::size_t i = 0; i < _states.size(); ++i)
+					_states[i]->pending = _states[i]->consumers;
+
+				for (std::size_t n = 0; n < _outputs.size(); ++n)
+				{
+					const std::vector<state_type*>& reads = _outputs[n]->reads;
+
+					for (std::size_t i = 0; i < reads.size(); ++i)
+					{
+						if (!reads[i]->buffer && materialise(*reads[i]) && acquire(*reads[i]))
+							++computed;
+					}
+
+					_outputs[n]->evaluate();
+
+					for (std::size_t i = 0; i < reads.size(); ++i)
+					{
+						if ((--reads[i]->pending == 0) && reads[i]->buffer)
+							release(*reads[i]);
+					}
+				}
+
+				return computed;
+			}
+
+			// Buffers allocated so far, the most that were in use at once
+			std::size_t buffers() const
+			{
+				return _buffers.size();
+			}
+
+			// The choice the cost model makes for an intermediate read by
+			// consumers outputs
+			static bool materialise(const state_type& state)
+			{
+				if (state.policy != memo_auto)
+					return state.policy == memo_materialise;
+
+				const std::size_t compute = state.flops * memo_flop_cost + state.loads * memo_load_cost;
+
+				const std::size_t recomputed = state.consumers * compute;
+				const std::size_t stored = compute + memo_store_cost + state.consumers * memo_load_cost;
+
+				return stored < recomputed;
+			}
+
+		private:
+
+			memo_graph(const memo_graph&);
+			memo_graph& operator= (const memo_graph&);
+
+			// Gives the state a buffer, returns false if the buffer still
+			// held its values
+			bool acquire(state_type& state)
+			{
+				buffer_type* buffer = 0;
+
+				for (std::size_t i = 0; i < _free.size(); ++i)
+				{
+					if (_free[i] == state.last)
+					{
+						buffer = take(i);
+						break;
+					}
+				}
+
+				if (buffer && (buffer->owner == &state) && !state.changed())
+				{
+					hold(state, buffer);
+
+					return false;
+				}
+
+				// Any free buffer of the right size will do
+				for (std::size_t i = 0; !buffer && (i < _free.size()); ++i)
+				{
+					if (_free[i]->values.size() == state.size)
+						buffer = take(i);
+				}
+
+				if (!buffer)
+				{
+					buffer = new buffer_type(state.size);
+					_buffers.push_back(buffer);
+				}
+
+				if (buffer->owner)
+					buffer->owner->last = 0;
+
+				buffer->owner = &state;
+
+				state.evaluate(buffer->values);
+				state.record_versions();
+
+				hold(state, buffer);
+
+				return true;
+			}
+
+			void hold(state_type& state, buffer_type* buffer)
+			{
+				state.buffer = buffer;
+				state.last = buffer;
+				state.set_values(buffer->values.data());
+			}
+
+			// The values stay in the buffer until another state takes it
+			void release(state_type& state)
+			{
+				_free.push_back(state.buffer);
+
+				state.buffer = 0;
+				state.set_values(0);
+			}
+
+			buffer_type* take(std::size_t i)
+			{
+				buffer_type* buffer = _free[i];
+
+				_free.erase(_free.begin() + i);
+
+				return buffer;
+			}
+
+			std::vector<state_type*> _states;
+			std::vector<memo_output<Real, Rep>*> _outputs;
+			std::vector<buffer_type*> _buffers;
+			std::vector<buffer_type*> _free;
+
+	} ; // end class memo_graph<Real, Rep>
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, typename Rep, typename Src>
+	struct expression_signature<expression_template_simd::valarray_memo<Real, Rep, Src> >
+	{
+		enum { bytes_per_value = sizeof(Real) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "memo(";
+			expression_signature<Src>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_memo<Real, Rep, Src> >
+}
+
+#endif
+
+#endif // end MEMO_HPP_INCLUDED
@@ -23,6 +23,25 @@ namespace expression_template_simd
 		return vmulq_f32(lhs, rhs);
 	}
 
+	INLINE float32x4_t sub(const float32x4_t& lhs, const float32x4_t& rhs)
+	{
+		return vsubq_f32(lhs, rhs);
+	}
+
+	INLINE float32x4_t div(const float32x4_t& lhs, const float32x4_t& rhs)
+	{
+	#ifdef __aarch64__
+		return vdivq_f32(lhs, rhs);
+	#else
+		// ARMv7 has no divide, refine the reciprocal estimate twice
+		float32x4_t reciprocal = vrecpeq_f32(rhs);
+		reciprocal = vmulq_f32(vrecpsq_f32(rhs, reciprocal), reciprocal);
+		reciprocal = vmulq_f32(vrecpsq_f32(rhs, reciprocal), reciprocal);
+
+		return vmulq_f32(lhs, reciprocal);
+	#endif
+	}
+
 	INLINE float32x4_t madd(const float32x4_t& a, const float32x4_t& b, const float32x4_t& c)
 	{
 		return vmlaq_f32(a, b, c);
@@ -33,13 +52,34 @@ namespace expression_template_simd
 		return vmulq_f32(v, vrsqrteq_f32(v));
 	}
 
+	// Store that bypasses the cache, the address must be aligned
+	INLINE void stream(float32x4_t* address, const float32x4_t& value)
+	{
+		// NEON has no non-temporal hint for ordinary stores
+		vst1q_f32((float*)address, value);
+	}
+
+	// Writes the lanes in order, the address need not be aligned
+	INLINE void store(float* address, const float32x4_t& value)
+	{
+		vst1q_f32(address, value);
+	}
+
 	INLINE float get(const float32x4_t& value, std::size_t i)
 	{
-	#ifdef _WIN32
-		return value.n128_f32[i];
-	#else
-		return 0.0f;
-	#endif
+		float values[4];
+		store(values, value);
+
+		return values[i];
+	}
+
+	template <typename Element>
+	Element splat(float value);
+
+	template <>
+	INLINE float32x4_t splat<float32x4_t>(float value)
+	{
+		return vdupq_n_f32(value);
 	}
 
 	template <>
@@ -78,7 +118,7 @@ namespace expression_template_simd
 				: _size(copy._size)
 				, _elements(copy._elements)
 			{
-				 _values = (element_type*)_mm_malloc(_elements, alignment());
+				 _values = (element_type*)_mm_malloc(_elements * sizeof(element_type), alignment());
 
 				 swap(copy);
 			}
@@ -104,6 +144,16 @@ namespace expression_template_simd
 				return _values[i];
 			}
 
+			INLINE const element_type* data() const
+			{
+				return _values;
+			}
+
+			INLINE element_type* data()
+			{
+				return _values;
+			}
+
 			INLINE float operator[] (std::size_t i) const
 			{
 				assert(i < _size);
@@ -152,4 +202,23 @@ namespace expression_template_simd
 
 } // end namespace expression_template_simd
 
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real>
+	struct expression_signature<expression_template_simd::valarray_rep_neon<Real> >
+	{
+		enum { bytes_per_value = sizeof(Real) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "neon";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_neon<Real> >
+}
+
+#endif
+
 #endif // end NEON_ARRAY_HPP_INCLUDED
@@ -0,0 +1,37 @@
+#include "performance_test.hpp"
+#include <cassert>
+#include <vector>
+
+namespace
+{
+	// Function local so registration is safe during static initialization
+	std::vector<performance_test_info>& registry()
+	{
+		static std::vector<performance_test_info> tests;
+
+		return tests;
+	}
+}
+
+register_performance_test::register_performance_test(const char* name, performance_test_factory create, double bytes_per_element, double flops_per_element)
+{
+	performance_test_info info;
+	info.name = name;
+	info.create = create;
+	info.bytes_per_element = bytes_per_element;
+	info.flops_per_element = flops_per_element;
+
+	registry().push_back(info);
+}
+
+std::size_t performance_test_count()
+{
+	return registry().size();
+}
+
+const performance_test_info& get_performance_test(std::size_t i)
+{
+	assert(i < registry().size());
+
+	return registry()[i];
+}
@@ -4,22 +4,95 @@
 #include "config.hpp"
 
 //---------------------------------------------------------------------
-// valarray implementations
+// Benchmark kernels
 //---------------------------------------------------------------------
 
-double time_naive_array(std::size_t size);
-double time_expr_template_float(std::size_t size);
-double time_expr_template_sse(std::size_t size);
-double time_expr_template_avx(std::size_t size);
-double time_expr_template_neon(std::size_t size);
+// A single benchmark kernel. setup() allocates and fills the arrays once,
+// outside of the timed region, and run() performs the computation being
+// measured. The same buffers are reused by every call to run().
+class performance_test
+{
+	public:
 
-//---------------------------------------------------------------------
-// C array implementations
-//---------------------------------------------------------------------
+		virtual ~performance_test()
+		{ }
+
+		virtual void setup(std::size_t size) = 0;
+
+		virtual void run() = 0;
+
+		virtual void teardown() = 0;
+
+		// Kernels that can split their work return true and implement
+		// run_partition(), where the shares for index 0 to count - 1 together
+		// do the same work as run()
+		virtual bool supports_partition() const
+		{
+			return false;
+		}
+
+		virtual void run_partition(std::size_t index, std::size_t)
+		{
+			if (index == 0)
+				run();
+		}
+
+		// Called once after the timed runs. Kernels that can check their
+		// results return false when the runs computed the wrong values.
+		virtual bool verify()
+		{
+			return true;
+		}
+
+} ; // end class performance_test
+
+// Boundaries between partitions are kept on cache line multiples so that
+// threads never write to the same line
+const std::size_t cache_line_size = 64;
+
+// Splits [0, size) into count contiguous ranges of whole granules and
+// returns the range for index
+inline void partition(std::size_t size, std::size_t index, std::size_t count, std::size_t granularity, std::size_t& begin, std::size_t& end)
+{
+	const std::size_t granules = (size + granularity - 1) / granularity;
+
+	begin = (granules * index / count) * granularity;
+	end = (granules * (index + 1) / count) * granularity;
+
+	begin = (begin < size) ? begin : size;
+	end = (end < size) ? end : size;
+}
+
+typedef performance_test* (*performance_test_factory)();
+
+template <typename Test>
+performance_test* create_performance_test()
+{
+	return new Test();
+}
+
+// Describes a registered kernel. The byte and flop counts are per value
+// and are used to derive bandwidth and throughput from the timings.
+struct performance_test_info
+{
+	const char* name;
+	performance_test_factory create;
+	double bytes_per_element;
+	double flops_per_element;
+
+} ; // end struct performance_test_info
+
+// Adds a kernel to the registry when constructed at namespace scope
+class register_performance_test
+{
+	public:
+
+		register_performance_test(const char* name, performance_test_factory create, double bytes_per_element, double flops_per_element);
+
+} ; // end class register_performance_test
+
+std::size_t performance_test_count();
 
-double time_float_arrays(std::size_t size);
-double time_sse_arrays(std::size_t elements);
-double time_avx_arrays(std::size_t elements);
-double time_neon_arrays(std::size_t elements);
+const performance_test_info& get_performance_test(std::size_t i);
 
 #endif // end PERFORMANCE_TEST_HPP_INCLUDED
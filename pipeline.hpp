@@ -0,0 +1,295 @@
+#ifndef PIPELINE_HPP_INCLUDED
+#define PIPELINE_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace expression_template_simd
+{
+	// View of a rep whose element i is element i + offset of the rep. The
+	// offset wraps, so a negative offset places a short array at a position
+	// inside a longer expression. Only the elements that lie inside the rep
+	// may be evaluated.
+	template <typename Real, typename Rep>
+	class valarray_window
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename Rep::element_type element_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			INLINE valarray_window(const Rep& rep, std::size_t offset, std::size_t elements)
+				: _rep(rep)
+				, _offset(offset)
+				, _elements(elements)
+			{ }
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				return _rep(i + _offset);
+			}
+
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				return _rep[i + _offset * lanes];
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _elements * lanes;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+		private:
+
+			const Rep& _rep;
+			std::size_t _offset;
+			std::size_t _elements;
+
+	} ; // end class valarray_window<Real, Rep>
+
+	template <typename Real, typename Rep>
+	struct valarray_operand<valarray_window<Real, Rep> >
+	{
+		typedef const valarray_window<Real, Rep> type;
+
+	} ; // end valarray_operand<valarray_window<Real, Rep> >
+
+	// Elements [begin, begin + elements) of a, as an array of that length
+	template <typename Real, typename Rep>
+	INLINE valarray<Real, valarray_window<Real, Rep> > window(const valarray<Real, Rep>& a, std::size_t begin, std::size_t elements)
+	{
+		return valarray<Real, valarray_window<Real, Rep> >(valarray_window<Real, Rep>(a.rep(), begin, elements));
+	}
+
+	// a placed at begin of an array with the given number of elements, the
+	// inverse of window()
+	template <typename Real, typename Rep>
+	INLINE valarray<Real, valarray_window<Real, Rep> > placed(const valarray<Real, Rep>& a, std::size_t begin, std::size_t elements)
+	{
+		return valarray<Real, valarray_window<Real, Rep> >(valarray_window<Real, Rep>(a.rep(), 0 - begin, elements));
+	}
+
+#ifdef USE_THREADS
+	// One step of a stage_pipeline. Stages are called one chunk at a time
+	// and in order, so a stage can keep state such as a running reduction.
+	template <typename Array>
+	class pipeline_stage
+	{
+		public:
+
+			virtual ~pipeline_stage()
+			{ }
+
+			// Computes elements [begin, end) of the problem. Input holds the
+			// previous stage's output for the chunk, and output is written
+			// for the next stage, both starting at element 0. The input of
+			// the first stage and the output of the last are scratch.
+			virtual void process(const Array& input, Array& output, std::size_t begin, std::size_t end) = 0;
+
+	} ; // end class pipeline_stage<Array>
+
+	// Runs a chain of dependent stages over a problem split into chunks.
+	// Each pair of stages is joined by a ring of chunk buffers, so while
+	// stage n works on chunk k stage n - 1 can already produce the chunks
+	// after it. The intermediate results stay in cache instead of going
+	// through full size temporaries. Every stage runs as a task on the
+	// scheduler, and a stage that is waiting on its input or on a free
+	// buffer gives its worker back rather than blocking it.
+	template <typename Array>
+	class stage_pipeline
+	{
+		public:
+
+			typedef typename Array::value_type value_type;
+			typedef typename Array::element_type element_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			// Chunk is in SIMD elements, zero takes the block size of the
+			// tuning profile. Depth is the number of buffers between two
+			// stages.
+			stage_pipeline(std::size_t elements, std::size_t chunk = 0, std::size_t depth = 2, task_scheduler& scheduler = task_scheduler::get_default())
+				: _elements(elements)
+				, _chunk((chunk > 0) ? chunk : tuning::get_profile().block_size)
+				, _depth((depth > 0) ? depth : 1)
+				, _scheduler(scheduler)
+				, _scratch(_chunk * lanes)
+			{
+				_chunks = (_elements / _chunk) + ((_elements % _chunk == 0) ? 0 : 1);
+			}
+
+			~stage_pipeline()
+			{
+				for (std::size_t i = 0; i < _stages.size(); ++i)
+				{
+					delete _stages[i];
+
+					for (std::size_t j = 0; j < _depth; ++j)
+						delete _buffers[i * _depth + j];
+				}
+			}
+
+			// Appends a stage, the pipeline takes ownership of it
+			void add_stage(pipeline_stage<Array>* stage)
+			{
+				_stages.push_back(stage);
+				_done.push_back(0);
+				_running.push_back(false);
+
+				for (std::size_t j = 0; j < _depth; ++j)
+					_buffers.push_back(new Array(_chunk * lanes));
+			}
+
+			// Runs every stage over every chunk, helping on the calling
+			// thread until the last stage has finished
+			void run()
+			{
+				if (_stages.empty())
+					return;
+
+				{
+					threading::scoped_lock lock(_lock);
+
+					for (std::size_t i = 0; i < _stages.size(); ++i)
+					{
+						_done[i] = 0;
+						_running[i] = false;
+					}
+
+					schedule(_scheduler.size());
+				}
+
+				_scheduler.wait(_group);
+			}
+
+		private:
+
+			stage_pipeline(const stage_pipeline&);
+			stage_pipeline& operator= (const stage_pipeline&);
+
+			class stage_task : public scheduler_task
+			{
+				public:
+
+					stage_task(stage_pipeline& pipeline, std::size_t stage, std::size_t chunk)
+						: scheduler_task(pipeline._group)
+						, _pipeline(pipeline)
+						, _stage(stage)
+						, _chunk(chunk)
+					{ }
+
+					void run(task_scheduler&, std::size_t worker)
+					{
+						_pipeline.process(_stage, _chunk, worker);
+					}
+
+				private:
+
+					stage_pipeline& _pipeline;
+					std::size_t _stage;
+					std::size_t _chunk;
+
+			} ; // end class stage_task
+
+			void process(std::size_t stage, std::size_t chunk, std::size_t worker)
+			{
+				const Array& input = (stage > 0) ? *_buffers[(stage - 1) * _depth + chunk % _depth] : _scratch;
+				Array& output = *_buffers[stage * _depth + chunk % _depth];
+
+				const std::size_t begin = chunk * _chunk;
+				const std::size_t end = (begin + _chunk < _elements) ? begin + _chunk : _elements;
+
+				_stages[stage]->process(input, output, begin, end);
+
+				threading::scoped_lock lock(_lock);
+
+				++_done[stage];
+				_running[stage] = false;
+
+				schedule(worker);
+			}
+
+			// Starts every stage whose next chunk has its input and a free
+			// output buffer. Called with the lock held, from outside the
+			// scheduler when worker is its size.
+			void schedule(std::size_t worker)
+			{
+				const std::size_t last = _stages.size() - 1;
+
+				for (std::size_t i = 0; i <= last; ++i)
+				{
+					const std::size_t chunk = _done[i];
+
+					if (_running[i] || (chunk == _chunks))
+						continue;
+
+					if ((i > 0) && (_done[i - 1] <= chunk))
+						continue;
+
+					if ((i < last) && (_done[i + 1] + _depth <= chunk))
+						continue;
+
+					_running[i] = true;
+
+					stage_task* task = new stage_task(*this, i, chunk);
+
+					if (worker < _scheduler.size())
+						_scheduler.spawn(task, worker);
+					else
+						_scheduler.submit(task);
+				}
+			}
+
+			std::size_t _elements;
+			std::size_t _chunk;
+			std::size_t _chunks;
+			std::size_t _depth;
+
+			task_scheduler& _scheduler;
+			task_group _group;
+
+			std::vector<pipeline_stage<Array>*> _stages;
+			// _depth buffers for the output of each stage
+			std::vector<Array*> _buffers;
+			Array _scratch;
+
+			threading::mutex _lock;
+			// Chunks each stage has finished
+			std::vector<std::size_t> _done;
+			std::vector<bool> _running;
+
+	} ; // end class stage_pipeline<Array>
+#endif
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, typename Rep>
+	struct expression_signature<expression_template_simd::valarray_window<Real, Rep> >
+	{
+		enum { bytes_per_value = expression_signature<Rep>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "window(";
+			expression_signature<Rep>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_window<Real, Rep> >
+}
+
+#endif
+
+#endif // end PIPELINE_HPP_INCLUDED
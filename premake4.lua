@@ -9,6 +9,11 @@ solution ("expression_" .. _ACTION)
 		defines { "NDEBUG" }
 		flags { "Optimize" }
 
+	configuration "linux"
+		links { "pthread" }
+
+	configuration {}
+
 	-- Vector dot product project
 	project ("dot_product_" .. _ACTION)
 		language "C++"
@@ -21,7 +26,20 @@ solution ("expression_" .. _ACTION)
 			-- Source Files
 			"main.cpp",
 			"timer.cpp",
-			"test_dot_product.cpp"
+			"test_dot_product.cpp",
+			"performance_test.cpp",
+			"benchmark.cpp",
+			"system_info.cpp",
+			"threading.cpp",
+			"thread_pool.cpp",
+			"stream.cpp",
+			"profiling.cpp",
+			"tuning.cpp",
+			"scheduler.cpp",
+			"snapshot.cpp",
+			"formula.cpp",
+			"jit.cpp",
+			"tracking.cpp"
 		}
 
 	-- Vector length project
@@ -36,5 +54,102 @@ solution ("expression_" .. _ACTION)
 			-- Source Files
 			"main.cpp",
 			"timer.cpp",
-			"test_vector_length.cpp"
+			"test_vector_length.cpp",
+			"performance_test.cpp",
+			"benchmark.cpp",
+			"system_info.cpp",
+			"threading.cpp",
+			"thread_pool.cpp",
+			"stream.cpp",
+			"profiling.cpp",
+			"tuning.cpp",
+			"scheduler.cpp",
+			"snapshot.cpp",
+			"formula.cpp",
+			"jit.cpp",
+			"tracking.cpp"
+		}
+
+	-- Generated expression shapes project
+	project ("expression_shapes_" .. _ACTION)
+		language "C++"
+		kind "ConsoleApp"
+		files 
+		{
+			-- Header Files
+			"*.hpp",
+
+			-- Source Files
+			"main.cpp",
+			"timer.cpp",
+			"test_expression_shapes.cpp",
+			"performance_test.cpp",
+			"benchmark.cpp",
+			"system_info.cpp",
+			"threading.cpp",
+			"thread_pool.cpp",
+			"stream.cpp",
+			"profiling.cpp",
+			"tuning.cpp",
+			"scheduler.cpp",
+			"snapshot.cpp",
+			"formula.cpp",
+			"jit.cpp",
+			"tracking.cpp"
+		}
+
+	-- Autotuner for the evaluation loop
+	project ("autotune_" .. _ACTION)
+		language "C++"
+		kind "ConsoleApp"
+		files 
+		{
+			-- Header Files
+			"*.hpp",
+
+			-- Source Files
+			"autotune.cpp",
+			"timer.cpp",
+			"performance_test.cpp",
+			"benchmark.cpp",
+			"system_info.cpp",
+			"threading.cpp",
+			"thread_pool.cpp",
+			"profiling.cpp",
+			"tuning.cpp",
+			"scheduler.cpp",
+			"snapshot.cpp",
+			"formula.cpp",
+			"jit.cpp",
+			"tracking.cpp"
+		}
+
+	-- Regression suite over every kernel
+	project ("regression_" .. _ACTION)
+		language "C++"
+		kind "ConsoleApp"
+		files 
+		{
+			-- Header Files
+			"*.hpp",
+
+			-- Source Files
+			"regression_main.cpp",
+			"regression.cpp",
+			"timer.cpp",
+			"test_dot_product.cpp",
+			"test_vector_length.cpp",
+			"performance_test.cpp",
+			"benchmark.cpp",
+			"system_info.cpp",
+			"threading.cpp",
+			"thread_pool.cpp",
+			"stream.cpp",
+			"profiling.cpp",
+			"tuning.cpp",
+			"scheduler.cpp",
+			"snapshot.cpp",
+			"formula.cpp",
+			"jit.cpp",
+			"tracking.cpp"
 		}
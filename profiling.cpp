@@ -0,0 +1,190 @@
+#include "config.hpp"
+
+#ifdef USE_PROFILING
+
+#include "threading.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+namespace
+{
+	const std::size_t max_sites = 1024;
+
+	// Written only by the owning thread, but read by dump() at any time
+	struct shared_counters
+	{
+		volatile uint64_t calls;
+		volatile uint64_t values;
+		volatile uint64_t ticks;
+		volatile uint64_t bytes;
+	} ;
+
+	// Counters owned by one thread, only ever written by that thread.
+	// Blocks are never freed so the counts of finished threads remain.
+	struct thread_counters
+	{
+		shared_counters sites[max_sites];
+		thread_counters* next;
+	} ;
+
+	thread_counters* volatile __threads = 0;
+	THREAD_LOCAL thread_counters* __counters = 0;
+
+	threading::mutex __lock;
+	std::vector<std::string> __signatures;
+
+	thread_counters* get_thread_counters()
+	{
+		if (!__counters)
+		{
+			thread_counters* counters = new thread_counters;
+			std::memset((void*)counters->sites, 0, sizeof(counters->sites));
+
+			// Push onto the list of all threads without locking
+			void* head;
+
+			do
+			{
+				head = __threads;
+				counters->next = (thread_counters*)head;
+			} while (threading::compare_exchange((void* volatile*)&__threads, counters, head) != head);
+
+			__counters = counters;
+		}
+
+		return __counters;
+	}
+
+	struct site_total
+	{
+		std::string signature;
+		profiling::site_counters counters;
+
+		bool operator< (const site_total& other) const
+		{
+			return counters.ticks > other.counters.ticks;
+		}
+	} ;
+}
+
+void profiling::append_number(std::string& signature, std::size_t value)
+{
+	char digits[24];
+	std::size_t count = 0;
+
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+
+	while (count > 0)
+		signature += digits[--count];
+}
+
+std::size_t profiling::register_site(const std::string& signature)
+{
+	threading::scoped_lock lock(__lock);
+
+	for (std::size_t i = 0; i < __signatures.size(); ++i)
+	{
+		if (__signatures[i] == signature)
+			return i + 1;
+	}
+
+	__signatures.push_back(signature);
+
+	return __signatures.size();
+}
+
+void profiling::record(std::size_t site, std::size_t values, uint64_t ticks, uint64_t bytes)
+{
+	if (site >= max_sites)
+		return;
+
+	shared_counters& counters = get_thread_counters()->sites[site];
+
+	// Only this thread writes the counters, so reading them back needs no
+	// atomics. The stores must not tear for dump().
+	threading::store(&counters.calls, counters.calls + 1);
+	threading::store(&counters.values, counters.values + values);
+	threading::store(&counters.ticks, counters.ticks + ticks);
+	threading::store(&counters.bytes, counters.bytes + bytes);
+}
+
+void profiling::dump(std::ostream& out)
+{
+	std::vector<site_total> totals;
+
+	{
+		threading::scoped_lock lock(__lock);
+
+		totals.resize(__signatures.size());
+
+		for (std::size_t i = 0; i < totals.size(); ++i)
+		{
+			totals[i].signature = __signatures[i];
+			std::memset(&totals[i].counters, 0, sizeof(site_counters));
+		}
+	}
+
+	for (thread_counters* counters = __threads; counters; counters = counters->next)
+	{
+		for (std::size_t i = 0; (i < totals.size()) && (i + 1 < max_sites); ++i)
+		{
+			const shared_counters& site = counters->sites[i + 1];
+
+			totals[i].counters.calls += threading::load(&site.calls);
+			totals[i].counters.values += threading::load(&site.values);
+			totals[i].counters.ticks += threading::load(&site.ticks);
+			totals[i].counters.bytes += threading::load(&site.bytes);
+		}
+	}
+
+	std::sort(totals.begin(), totals.end());
+
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out.setf(std::ios::fixed, std::ios::floatfield);
+
+	out << std::setw(10) << "calls"
+	    << std::setw(14) << "values"
+	    << std::setw(12) << "total ms"
+	    << std::setw(10) << "ns/value"
+	    << std::setw(10) << "GB/s"
+	    << "  expression\n";
+
+	for (std::size_t i = 0; i < totals.size(); ++i)
+	{
+		const site_counters& counters = totals[i].counters;
+
+		if (counters.calls == 0)
+			continue;
+
+		const double seconds = counters.ticks * system_time::get_resolution();
+
+		out << std::setw(10) << counters.calls
+		    << std::setw(14) << counters.values
+		    << std::setprecision(3)
+		    << std::setw(12) << seconds * 1e3
+		    << std::setw(10) << ((counters.values > 0) ? seconds / counters.values * 1e9 : 0.0)
+		    << std::setprecision(2)
+		    << std::setw(10) << ((seconds > 0.0) ? counters.bytes / seconds * 1e-9 : 0.0)
+		    << "  " << totals[i].signature << "\n";
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void profiling::reset()
+{
+	for (thread_counters* counters = __threads; counters; counters = counters->next)
+		std::memset((void*)counters->sites, 0, sizeof(counters->sites));
+}
+
+#endif // end USE_PROFILING
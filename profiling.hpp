@@ -0,0 +1,113 @@
+#ifndef PROFILING_HPP_INCLUDED
+#define PROFILING_HPP_INCLUDED
+
+#include "threading.hpp"
+#include "timer.hpp"
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <stdint.h>
+
+//---------------------------------------------------------------------
+// Expression profiling
+//---------------------------------------------------------------------
+
+// Only compiled in with USE_PROFILING. Every evaluation of an expression
+// through valarray::operator= or valarray::assign is recorded against the
+// type of its tree. Counters are kept per thread so recording never takes
+// a lock, and are summed over all threads when dumped.
+namespace profiling
+{
+	// Readable description of an expression type, and the bytes it reads
+	// from memory for each value. Each rep specializes this in its own
+	// header, so leaves that are not are generic arrays.
+	template <typename Expression>
+	struct expression_signature
+	{
+		enum { bytes_per_value = sizeof(typename Expression::value_type) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "array";
+		}
+
+	} ; // end struct expression_signature<Expression>
+
+	struct site_counters
+	{
+		uint64_t calls;
+		uint64_t values;
+		uint64_t ticks;
+		uint64_t bytes;
+
+	} ; // end struct site_counters
+
+	// Appends a template argument such as the length of a fixed array
+	void append_number(std::string& signature, std::size_t value);
+
+	// Returns the id of the expression with the given signature, adding it
+	// when first seen. Ids start at 1.
+	std::size_t register_site(const std::string& signature);
+
+	// Adds one evaluation to the calling thread's counters
+	void record(std::size_t site, std::size_t values, uint64_t ticks, uint64_t bytes);
+
+	// Prints every expression seen with the counts summed over all threads,
+	// most expensive first. Counts from threads still recording may be
+	// slightly behind.
+	void dump(std::ostream& out);
+
+	// Clears the counters of every thread. Only call while no expressions
+	// are being evaluated.
+	void reset();
+
+	template <typename Real, typename Expression>
+	std::size_t expression_site()
+	{
+		// Registration is idempotent, so threads racing on first use all
+		// publish the same id
+		static volatile std::size_t site = 0;
+
+		std::size_t id = threading::load_acquire(&site);
+
+		if (id == 0)
+		{
+			std::string signature;
+			expression_signature<Expression>::append(signature);
+
+			id = register_site(signature);
+			threading::compare_exchange(&site, id, 0);
+		}
+
+		return id;
+	}
+
+	// Times the enclosing scope and records it against an expression
+	template <typename Real, typename Dest, typename Expression>
+	class expression_scope
+	{
+		public:
+
+			explicit expression_scope(std::size_t values)
+				: _values(values)
+				, _start(system_time::get_time())
+			{ }
+
+			~expression_scope()
+			{
+				const uint64_t bytes_per_value =
+					expression_signature<Expression>::bytes_per_value +
+					expression_signature<Dest>::bytes_per_value;
+
+				record(expression_site<Real, Expression>(), _values, system_time::get_time() - _start, bytes_per_value * _values);
+			}
+
+		private:
+
+			std::size_t _values;
+			uint64_t _start;
+
+	} ; // end class expression_scope<Real, Dest, Expression>
+}
+
+#endif // end PROFILING_HPP_INCLUDED
@@ -0,0 +1,311 @@
+#ifndef QUANTIZED_ARRAY_HPP_INCLUDED
+#define QUANTIZED_ARRAY_HPP_INCLUDED
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <emmintrin.h>
+
+namespace expression_template_simd
+{
+	// Conversions between int8 storage and float lanes. Loading computes
+	// q * scale + offset, where offset = -zero_point * scale. Storing rounds
+	// to nearest and saturates to [-128, 127]. The zero point is only an
+	// offset, so it lies outside the int8 range when the range of the
+	// values does not contain 0.
+	struct int8_format
+	{
+		static INLINE void load(const int8_t* values, const __m128& scale, const __m128& offset, __m128& out)
+		{
+			int32_t packed;
+			std::memcpy(&packed, values, sizeof(packed));
+
+			__m128i widened = _mm_cvtsi32_si128(packed);
+			widened = _mm_unpacklo_epi8(widened, widened);
+			widened = _mm_unpacklo_epi16(widened, widened);
+			widened = _mm_srai_epi32(widened, 24);
+
+			out = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(widened), scale), offset);
+		}
+
+		static INLINE void store(int8_t* values, const __m128& value, const __m128& inverse_scale, const __m128& zero_point)
+		{
+			const int32_t packed = _mm_cvtsi128_si32(narrow(value, inverse_scale, zero_point));
+
+			std::memcpy(values, &packed, sizeof(packed));
+		}
+
+	#ifdef USE_AVX
+		static INLINE void load(const int8_t* values, const __m256& scale, const __m256& offset, __m256& out)
+		{
+			__m128 low;
+			__m128 high;
+
+			load(values,     _mm256_castps256_ps128(scale), _mm256_castps256_ps128(offset), low);
+			load(values + 4, _mm256_castps256_ps128(scale), _mm256_castps256_ps128(offset), high);
+
+			out = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+		}
+
+		static INLINE void store(int8_t* values, const __m256& value, const __m256& inverse_scale, const __m256& zero_point)
+		{
+			const __m128i low  = narrow(_mm256_castps256_ps128(value), _mm256_castps256_ps128(inverse_scale), _mm256_castps256_ps128(zero_point));
+			const __m128i high = narrow(_mm256_extractf128_ps(value, 1), _mm256_castps256_ps128(inverse_scale), _mm256_castps256_ps128(zero_point));
+
+			_mm_storel_epi64((__m128i*)values, _mm_unpacklo_epi32(low, high));
+		}
+	#endif
+
+		// Returns the four quantized values packed into the low 32 bits. The
+		// clamp is done in float since out of range conversions give
+		// INT_MIN, which would saturate large positive values to -128.
+		static INLINE __m128i narrow(const __m128& value, const __m128& inverse_scale, const __m128& zero_point)
+		{
+			const __m128 scaled = _mm_add_ps(_mm_mul_ps(value, inverse_scale), zero_point);
+			const __m128 clamped = _mm_min_ps(_mm_max_ps(scaled, _mm_set1_ps(-128.0f)), _mm_set1_ps(127.0f));
+
+			const __m128i rounded = _mm_cvtps_epi32(clamped);
+			const __m128i words = _mm_packs_epi32(rounded, rounded);
+
+			return _mm_packs_epi16(words, words);
+		}
+
+	} ; // end int8_format
+
+	template <typename Real, typename Element = void>
+	class valarray_rep_quantized;
+
+	// Stores each value as an int8 with a per-array scale and zero point.
+	// Elements are dequantized to float lanes on load, so the rep mixes
+	// freely with float arrays. Writes quantize through a reference proxy.
+	template <typename Element>
+	class valarray_rep_quantized<float, Element>
+	{
+		public:
+
+			typedef float value_type;
+			typedef typename default_element<Element>::type element_type;
+			typedef int8_t storage_type;
+
+			enum { lanes = sizeof(element_type) / sizeof(value_type) } ;
+
+			class reference
+			{
+				public:
+
+					INLINE reference(const valarray_rep_quantized& rep, storage_type* values)
+						: _rep(rep)
+						, _values(values)
+					{ }
+
+					INLINE reference& operator= (const element_type& value)
+					{
+						int8_format::store(_values, value, _rep._inverse_scale_lanes, _rep._zero_point_lanes);
+
+						return *this;
+					}
+
+					INLINE operator element_type() const
+					{
+						element_type value;
+						int8_format::load(_values, _rep._scale_lanes, _rep._offset_lanes, value);
+
+						return value;
+					}
+
+				private:
+
+					const valarray_rep_quantized& _rep;
+					storage_type* _values;
+
+			} ; // end class reference
+
+			INLINE valarray_rep_quantized(std::size_t size)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes, alignment());
+
+				set_quantization(1.0f, 0);
+			}
+
+			INLINE valarray_rep_quantized(std::size_t size, value_type scale, int zero_point)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes, alignment());
+
+				set_quantization(scale, zero_point);
+			}
+
+			INLINE valarray_rep_quantized(std::size_t size, value_type value)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes, alignment());
+
+				// Pick a scale that represents the value exactly when possible
+				set_quantization((value == 0.0f) ? 1.0f : std::fabs(value) / 127.0f, 0);
+
+				std::memset(_values, (value < 0.0f) ? -127 : ((value > 0.0f) ? 127 : 0), _elements * lanes);
+			}
+
+			INLINE ~valarray_rep_quantized()
+			{
+				_mm_free(_values);
+			}
+
+			INLINE valarray_rep_quantized(const valarray_rep_quantized& copy)
+				: _size(copy._size)
+				, _elements(copy._elements)
+			{
+				_values = (storage_type*)_mm_malloc(_elements * lanes, alignment());
+
+				set_quantization(copy._scale, copy._zero_point);
+
+				swap(copy);
+			}
+
+			INLINE valarray_rep_quantized& operator= (const valarray_rep_quantized& copy)
+			{
+				set_quantization(copy._scale, copy._zero_point);
+
+				swap(copy);
+
+				return *this;
+			}
+
+			// Creates an array whose quantization covers [minimum, maximum]
+			static INLINE valarray_rep_quantized from_range(std::size_t size, value_type minimum, value_type maximum)
+			{
+				assert(minimum < maximum);
+
+				const value_type scale = (maximum - minimum) / 255.0f;
+				const int zero_point = -128 - (int)std::floor(minimum / scale + 0.5f);
+
+				return valarray_rep_quantized(size, scale, zero_point);
+			}
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				assert(i < _elements);
+
+				element_type value;
+				int8_format::load(_values + i * lanes, _scale_lanes, _offset_lanes, value);
+
+				return value;
+			}
+
+			INLINE reference operator() (std::size_t i)
+			{
+				assert(i < _elements);
+
+				return reference(*this, _values + i * lanes);
+			}
+
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				assert(i < _size);
+
+				return (_values[i] - _zero_point) * _scale;
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+			INLINE value_type scale() const
+			{
+				return _scale;
+			}
+
+			INLINE int zero_point() const
+			{
+				return _zero_point;
+			}
+
+			INLINE static std::size_t alignment()
+			{
+				return sizeof(element_type);
+			}
+
+			INLINE static std::size_t element_size()
+			{
+				return lanes;
+			}
+
+			INLINE void swap(const valarray_rep_quantized& copy)
+			{
+				assert(_size == copy._size);
+
+				std::memcpy(_values, copy._values, _elements * lanes);
+			}
+
+		private:
+
+			INLINE void set_quantization(value_type scale, int zero_point)
+			{
+				assert(scale > 0.0f);
+
+				_scale = scale;
+				_zero_point = zero_point;
+
+				fill(_scale_lanes, scale);
+				fill(_offset_lanes, -zero_point * scale);
+				fill(_inverse_scale_lanes, 1.0f / scale);
+				fill(_zero_point_lanes, (value_type)zero_point);
+			}
+
+			static INLINE void fill(element_type& lanes_out, value_type value)
+			{
+				value_type* values = reinterpret_cast<value_type*>(&lanes_out);
+
+				for (std::size_t i = 0; i < lanes; ++i)
+					values[i] = value;
+			}
+
+			element_type _scale_lanes;
+			element_type _offset_lanes;
+			element_type _inverse_scale_lanes;
+			element_type _zero_point_lanes;
+			std::size_t _size;
+			std::size_t _elements;
+			storage_type* _values;
+			value_type _scale;
+			int _zero_point;
+
+	} ; // end class valarray_rep_quantized<float, Element>
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, typename Element>
+	struct expression_signature<expression_template_simd::valarray_rep_quantized<Real, Element> >
+	{
+		enum { bytes_per_value = sizeof(int8_t) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "int8";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_quantized<Real, Element> >
+}
+
+#endif
+
+#endif // end QUANTIZED_ARRAY_HPP_INCLUDED
@@ -0,0 +1,234 @@
+#ifndef REDUCTION_HPP_INCLUDED
+#define REDUCTION_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace expression_template_simd
+{
+	enum reduction_mode
+	{
+		// Sums in whatever order is quickest, the result can change with
+		// the thread count and the SIMD width
+		fast_reduction,
+		// Sums in an order fixed by the size alone, so the result is the
+		// same for any thread count and SIMD width
+		deterministic_reduction
+	} ;
+
+	enum
+	{
+		// Running sums kept while reducing, value i is added to sum
+		// i % reduction_lanes whatever the SIMD width
+		reduction_lanes = 32,
+		// Values in each block of a deterministic reduction
+		reduction_block_size = 4096
+	} ;
+
+	// Adds the two halves of the values recursively, the shape of the tree
+	// depends only on the count
+	template <typename Real>
+	Real pairwise_sum(const Real* values, std::size_t count)
+	{
+		if (count <= 1)
+			return (count == 1) ? values[0] : Real(0);
+
+		const std::size_t half = count / 2;
+
+		return pairwise_sum(values, half) + pairwise_sum(values + half, count - half);
+	}
+
+	template <std::size_t Index, std::size_t Count>
+	struct valarray_reduce_step
+	{
+		template <typename Element, typename Src>
+		static INLINE void accumulate(Element* sums, const Src& src, std::size_t base)
+		{
+			sums[Index] = add(sums[Index], src(base + Index));
+
+			valarray_reduce_step<Index + 1, Count>::accumulate(sums, src, base);
+		}
+
+	} ; // end valarray_reduce_step<Index, Count>
+
+	template <std::size_t Count>
+	struct valarray_reduce_step<Count, Count>
+	{
+		template <typename Element, typename Src>
+		static INLINE void accumulate(Element*, const Src&, std::size_t)
+		{ }
+
+	} ; // end valarray_reduce_step<Count, Count>
+
+	template <typename Real, typename Src>
+	struct valarray_reduce
+	{
+		typedef typename Src::element_type element_type;
+
+		enum { lanes = sizeof(element_type) / sizeof(Real) } ;
+		enum { accumulators = reduction_lanes / lanes } ;
+
+		// Sums values [begin, end) into reduction_lanes running sums, each
+		// in index order. Begin must be a multiple of reduction_lanes.
+		static void accumulate(const Src& src, std::size_t begin, std::size_t end, Real* result)
+		{
+			assert(begin % reduction_lanes == 0);
+
+			element_type sums[accumulators];
+
+			for (std::size_t a = 0; a < accumulators; ++a)
+				sums[a] = splat<element_type>(Real(0));
+
+			std::size_t i = begin / lanes;
+			const std::size_t full = end / lanes;
+
+			for (; i + accumulators <= full; i += accumulators)
+				valarray_reduce_step<0, accumulators>::accumulate(sums, src, i);
+
+			for (std::size_t a = 0; i < full; ++i, ++a)
+				sums[a] = add(sums[a], src(i));
+
+			for (std::size_t a = 0; a < accumulators; ++a)
+				store(result + a * lanes, sums[a]);
+
+			// Only part of the last element belongs to the array
+			if (full * lanes < end)
+			{
+				Real tail[lanes];
+				store(tail, src(full));
+
+				for (std::size_t v = full * lanes; v < end; ++v)
+					result[v % reduction_lanes] += tail[v - full * lanes];
+			}
+		}
+
+		static Real sum(const Src& src, std::size_t begin, std::size_t end)
+		{
+			Real result[reduction_lanes];
+			accumulate(src, begin, end, result);
+
+			return pairwise_sum(result, reduction_lanes);
+		}
+
+	} ; // end valarray_reduce<Real, Src>
+
+#ifdef USE_THREADS
+	// Threads take blocks from a shared counter. Deterministic reductions
+	// keep the sum of every block, fast ones the sum of every thread.
+	template <typename Real, typename Src>
+	struct valarray_reduce_task
+	{
+		const Src* src;
+		std::size_t size;
+		std::size_t block_size;
+		bool deterministic;
+		Real* sums;
+		volatile std::size_t next;
+
+		static void run(void* context, std::size_t index, std::size_t)
+		{
+			valarray_reduce_task& task = *(valarray_reduce_task*)context;
+
+			Real partial = Real(0);
+
+			for (;;)
+			{
+				const std::size_t begin = threading::fetch_add(&task.next, task.block_size);
+
+				if (begin >= task.size)
+					break;
+
+				const std::size_t end = (begin + task.block_size < task.size) ? begin + task.block_size : task.size;
+				const Real sum = valarray_reduce<Real, Src>::sum(*task.src, begin, end);
+
+				if (task.deterministic)
+					task.sums[begin / task.block_size] = sum;
+				else
+					partial += sum;
+			}
+
+			if (!task.deterministic)
+				task.sums[index] = partial;
+		}
+
+	} ; // end valarray_reduce_task<Real, Src>
+#endif
+
+	template <typename Real, typename Src>
+	Real reduce(const Src& src, reduction_mode mode)
+	{
+		const std::size_t size = src.size();
+		const std::size_t blocks = (size / reduction_block_size) + ((size % reduction_block_size == 0) ? 0 : 1);
+
+		if (blocks <= 1)
+			return valarray_reduce<Real, Src>::sum(src, 0, size);
+
+		std::vector<Real> sums;
+
+#ifdef USE_THREADS
+		const tuning::tuning_profile& profile = tuning::get_profile();
+
+		if (size >= profile.parallel_threshold)
+		{
+			thread_pool* pool = tuning::acquire_thread_pool();
+
+			if (pool)
+			{
+				// Fast blocks follow the profile, rounded to whole lanes
+				const std::size_t lanes = sizeof(typename Src::element_type) / sizeof(Real);
+				const std::size_t block_size = ((profile.block_size * lanes + reduction_lanes - 1) / reduction_lanes) * reduction_lanes;
+
+				valarray_reduce_task<Real, Src> task;
+				task.src = &src;
+				task.size = size;
+				task.block_size = (mode == deterministic_reduction) ? (std::size_t)reduction_block_size : block_size;
+				task.deterministic = (mode == deterministic_reduction);
+				task.next = 0;
+
+				sums.resize(task.deterministic ? blocks : pool->size());
+				task.sums = &sums[0];
+
+				pool->run(&valarray_reduce_task<Real, Src>::run, &task);
+
+				tuning::release_thread_pool();
+
+				return pairwise_sum(&sums[0], sums.size());
+			}
+		}
+#endif
+
+		if (mode == fast_reduction)
+			return valarray_reduce<Real, Src>::sum(src, 0, size);
+
+		sums.resize(blocks);
+
+		for (std::size_t i = 0; i < blocks; ++i)
+		{
+			const std::size_t begin = i * reduction_block_size;
+			const std::size_t end = (begin + reduction_block_size < size) ? begin + reduction_block_size : size;
+
+			sums[i] = valarray_reduce<Real, Src>::sum(src, begin, end);
+		}
+
+		return pairwise_sum(&sums[0], blocks);
+	}
+
+	// Sum of every value of the expression. A deterministic sum gives the
+	// same bits on every run as long as the expression computes the same
+	// values, the SSE and AVX reps included.
+	template <typename Real, typename Rep>
+	Real sum(const valarray<Real, Rep>& a, reduction_mode mode = fast_reduction)
+	{
+		return reduce<Real>(a.rep(), mode);
+	}
+
+	template <typename Real, typename Rep1, typename Rep2>
+	Real dot(const valarray<Real, Rep1>& a, const valarray<Real, Rep2>& b, reduction_mode mode = fast_reduction)
+	{
+		return sum(a * b, mode);
+	}
+
+} // end namespace expression_template_simd
+
+#endif // end REDUCTION_HPP_INCLUDED
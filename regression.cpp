@@ -0,0 +1,197 @@
+#include "regression.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+bool read_baseline(const char* path, baseline& values)
+{
+	std::ifstream in(path);
+
+	if (!in)
+		return false;
+
+	std::string line;
+
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		std::string key;
+
+		if (!(fields >> key) || (key[0] == '#'))
+			continue;
+
+		if (key == "size")
+		{
+			fields >> values.size;
+		}
+		else if (key == "repeat")
+		{
+			fields >> values.repeat;
+		}
+		else if (key == "kernel")
+		{
+			baseline_entry entry;
+
+			if (!(fields >> entry.name >> entry.reference >> entry.ratio >> entry.tolerance))
+				return false;
+
+			values.entries.push_back(entry);
+		}
+		else
+		{
+			return false;
+		}
+
+		if (fields.fail())
+			return false;
+	}
+
+	return true;
+}
+
+bool write_baseline(const char* path, const baseline& values)
+{
+	std::ofstream out(path);
+
+	if (!out)
+		return false;
+
+	out << "# Expression template regression baseline\n"
+	    << "#\n"
+	    << "# kernel <name> <reference> <GB/s ratio to reference> <tolerance %>\n"
+	    << "#\n"
+	    << "# Throughput is measured from the fastest run, which other load on\n"
+	    << "# the host disturbs least, and the reference is a C array kernel run\n"
+	    << "# alongside it. Regenerate with --update when a change is meant to\n"
+	    << "# move a ratio.\n\n";
+
+	out << "size " << values.size << "\n"
+	    << "repeat " << values.repeat << "\n\n";
+
+	out << std::fixed;
+
+	for (std::size_t i = 0; i < values.entries.size(); ++i)
+	{
+		const baseline_entry& entry = values.entries[i];
+
+		out << "kernel " << std::left << std::setw(40) << entry.name << std::setw(28) << entry.reference << std::right
+		    << std::setprecision(3) << std::setw(8) << entry.ratio
+		    << std::setprecision(1) << std::setw(8) << entry.tolerance << "\n";
+	}
+
+	return out.good();
+}
+
+std::string reference_kernel(const std::string& name)
+{
+	const std::string::size_type slash = name.find('/');
+	const std::string group = (slash == std::string::npos) ? std::string() : name.substr(0, slash + 1);
+
+	if (name.find("_sse") != std::string::npos)
+		return group + "sse_arrays";
+	if (name.find("_avx") != std::string::npos)
+		return group + "avx_arrays";
+	if (name.find("_neon") != std::string::npos)
+		return group + "neon_arrays";
+
+	return group + "float_arrays";
+}
+
+namespace
+{
+	const benchmark_result* find_result(const std::vector<benchmark_result>& results, const std::string& name)
+	{
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			if (results[i].name == name)
+				return &results[i];
+		}
+
+		return 0;
+	}
+}
+
+double best_throughput(const benchmark_result& result)
+{
+	return (result.minimum > 0.0) ? result.working_set / result.minimum * 1e-9 : 0.0;
+}
+
+std::vector<regression_result> compare_baseline(const baseline& values, const std::vector<benchmark_result>& results)
+{
+	std::vector<regression_result> regressions;
+
+	for (std::size_t i = 0; i < values.entries.size(); ++i)
+	{
+		regression_result regression;
+		regression.expected = values.entries[i];
+		regression.ratio = 0.0;
+		regression.change = 0.0;
+		regression.status = regression_missing;
+
+		const benchmark_result* kernel = find_result(results, regression.expected.name);
+		const benchmark_result* reference = find_result(results, regression.expected.reference);
+
+		if (kernel && reference && (best_throughput(*reference) > 0.0))
+		{
+			const double expected = regression.expected.ratio;
+
+			regression.ratio = best_throughput(*kernel) / best_throughput(*reference);
+			regression.change = (expected > 0.0) ? (regression.ratio / expected - 1.0) * 100.0 : 0.0;
+
+			if (regression.change < -regression.expected.tolerance)
+				regression.status = regression_failed;
+			else if (regression.change > regression.expected.tolerance)
+				regression.status = regression_improved;
+			else
+				regression.status = regression_pass;
+		}
+
+		regressions.push_back(regression);
+	}
+
+	return regressions;
+}
+
+std::size_t print_regressions(std::ostream& out, const std::vector<regression_result>& results)
+{
+	static const char* status_names[] = { "ok", "improved", "REGRESSED", "missing" };
+
+	const std::ios_base::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	out << std::left << std::setw(44) << "Kernel" << std::right
+	    << std::setw(12) << "base ratio"
+	    << std::setw(12) << "now ratio"
+	    << std::setw(10) << "change %"
+	    << std::setw(8) << "tol %"
+	    << std::setw(12) << "status" << "\n";
+
+	out << std::fixed;
+
+	std::size_t failures = 0;
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const regression_result& result = results[i];
+
+		out << std::left << std::setw(44) << result.expected.name << std::right << std::setprecision(2)
+		    << std::setw(12) << result.expected.ratio;
+
+		if (result.status == regression_missing)
+			out << std::setw(12) << "-" << std::setw(10) << "-";
+		else
+			out << std::setw(12) << result.ratio << std::setprecision(1) << std::setw(10) << result.change;
+
+		out << std::setprecision(1) << std::setw(8) << result.expected.tolerance
+		    << std::setw(12) << status_names[result.status] << "\n";
+
+		if (result.status == regression_failed)
+			++failures;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+
+	return failures;
+}
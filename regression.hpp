@@ -0,0 +1,76 @@
+#ifndef REGRESSION_HPP_INCLUDED
+#define REGRESSION_HPP_INCLUDED
+
+#include "benchmark.hpp"
+
+//---------------------------------------------------------------------
+// Regression baselines
+//---------------------------------------------------------------------
+
+// Expected best throughput of one kernel as a ratio to a C array
+// reference kernel measured in the same run, and how far below it a run may fall,
+// as a percentage, before it is considered a regression. The ratio
+// depends on the code the kernel compiles to, not the speed of the host.
+struct baseline_entry
+{
+	std::string name;
+	std::string reference;
+	double ratio;
+	double tolerance;
+
+} ; // end struct baseline_entry
+
+// The kernels to run and the problem size they were recorded at
+struct baseline
+{
+	std::size_t size;
+	std::size_t repeat;
+	std::vector<baseline_entry> entries;
+
+	baseline()
+		: size(1000000)
+		, repeat(50)
+	{ }
+
+} ; // end struct baseline
+
+enum regression_status
+{
+	regression_pass,
+	regression_improved,
+	regression_failed,
+	regression_missing
+} ;
+
+struct regression_result
+{
+	baseline_entry expected;
+	double ratio;
+	double change;
+	regression_status status;
+
+} ; // end struct regression_result
+
+// GB/s of the fastest run
+double best_throughput(const benchmark_result& result);
+
+// The C array kernel with the same instruction set as the named kernel,
+// for example dot_product/sse_arrays for dot_product/expr_template_sse
+std::string reference_kernel(const std::string& name);
+
+// Reads a baseline written by write_baseline. Blank lines and lines
+// starting with '#' are ignored.
+bool read_baseline(const char* path, baseline& values);
+
+bool write_baseline(const char* path, const baseline& values);
+
+// Compares the ratio of each baseline entry against the results with the
+// same names. Entries without a result for the kernel or its reference
+// are reported as missing, which is not a failure as the kernel may not
+// be compiled in on this target.
+std::vector<regression_result> compare_baseline(const baseline& values, const std::vector<benchmark_result>& results);
+
+// Prints a diff table and returns the number of regressions
+std::size_t print_regressions(std::ostream& out, const std::vector<regression_result>& results);
+
+#endif // end REGRESSION_HPP_INCLUDED
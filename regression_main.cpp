@@ -0,0 +1,187 @@
+#include "regression.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	void print_usage(const char* program)
+	{
+		std::cout << "Usage: " << program << " [options]\n"
+		          << "  --baseline path  Baseline file (default regression_baseline.txt)\n"
+		          << "  --update         Rewrite the baseline from this run\n"
+		          << "  --tolerance P    Tolerance in percent for kernels new to the baseline\n"
+		          << "  --kernel a,b     Kernels to add to the baseline when updating\n"
+		          << "  --tsc            Time with the invariant TSC instead of the OS clock\n";
+	}
+}
+
+//---------------------------------------------------------------------
+// Main
+//---------------------------------------------------------------------
+
+// Exits with 0 when every kernel is within tolerance, 1 on a regression
+// and 2 when the baseline could not be read or written
+int main(int argc, char *argv[])
+{
+	const char* baseline_path = "regression_baseline.txt";
+	bool update = false;
+	double tolerance = 10.0;
+	std::string filter;
+	system_time::clock_source source = system_time::default_clock;
+
+	// Parse the command line
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const bool has_value = (i + 1 < argc);
+
+		if ((std::strcmp(arg, "--baseline") == 0) && has_value)
+			baseline_path = argv[++i];
+		else if (std::strcmp(arg, "--update") == 0)
+			update = true;
+		else if ((std::strcmp(arg, "--tolerance") == 0) && has_value)
+			tolerance = std::atof(argv[++i]);
+		else if ((std::strcmp(arg, "--kernel") == 0) && has_value)
+			filter = argv[++i];
+		else if (std::strcmp(arg, "--tsc") == 0)
+			source = system_time::cycle_counter;
+		else
+		{
+			print_usage(argv[0]);
+
+			return 2;
+		}
+	}
+
+	baseline values;
+
+	if (!read_baseline(baseline_path, values) && !update)
+	{
+		std::cerr << "Unable to read " << baseline_path << "\n";
+
+		return 2;
+	}
+
+	// Initialize the timer
+	system_time::initialize(source);
+
+	benchmark_options options;
+	options.size = values.size;
+	options.repeat = values.repeat;
+
+	// Run the kernels in the baseline, any new ones being added to it and
+	// the reference kernels of both
+	std::vector<std::string> wanted;
+
+	for (std::size_t j = 0; j < values.entries.size(); ++j)
+	{
+		wanted.push_back(values.entries[j].name);
+		wanted.push_back(values.entries[j].reference);
+	}
+
+	if (update)
+	{
+		for (std::size_t i = 0; i < performance_test_count(); ++i)
+		{
+			const performance_test_info& info = get_performance_test(i);
+
+			if (matches_filter(info.name, filter))
+			{
+				wanted.push_back(info.name);
+				wanted.push_back(reference_kernel(info.name));
+			}
+		}
+	}
+
+	std::vector<benchmark_result> results;
+
+	for (std::size_t i = 0; i < performance_test_count(); ++i)
+	{
+		const performance_test_info& info = get_performance_test(i);
+
+		if (std::find(wanted.begin(), wanted.end(), info.name) != wanted.end())
+			results.push_back(run_benchmark(info, options));
+	}
+
+	int status = 0;
+
+	if (update)
+	{
+		baseline updated;
+		updated.size = values.size;
+		updated.repeat = values.repeat;
+
+		// Keep the reference and tolerance of existing entries. Kernels
+		// that only ran as a reference are not added.
+		for (std::size_t i = 0; i < results.size(); ++i)
+		{
+			baseline_entry entry;
+			entry.name = results[i].name;
+			entry.reference = reference_kernel(entry.name);
+			entry.tolerance = tolerance;
+
+			bool in_baseline = false;
+
+			for (std::size_t j = 0; j < values.entries.size(); ++j)
+			{
+				if (values.entries[j].name == entry.name)
+				{
+					entry.reference = values.entries[j].reference;
+					entry.tolerance = values.entries[j].tolerance;
+					in_baseline = true;
+				}
+			}
+
+			if ((entry.reference == entry.name) || (!in_baseline && !matches_filter(entry.name.c_str(), filter)))
+				continue;
+
+			entry.ratio = 0.0;
+
+			for (std::size_t j = 0; j < results.size(); ++j)
+			{
+				if ((results[j].name == entry.reference) && (best_throughput(results[j]) > 0.0))
+					entry.ratio = best_throughput(results[i]) / best_throughput(results[j]);
+			}
+
+			updated.entries.push_back(entry);
+		}
+
+		print_regressions(std::cout, compare_baseline(updated, results));
+
+		if (write_baseline(baseline_path, updated))
+		{
+			std::cout << "\nWrote " << updated.entries.size() << " kernels to " << baseline_path << "\n";
+		}
+		else
+		{
+			std::cerr << "Unable to write " << baseline_path << "\n";
+			status = 2;
+		}
+	}
+	else
+	{
+		const std::size_t failures = print_regressions(std::cout, compare_baseline(values, results));
+
+		if (failures > 0)
+		{
+			std::cout << "\n" << failures << " kernel(s) regressed\n";
+			status = 1;
+		}
+	}
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		if (!results[i].verified)
+		{
+			std::cerr << results[i].name << " computed the wrong values\n";
+			status = 1;
+		}
+	}
+
+	// Terminate the timer
+	system_time::terminate();
+
+	return status;
+}
@@ -0,0 +1,431 @@
+#ifndef REWRITE_HPP_INCLUDED
+#define REWRITE_HPP_INCLUDED
+
+#include <cstddef>
+
+//---------------------------------------------------------------------
+// Expression rewriting
+//---------------------------------------------------------------------
+
+// rewritten(expr) rebuilds the tree of an expression as a new type, so the
+// evaluation loop is only instantiated for the rewritten tree:
+//   - chains of sums are flattened and rebuilt as balanced trees, so that
+//     the terms do not wait on each other
+//   - a product or square in a sum is moved second, where it fuses into a
+//     multiply-add
+//   - zero terms and factors of one made by zeros() and ones() are dropped
+// The balanced sums round differently from the chain as written, so the
+// values can change in the last bits. Whether two operands are the same
+// array is only known at run time, so squares are written with square().
+namespace expression_template_simd
+{
+	template <typename Op>
+	struct valarray_rewrite;
+
+	template <typename Op>
+	struct valarray_is_zero
+	{
+		enum { value = 0 } ;
+	} ;
+
+	template <typename Real, typename Element>
+	struct valarray_is_zero<valarray_literal<Real, 0, Element> >
+	{
+		enum { value = 1 } ;
+	} ;
+
+	template <typename Op>
+	struct valarray_is_one
+	{
+		enum { value = 0 } ;
+	} ;
+
+	template <typename Real, typename Element>
+	struct valarray_is_one<valarray_literal<Real, 1, Element> >
+	{
+		enum { value = 1 } ;
+	} ;
+
+	// Operands a multiply-add can take as its product
+	template <typename Op>
+	struct valarray_is_product
+	{
+		enum { value = 0 } ;
+	} ;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_is_product<valarray_mul<Real, Op1, Op2> >
+	{
+		enum { value = 1 } ;
+	} ;
+
+	template <typename Real, typename Op>
+	struct valarray_is_product<valarray_square<Real, Op> >
+	{
+		enum { value = 1 } ;
+	} ;
+
+	// Builds a + b. Rule 1 drops a zero b, rule 2 a zero a, and rule 3
+	// swaps a product first so that it fuses.
+	template <typename Real, typename A, typename B,
+		int Rule = valarray_is_zero<B>::value ? 1 :
+			valarray_is_zero<A>::value ? 2 :
+			(valarray_is_product<A>::value && !valarray_is_product<B>::value) ? 3 : 0>
+	struct valarray_sum
+	{
+		typedef valarray_add<Real, A, B> type;
+
+		static INLINE type make(const A& a, const B& b)
+		{
+			return type(a, b);
+		}
+
+	} ; // end valarray_sum<Real, A, B, Rule>
+
+	template <typename Real, typename A, typename B>
+	struct valarray_sum<Real, A, B, 1>
+	{
+		typedef A type;
+
+		static INLINE typename valarray_operand<A>::type make(const A& a, const B&)
+		{
+			return a;
+		}
+
+	} ; // end valarray_sum<Real, A, B, 1>
+
+	template <typename Real, typename A, typename B>
+	struct valarray_sum<Real, A, B, 2>
+	{
+		typedef B type;
+
+		static INLINE typename valarray_operand<B>::type make(const A&, const B& b)
+		{
+			return b;
+		}
+
+	} ; // end valarray_sum<Real, A, B, 2>
+
+	template <typename Real, typename A, typename B>
+	struct valarray_sum<Real, A, B, 3>
+	{
+		typedef valarray_add<Real, B, A> type;
+
+		static INLINE type make(const A& a, const B& b)
+		{
+			return type(b, a);
+		}
+
+	} ; // end valarray_sum<Real, A, B, 3>
+
+	// Builds a * b. Rule 1 drops a b of one and rule 2 an a of one.
+	template <typename Real, typename A, typename B,
+		int Rule = valarray_is_one<B>::value ? 1 : valarray_is_one<A>::value ? 2 : 0>
+	struct valarray_product
+	{
+		typedef valarray_mul<Real, A, B> type;
+
+		static INLINE type make(const A& a, const B& b)
+		{
+			return type(a, b);
+		}
+
+	} ; // end valarray_product<Real, A, B, Rule>
+
+	template <typename Real, typename A, typename B>
+	struct valarray_product<Real, A, B, 1>
+	{
+		typedef A type;
+
+		static INLINE typename valarray_operand<A>::type make(const A& a, const B&)
+		{
+			return a;
+		}
+
+	} ; // end valarray_product<Real, A, B, 1>
+
+	template <typename Real, typename A, typename B>
+	struct valarray_product<Real, A, B, 2>
+	{
+		typedef B type;
+
+		static INLINE typename valarray_operand<B>::type make(const A&, const B& b)
+		{
+			return b;
+		}
+
+	} ; // end valarray_product<Real, A, B, 2>
+
+	// The two operands of a sum, whichever form of valarray_add holds them
+	template <typename Node>
+	struct valarray_add_operands;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_add_operands<valarray_add<Real, Op1, Op2> >
+	{
+		static INLINE typename valarray_operand<Op1>::type first(const valarray_add<Real, Op1, Op2>& node)
+		{
+			return node._op1;
+		}
+
+		static INLINE typename valarray_operand<Op2>::type second(const valarray_add<Real, Op1, Op2>& node)
+		{
+			return node._op2;
+		}
+
+	} ; // end valarray_add_operands<valarray_add<Real, Op1, Op2> >
+
+	template <typename Real, typename Op1, typename Op2, typename Op3>
+	struct valarray_add_operands<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+	{
+		typedef valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > node_type;
+
+		static INLINE typename valarray_operand<Op1>::type first(const node_type& node)
+		{
+			return node._op1;
+		}
+
+		static INLINE const valarray_mul<Real, Op2, Op3> second(const node_type& node)
+		{
+			return valarray_mul<Real, Op2, Op3>(node._op2, node._op3);
+		}
+
+	} ; // end valarray_add_operands<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_add_operands<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+	{
+		typedef valarray_add<Real, Op1, valarray_square<Real, Op2> > node_type;
+
+		static INLINE typename valarray_operand<Op1>::type first(const node_type& node)
+		{
+			return node._op1;
+		}
+
+		static INLINE const valarray_square<Real, Op2> second(const node_type& node)
+		{
+			return valarray_square<Real, Op2>(node._op2);
+		}
+
+	} ; // end valarray_add_operands<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+
+	// Number of terms in a chain of sums
+	template <typename Op>
+	struct valarray_sum_terms
+	{
+		enum { count = 1 } ;
+	} ;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_sum_terms<valarray_add<Real, Op1, Op2> >
+	{
+		enum { count = valarray_sum_terms<Op1>::count + valarray_sum_terms<Op2>::count } ;
+	} ;
+
+	// Term Index of a chain of sums, counted from the left
+	template <typename Op, std::size_t Index>
+	struct valarray_sum_term
+	{
+		typedef Op type;
+
+		static INLINE typename valarray_operand<Op>::type get(const Op& op)
+		{
+			return op;
+		}
+
+	} ; // end valarray_sum_term<Op, Index>
+
+	template <typename Node, std::size_t Index, bool First>
+	struct valarray_sum_term_select;
+
+	template <typename Real, typename Op1, typename Op2, std::size_t Index>
+	struct valarray_sum_term<valarray_add<Real, Op1, Op2>, Index>
+		: valarray_sum_term_select<valarray_add<Real, Op1, Op2>, Index, (Index < (std::size_t)valarray_sum_terms<Op1>::count)>
+	{ } ;
+
+	template <typename Real, typename Op1, typename Op2, std::size_t Index>
+	struct valarray_sum_term_select<valarray_add<Real, Op1, Op2>, Index, true>
+	{
+		typedef valarray_sum_term<Op1, Index> term;
+		typedef typename term::type type;
+
+		static INLINE typename valarray_operand<type>::type get(const valarray_add<Real, Op1, Op2>& node)
+		{
+			return term::get(valarray_add_operands<valarray_add<Real, Op1, Op2> >::first(node));
+		}
+
+	} ; // end valarray_sum_term_select<valarray_add<Real, Op1, Op2>, Index, true>
+
+	template <typename Real, typename Op1, typename Op2, std::size_t Index>
+	struct valarray_sum_term_select<valarray_add<Real, Op1, Op2>, Index, false>
+	{
+		typedef valarray_sum_term<Op2, Index - valarray_sum_terms<Op1>::count> term;
+		typedef typename term::type type;
+
+		static INLINE typename valarray_operand<type>::type get(const valarray_add<Real, Op1, Op2>& node)
+		{
+			return term::get(valarray_add_operands<valarray_add<Real, Op1, Op2> >::second(node));
+		}
+
+	} ; // end valarray_sum_term_select<valarray_add<Real, Op1, Op2>, Index, false>
+
+	// Sums Count terms of a chain from Begin by halves, each term rewritten
+	template <typename Real, typename Node, std::size_t Begin, std::size_t Count>
+	struct valarray_balanced_sum
+	{
+		typedef valarray_balanced_sum<Real, Node, Begin, Count / 2> left;
+		typedef valarray_balanced_sum<Real, Node, Begin + Count / 2, Count - Count / 2> right;
+		typedef valarray_sum<Real, typename left::type, typename right::type> sum;
+		typedef typename sum::type type;
+
+		static INLINE typename valarray_operand<type>::type apply(const Node& node)
+		{
+			return sum::make(left::apply(node), right::apply(node));
+		}
+
+	} ; // end valarray_balanced_sum<Real, Node, Begin, Count>
+
+	template <typename Real, typename Node, std::size_t Begin>
+	struct valarray_balanced_sum<Real, Node, Begin, 1>
+	{
+		typedef valarray_sum_term<Node, Begin> term;
+		typedef valarray_rewrite<typename term::type> rewrite;
+		typedef typename rewrite::type type;
+
+		static INLINE typename valarray_operand<type>::type apply(const Node& node)
+		{
+			return rewrite::apply(term::get(node));
+		}
+
+	} ; // end valarray_balanced_sum<Real, Node, Begin, 1>
+
+	// Leaves, and nodes without rules, are kept as they are
+	template <typename Op>
+	struct valarray_rewrite
+	{
+		typedef Op type;
+
+		static INLINE typename valarray_operand<Op>::type apply(const Op& op)
+		{
+			return op;
+		}
+
+	} ; // end valarray_rewrite<Op>
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_rewrite<valarray_add<Real, Op1, Op2> >
+		: valarray_balanced_sum<Real, valarray_add<Real, Op1, Op2>, 0, valarray_sum_terms<valarray_add<Real, Op1, Op2> >::count>
+	{ } ;
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_rewrite<valarray_mul<Real, Op1, Op2> >
+	{
+		typedef valarray_rewrite<Op1> first;
+		typedef valarray_rewrite<Op2> second;
+		typedef valarray_product<Real, typename first::type, typename second::type> product;
+		typedef typename product::type type;
+
+		static INLINE typename valarray_operand<type>::type apply(const valarray_mul<Real, Op1, Op2>& node)
+		{
+			return product::make(first::apply(node._op1), second::apply(node._op2));
+		}
+
+	} ; // end valarray_rewrite<valarray_mul<Real, Op1, Op2> >
+
+	template <typename Real, typename Op>
+	struct valarray_rewrite<valarray_sqrt<Real, Op> >
+	{
+		typedef valarray_rewrite<Op> operand;
+		typedef valarray_sqrt<Real, typename operand::type> type;
+
+		static INLINE type apply(const valarray_sqrt<Real, Op>& node)
+		{
+			return type(operand::apply(node._op));
+		}
+
+	} ; // end valarray_rewrite<valarray_sqrt<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct valarray_rewrite<valarray_square<Real, Op> >
+	{
+		typedef valarray_rewrite<Op> operand;
+		typedef valarray_square<Real, typename operand::type> type;
+
+		static INLINE type apply(const valarray_square<Real, Op>& node)
+		{
+			return type(operand::apply(node._op));
+		}
+
+	} ; // end valarray_rewrite<valarray_square<Real, Op> >
+
+	// Root of a rewritten tree. It always is a node, so a valarray of it is
+	// cheap to copy even when the rewritten tree is a single array.
+	template <typename Real, typename Op>
+	struct valarray_rewritten
+	{
+		typedef typename valarray_rewrite<Op>::type node_type;
+
+		typedef Real value_type;
+		typedef typename node_type::element_type element_type;
+
+		INLINE valarray_rewritten(const Op& op)
+			: _node(valarray_rewrite<Op>::apply(op))
+		{ }
+
+		INLINE element_type operator() (std::size_t i) const
+		{
+			return _node(i);
+		}
+
+		INLINE std::size_t size() const
+		{
+			return _node.size();
+		}
+
+		INLINE std::size_t elements() const
+		{
+			return _node.elements();
+		}
+
+		typename valarray_operand<node_type>::type _node;
+
+	} ; // end valarray_rewritten<Real, Op>
+
+	template <typename Real, typename Op>
+	struct valarray_operand<valarray_rewritten<Real, Op> >
+	{
+		typedef const valarray_rewritten<Real, Op> type;
+
+	} ; // end valarray_operand<valarray_rewritten<Real, Op> >
+
+	template <typename Real, typename Op>
+	INLINE valarray<Real, valarray_rewritten<Real, Op> > rewritten(const valarray<Real, Op>& value)
+	{
+		return valarray<Real, valarray_rewritten<Real, Op> >(valarray_rewritten<Real, Op>(value.rep()));
+	}
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	// Reports the tree that is evaluated rather than the one written
+	template <typename Real, typename Op>
+	struct expression_signature<expression_template_simd::valarray_rewritten<Real, Op> >
+	{
+		typedef typename expression_template_simd::valarray_rewritten<Real, Op>::node_type node_type;
+
+		enum { bytes_per_value = expression_signature<node_type>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			expression_signature<node_type>::append(signature);
+		}
+
+	} ; // end struct expression_signature<valarray_rewritten<Real, Op> >
+}
+
+#endif
+
+#endif // end REWRITE_HPP_INCLUDED
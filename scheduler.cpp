@@ -0,0 +1,280 @@
+#include "scheduler.hpp"
+#include <map>
+
+namespace
+{
+	task_scheduler* volatile __default_scheduler = 0;
+
+	typedef std::map<const void*, const task_group*> in_flight_map;
+
+	threading::mutex __in_flight_lock;
+	in_flight_map __in_flight;
+
+	// Entries in the map, readable without the lock
+	volatile std::size_t __in_flight_count = 0;
+}
+
+task_scheduler::task_scheduler(std::size_t count)
+	: _count((count > 0) ? count : threading::hardware_concurrency())
+	, _queued(0)
+	, _next(0)
+	, _sleeping(0)
+	, _exit(false)
+{
+	for (std::size_t i = 0; i <= _count; ++i)
+		_queues.push_back(new worker_queue);
+
+	// Filled before any thread starts so the entries never move
+	_starts.resize(_count);
+
+	for (std::size_t i = 0; i < _count; ++i)
+	{
+		_starts[i].scheduler = this;
+		_starts[i].index = i;
+
+		threading::thread* worker = new threading::thread();
+		worker->start(&task_scheduler::worker_entry, &_starts[i]);
+
+		_threads.push_back(worker);
+	}
+}
+
+task_scheduler::~task_scheduler()
+{
+	{
+		threading::scoped_lock lock(_lock);
+
+		_exit = true;
+		_wake.notify_all();
+	}
+
+	for (std::size_t i = 0; i < _threads.size(); ++i)
+		delete _threads[i];
+
+	for (std::size_t i = 0; i < _queues.size(); ++i)
+	{
+		for (std::size_t j = 0; j < _queues[i]->tasks.size(); ++j)
+			delete _queues[i]->tasks[j];
+
+		delete _queues[i];
+	}
+}
+
+task_scheduler& task_scheduler::get_default()
+{
+	if (!__default_scheduler)
+	{
+		// Threads racing to create it keep the first one installed
+		task_scheduler* scheduler = new task_scheduler();
+
+		if (threading::compare_exchange((void* volatile*)&__default_scheduler, scheduler, 0) != 0)
+			delete scheduler;
+	}
+
+	return *__default_scheduler;
+}
+
+void task_scheduler::submit(scheduler_task* task)
+{
+	threading::fetch_add(&task->group()._pending, 1);
+
+	push(task, threading::fetch_add(&_next, 1) % _count);
+}
+
+void task_scheduler::spawn(scheduler_task* task, std::size_t worker)
+{
+	threading::fetch_add(&task->group()._pending, 1);
+
+	push(task, worker);
+}
+
+void task_scheduler::wait(task_group& group)
+{
+	while (!group.finished())
+	{
+		scheduler_task* task = take(_count);
+
+		if (task)
+		{
+			execute(task, _count);
+			continue;
+		}
+
+		// Nothing left to steal, the rest of the group is running on the
+		// workers
+		threading::scoped_lock lock(_lock);
+
+		threading::fetch_add(&_sleeping, 1);
+
+		while ((_queued == 0) && !group.finished())
+			_wake.wait(_lock);
+
+		threading::fetch_add(&_sleeping, (std::size_t)-1);
+	}
+}
+
+void task_scheduler::worker_entry(void* context)
+{
+	const worker_start* start = (const worker_start*)context;
+
+	start->scheduler->worker(start->index);
+}
+
+void task_scheduler::worker(std::size_t index)
+{
+	for (;;)
+	{
+		scheduler_task* task = take(index);
+
+		if (task)
+		{
+			execute(task, index);
+			continue;
+		}
+
+		threading::scoped_lock lock(_lock);
+
+		threading::fetch_add(&_sleeping, 1);
+
+		while ((_queued == 0) && !_exit)
+			_wake.wait(_lock);
+
+		threading::fetch_add(&_sleeping, (std::size_t)-1);
+
+		if (_exit)
+			return;
+	}
+}
+
+void task_scheduler::push(scheduler_task* task, std::size_t queue)
+{
+	{
+		threading::scoped_lock lock(_queues[queue]->lock);
+
+		_queues[queue]->tasks.push_back(task);
+	}
+
+	threading::fetch_add(&_queued, 1);
+
+	wake_sleepers();
+}
+
+scheduler_task* task_scheduler::take(std::size_t queue)
+{
+	const std::size_t queues = _queues.size();
+
+	for (std::size_t i = 0; i < queues; ++i)
+	{
+		worker_queue& victim = *_queues[(queue + i) % queues];
+		scheduler_task* task = 0;
+
+		{
+			threading::scoped_lock lock(victim.lock);
+
+			if (victim.tasks.empty())
+				continue;
+
+			if (i == 0)
+			{
+				task = victim.tasks.back();
+				victim.tasks.pop_back();
+			}
+			else
+			{
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+			}
+		}
+
+		threading::fetch_add(&_queued, (std::size_t)-1);
+
+		return task;
+	}
+
+	return 0;
+}
+
+void task_scheduler::execute(scheduler_task* task, std::size_t queue)
+{
+	task_group& group = task->group();
+
+	task->run(*this, queue);
+
+	delete task;
+
+	// Wake the threads waiting on the group once its last task is done
+	if (threading::fetch_add(&group._pending, (std::size_t)-1) == 1)
+		wake_sleepers();
+}
+
+void task_scheduler::wake_sleepers()
+{
+	// A thread that counted itself before the check either saw the change
+	// or holds the lock until it waits, so the notify cannot be lost
+	if (threading::load_acquire(&_sleeping) == 0)
+		return;
+
+	threading::scoped_lock lock(_lock);
+
+	_wake.notify_all();
+}
+
+//---------------------------------------------------------------------
+// In flight destinations
+//---------------------------------------------------------------------
+
+bool mark_in_flight(const void* dest, const task_group& group)
+{
+	threading::scoped_lock lock(__in_flight_lock);
+
+	in_flight_map::iterator entry = __in_flight.find(dest);
+
+	if (entry == __in_flight.end())
+	{
+		__in_flight[dest] = &group;
+		threading::fetch_add(&__in_flight_count, 1);
+
+		return true;
+	}
+
+	if (!entry->second->finished())
+		return false;
+
+	entry->second = &group;
+
+	return true;
+}
+
+void clear_in_flight(const void* dest, const task_group& group)
+{
+	threading::scoped_lock lock(__in_flight_lock);
+
+	in_flight_map::iterator entry = __in_flight.find(dest);
+
+	// The destination may already belong to a later evaluation
+	if ((entry != __in_flight.end()) && (entry->second == &group))
+	{
+		__in_flight.erase(entry);
+		threading::fetch_add(&__in_flight_count, (std::size_t)-1);
+	}
+}
+
+bool is_in_flight(const void* dest)
+{
+	threading::scoped_lock lock(__in_flight_lock);
+
+	in_flight_map::const_iterator entry = __in_flight.find(dest);
+
+	return (entry != __in_flight.end()) && !entry->second->finished();
+}
+
+void wait_in_flight(const void* dest)
+{
+	if (threading::load_acquire(&__in_flight_count) == 0)
+		return;
+
+	// The group of an entry is only freed after the entry is cleared, so it
+	// is only looked at under the lock
+	while (is_in_flight(dest))
+		threading::yield();
+}
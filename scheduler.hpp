@@ -0,0 +1,164 @@
+#ifndef SCHEDULER_HPP_INCLUDED
+#define SCHEDULER_HPP_INCLUDED
+
+#include "threading.hpp"
+#include <deque>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Work-stealing task scheduler
+//---------------------------------------------------------------------
+
+class task_scheduler;
+
+// Counts the tasks of one batch that have not finished yet
+class task_group
+{
+	public:
+
+		task_group()
+			: _pending(0)
+		{ }
+
+		bool finished() const
+		{
+			return _pending == 0;
+		}
+
+	private:
+
+		friend class task_scheduler;
+
+		task_group(const task_group&);
+		task_group& operator= (const task_group&);
+
+		volatile std::size_t _pending;
+
+} ; // end class task_group
+
+// Unit of work run by the scheduler, deleted once it has run
+class scheduler_task
+{
+	public:
+
+		explicit scheduler_task(task_group& group)
+			: _group(&group)
+		{ }
+
+		virtual ~scheduler_task()
+		{ }
+
+		// Worker is the index of the queue the task is running from, tasks
+		// spawned from here should be pushed onto it
+		virtual void run(task_scheduler& scheduler, std::size_t worker) = 0;
+
+		task_group& group() const
+		{
+			return *_group;
+		}
+
+	private:
+
+		task_group* _group;
+
+} ; // end class scheduler_task
+
+// Each worker owns a deque, taking its newest task from the back while
+// idle workers steal the oldest tasks from the front of the others. Threads
+// that are not workers submit onto the worker deques in turn, and help run
+// tasks while they wait for a group to finish.
+class task_scheduler
+{
+	public:
+
+		// Zero starts a worker for every logical processor
+		explicit task_scheduler(std::size_t count = 0);
+
+		// Tasks that have not run are dropped
+		~task_scheduler();
+
+		// Scheduler shared by the library, started on first use with a
+		// worker for every logical processor and never destroyed
+		static task_scheduler& get_default();
+
+		std::size_t size() const
+		{
+			return _count;
+		}
+
+		// Queues a task from outside the scheduler
+		void submit(scheduler_task* task);
+
+		// Queues a task from inside a running task
+		void spawn(scheduler_task* task, std::size_t worker);
+
+		// Runs tasks until every task of the group has finished
+		void wait(task_group& group);
+
+	private:
+
+		task_scheduler(const task_scheduler&);
+		task_scheduler& operator= (const task_scheduler&);
+
+		struct worker_queue
+		{
+			threading::mutex lock;
+			std::deque<scheduler_task*> tasks;
+		} ;
+
+		struct worker_start
+		{
+			task_scheduler* scheduler;
+			std::size_t index;
+		} ;
+
+		static void worker_entry(void* context);
+
+		void worker(std::size_t index);
+
+		void push(scheduler_task* task, std::size_t queue);
+
+		// Pops from the back of the given queue, otherwise steals from the
+		// front of another
+		scheduler_task* take(std::size_t queue);
+
+		void execute(scheduler_task* task, std::size_t queue);
+
+		// Wakes the sleeping threads, taking the lock only if there are any.
+		// Callers publish their change with an atomic first, and sleepers
+		// count themselves atomically before checking it, so one of the two
+		// always sees the other.
+		void wake_sleepers();
+
+		std::size_t _count;
+
+		// One queue per worker, the last is shared by outside threads
+		std::vector<worker_queue*> _queues;
+		std::vector<worker_start> _starts;
+		std::vector<threading::thread*> _threads;
+
+		volatile std::size_t _queued;
+		volatile std::size_t _next;
+
+		threading::mutex _lock;
+		threading::condition _wake;
+		volatile std::size_t _sleeping;
+		bool _exit;
+
+} ; // end class task_scheduler
+
+// Destinations of unfinished asynchronous evaluations. A destination is
+// in flight from the time it is marked until its group has finished, and
+// stays registered until the group clears it. Marking fails if the
+// destination is already in flight.
+bool mark_in_flight(const void* dest, const task_group& group);
+
+void clear_in_flight(const void* dest, const task_group& group);
+
+bool is_in_flight(const void* dest);
+
+// Returns once dest is no longer in flight. Yields to the evaluating
+// threads in the meantime. Takes no lock while nothing is registered.
+void wait_in_flight(const void* dest);
+
+#endif // end SCHEDULER_HPP_INCLUDED
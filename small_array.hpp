@@ -0,0 +1,173 @@
+#ifndef SMALL_ARRAY_HPP_INCLUDED
+#define SMALL_ARRAY_HPP_INCLUDED
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <cassert>
+#include <cstddef>
+
+namespace expression_template_simd
+{
+	// Runtime sized storage that keeps up to Capacity values in an inline
+	// buffer and only goes to the aligned heap for larger arrays.
+	template <typename Real, std::size_t Capacity = 256, typename Element = void>
+	class valarray_rep_small
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename default_element<Element>::type element_type;
+
+			enum
+			{
+				lanes = sizeof(element_type) / sizeof(value_type),
+				inline_elements = (Capacity / lanes) + ((Capacity % lanes == 0) ? 0 : 1)
+			} ;
+
+			INLINE valarray_rep_small(std::size_t size)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = allocate();
+			}
+
+			INLINE valarray_rep_small(std::size_t size, value_type value)
+				: _size(size)
+				, _elements((size / element_size()) + ((size % element_size() == 0) ? 0 : 1))
+			{
+				_values = allocate();
+
+				value_type* values = reinterpret_cast<value_type*>(_values);
+
+				for (std::size_t i = 0, count = _elements * lanes; i < count; ++i)
+					values[i] = value;
+			}
+
+			INLINE ~valarray_rep_small()
+			{
+				if (!is_inline())
+					_mm_free(_values);
+			}
+
+			INLINE valarray_rep_small(const valarray_rep_small& copy)
+				: _size(copy._size)
+				, _elements(copy._elements)
+			{
+				_values = allocate();
+
+				swap(copy);
+			}
+
+			INLINE valarray_rep_small& operator= (const valarray_rep_small& copy)
+			{
+				swap(copy);
+
+				return *this;
+			}
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				assert(i < _elements);
+
+				return _values[i];
+			}
+
+			INLINE element_type& operator() (std::size_t i)
+			{
+				assert(i < _elements);
+
+				return _values[i];
+			}
+
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				assert(i < _size);
+
+				return reinterpret_cast<const value_type*>(_values)[i];
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _size;
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _elements;
+			}
+
+			INLINE const element_type* data() const
+			{
+				return _values;
+			}
+
+			INLINE element_type* data()
+			{
+				return _values;
+			}
+
+			INLINE bool is_inline() const
+			{
+				return _values == _buffer;
+			}
+
+			INLINE static std::size_t alignment()
+			{
+				return sizeof(element_type);
+			}
+
+			INLINE static std::size_t element_size()
+			{
+				return lanes;
+			}
+
+			INLINE void swap(const valarray_rep_small& copy)
+			{
+				assert(_size == copy._size);
+
+				for (std::size_t i = 0; i < _elements; ++i)
+					_values[i] = copy._values[i];
+			}
+
+		private:
+
+			INLINE element_type* allocate()
+			{
+				if (_elements <= inline_elements)
+					return _buffer;
+
+				return (element_type*)_mm_malloc(_elements * sizeof(element_type), alignment());
+			}
+
+			std::size_t _size;
+			std::size_t _elements;
+			element_type* _values;
+			element_type _buffer[inline_elements];
+
+	} ; // end class valarray_rep_small<Real, Capacity, Element>
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, std::size_t Capacity, typename Element>
+	struct expression_signature<expression_template_simd::valarray_rep_small<Real, Capacity, Element> >
+	{
+		enum { bytes_per_value = sizeof(Real) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "small<";
+			append_number(signature, Capacity);
+			signature += ">";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_small<Real, Capacity, Element> >
+}
+
+#endif
+
+#endif // end SMALL_ARRAY_HPP_INCLUDED
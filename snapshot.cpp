@@ -0,0 +1,92 @@
+#include "config.hpp"
+#include "snapshot.hpp"
+
+namespace
+{
+	// State of one reader thread, only written by that thread. Records are
+	// never freed so the list can be walked without locking.
+	struct reader_record
+	{
+		// Epoch the thread is pinned at, zero when it is not reading
+		volatile std::size_t epoch;
+		std::size_t depth;
+		reader_record* next;
+	} ;
+
+	reader_record* volatile __readers = 0;
+	THREAD_LOCAL reader_record* __reader = 0;
+
+	// Starts at one so that zero can mean not pinned
+	volatile std::size_t __epoch = 1;
+
+	reader_record* get_reader_record()
+	{
+		if (!__reader)
+		{
+			reader_record* reader = new reader_record;
+			reader->epoch = 0;
+			reader->depth = 0;
+
+			// Push onto the list of all readers without locking
+			void* head;
+
+			do
+			{
+				head = __readers;
+				reader->next = (reader_record*)head;
+			} while (threading::compare_exchange((void* volatile*)&__readers, reader, head) != head);
+
+			__reader = reader;
+		}
+
+		return __reader;
+	}
+}
+
+void epoch::enter()
+{
+	reader_record* reader = get_reader_record();
+
+	if (reader->depth++ > 0)
+		return;
+
+	reader->epoch = __epoch;
+
+	// The pin must be visible before the shared pointer is read. A writer
+	// that misses it has already swapped the pointer, so the reader gets
+	// the new data.
+	threading::memory_fence();
+}
+
+void epoch::leave()
+{
+	reader_record* reader = __reader;
+
+	if (--reader->depth > 0)
+		return;
+
+	// Finish every read of the shared data before unpinning
+	threading::memory_fence();
+
+	reader->epoch = 0;
+}
+
+std::size_t epoch::advance()
+{
+	return threading::fetch_add(&__epoch, 1) + 1;
+}
+
+bool epoch::is_quiescent(std::size_t retired)
+{
+	threading::memory_fence();
+
+	for (reader_record* reader = __readers; reader; reader = reader->next)
+	{
+		const std::size_t pinned = reader->epoch;
+
+		if ((pinned != 0) && (pinned < retired))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,197 @@
+#ifndef SNAPSHOT_HPP_INCLUDED
+#define SNAPSHOT_HPP_INCLUDED
+
+#include "threading.hpp"
+#include <cstddef>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Epoch based reclamation
+//---------------------------------------------------------------------
+
+// Readers pin the current epoch while they use shared data. Data replaced
+// by a writer is retired at the epoch that follows the replacement, and can
+// be freed once no reader is still pinned at an earlier epoch. Readers
+// never take a lock or wait for a writer.
+namespace epoch
+{
+	// Pins the calling thread, reads may be nested
+	void enter();
+
+	void leave();
+
+	// Moves to the next epoch and returns it. Call after replacing the data
+	// to be retired, the result is the epoch it is retired at.
+	std::size_t advance();
+
+	// True when no reader is pinned at an epoch earlier than the given one
+	bool is_quiescent(std::size_t retired);
+}
+
+namespace expression_template_simd
+{
+	// Array that many threads read while one thread at a time replaces its
+	// contents. The writer evaluates into a back buffer and publishes it
+	// with a single pointer swap, so readers see either the old or the new
+	// values in full and never wait on the evaluation. Old buffers are kept
+	// until no reader can still hold them, then reused as back buffers.
+	template <typename Real, typename Rep = valarray_rep_sse<Real> >
+	class snapshot_valarray
+	{
+		public:
+
+			typedef valarray<Real, Rep> array_type;
+
+			// Pins the version that was current when the guard was made. A
+			// pinned version holds back reclamation of every buffer retired
+			// after it, so guards should be short lived.
+			class read_guard
+			{
+				public:
+
+					explicit read_guard(const snapshot_valarray& snapshot)
+					{
+						epoch::enter();
+
+						_array = (const array_type*)snapshot._current;
+					}
+
+					~read_guard()
+					{
+						epoch::leave();
+					}
+
+					const array_type& operator* () const
+					{
+						return *_array;
+					}
+
+					const array_type* operator-> () const
+					{
+						return _array;
+					}
+
+				private:
+
+					read_guard(const read_guard&);
+					read_guard& operator= (const read_guard&);
+
+					const array_type* _array;
+
+			} ; // end class read_guard
+
+			snapshot_valarray(std::size_t size, Real value = Real(0))
+				: _size(size)
+				, _current(new array_type(size, value))
+				, _version(0)
+			{ }
+
+			// No reader may be using the array
+			~snapshot_valarray()
+			{
+				delete (array_type*)_current;
+
+				for (std::size_t i = 0; i < _retired.size(); ++i)
+					delete _retired[i].buffer;
+
+				for (std::size_t i = 0; i < _spare.size(); ++i)
+					delete _spare[i];
+			}
+
+			// Evaluates src into a back buffer and makes it the current
+			// version. Publishers are serialized, readers are never blocked.
+			template <typename Rep2>
+			void publish(const valarray<Real, Rep2>& src)
+			{
+				threading::scoped_lock lock(_writer);
+
+				reclaim();
+
+				array_type* back;
+
+				if (_spare.empty())
+				{
+					back = new array_type(_size);
+				}
+				else
+				{
+					back = _spare.back();
+					_spare.pop_back();
+				}
+
+				*back = src;
+
+				// The swap is a full barrier, so the values are visible
+				// before the pointer to them
+				array_type* old = (array_type*)_current;
+				threading::compare_exchange((void* volatile*)&_current, back, old);
+
+				threading::fetch_add(&_version, 1);
+
+				retired_buffer retired;
+				retired.buffer = old;
+				retired.epoch = epoch::advance();
+
+				_retired.push_back(retired);
+
+				reclaim();
+			}
+
+			// The current version, for the publishing thread to build the
+			// next one from. Other threads read through a read_guard.
+			const array_type& latest() const
+			{
+				return *(const array_type*)_current;
+			}
+
+			// Number of versions published so far
+			std::size_t version() const
+			{
+				return _version;
+			}
+
+			std::size_t size() const
+			{
+				return _size;
+			}
+
+		private:
+
+			snapshot_valarray(const snapshot_valarray&);
+			snapshot_valarray& operator= (const snapshot_valarray&);
+
+			struct retired_buffer
+			{
+				array_type* buffer;
+				std::size_t epoch;
+			} ;
+
+			// Moves the buffers no reader can hold to the spares
+			void reclaim()
+			{
+				std::size_t kept = 0;
+
+				for (std::size_t i = 0; i < _retired.size(); ++i)
+				{
+					if (epoch::is_quiescent(_retired[i].epoch))
+						_spare.push_back(_retired[i].buffer);
+					else
+						_retired[kept++] = _retired[i];
+				}
+
+				_retired.resize(kept);
+			}
+
+			std::size_t _size;
+			array_type* volatile _current;
+			volatile std::size_t _version;
+
+			threading::mutex _writer;
+			std::vector<retired_buffer> _retired;
+			std::vector<array_type*> _spare;
+
+	} ; // end class snapshot_valarray<Real, Rep>
+
+} // end namespace expression_template_simd
+
+#endif // end SNAPSHOT_HPP_INCLUDED
@@ -23,6 +23,16 @@ namespace expression_template_simd
 		return _mm_mul_ps(lhs, rhs);
 	}
 
+	INLINE __m128 sub(const __m128& lhs, const __m128& rhs)
+	{
+		return _mm_sub_ps(lhs, rhs);
+	}
+
+	INLINE __m128 div(const __m128& lhs, const __m128& rhs)
+	{
+		return _mm_div_ps(lhs, rhs);
+	}
+
 	INLINE __m128 madd(const __m128& a, const __m128& b, const __m128& c)
 	{
 		return _mm_add_ps(a, _mm_mul_ps(b, c));
@@ -33,13 +43,33 @@ namespace expression_template_simd
 		return _mm_mul_ps(v, _mm_rsqrt_ps(v));
 	}
 
+	// Store that bypasses the cache, the address must be aligned
+	INLINE void stream(__m128* address, const __m128& value)
+	{
+		_mm_stream_ps((float*)address, value);
+	}
+
+	// Writes the lanes in order, the address need not be aligned
+	INLINE void store(float* address, const __m128& value)
+	{
+		_mm_storeu_ps(address, value);
+	}
+
 	INLINE float get(const __m128& value, std::size_t i)
 	{
-	#ifdef _WIN32
-		return value.m128_f32[i];
-	#else
-		return 0.0f;
-	#endif
+		float values[4];
+		store(values, value);
+
+		return values[i];
+	}
+
+	template <typename Element>
+	Element splat(float value);
+
+	template <>
+	INLINE __m128 splat<__m128>(float value)
+	{
+		return _mm_set1_ps(value);
 	}
 
 	template <>
@@ -78,7 +108,7 @@ namespace expression_template_simd
 				: _size(copy._size)
 				, _elements(copy._elements)
 			{
-				 _values = (element_type*)_mm_malloc(_elements, alignment());
+				 _values = (element_type*)_mm_malloc(_elements * sizeof(element_type), alignment());
 
 				 swap(copy);
 			}
@@ -104,6 +134,16 @@ namespace expression_template_simd
 				return _values[i];
 			}
 
+			INLINE const element_type* data() const
+			{
+				return _values;
+			}
+
+			INLINE element_type* data()
+			{
+				return _values;
+			}
+
 			INLINE float operator[] (std::size_t i) const
 			{
 				assert(i < _size);
@@ -152,4 +192,23 @@ namespace expression_template_simd
 
 } // end namespace expression_template_simd
 
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real>
+	struct expression_signature<expression_template_simd::valarray_rep_sse<Real> >
+	{
+		enum { bytes_per_value = sizeof(Real) } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "sse";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_sse<Real> >
+}
+
+#endif
+
 #endif // end SSE_ARRAY_HPP_INCLUDED
@@ -0,0 +1,221 @@
+#include "stream.hpp"
+#include <algorithm>
+
+namespace
+{
+	template <int Operation>
+	class stream_kernel : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				_size = size;
+
+				// Setup the arrays
+				a = new float[size];
+				b = new float[size];
+				c = new float[size];
+
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					a[i] = 1.0f;
+					b[i] = 2.0f;
+					c[i] = 0.0f;
+				}
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(float), begin, end);
+
+				const float scalar = 3.0f;
+
+				switch (Operation)
+				{
+					case stream_copy:
+						for (std::size_t i = begin; i < end; ++i)
+							c[i] = a[i];
+						break;
+
+					case stream_scale:
+						for (std::size_t i = begin; i < end; ++i)
+							b[i] = scalar * c[i];
+						break;
+
+					case stream_add:
+						for (std::size_t i = begin; i < end; ++i)
+							c[i] = a[i] + b[i];
+						break;
+
+					case stream_triad:
+						for (std::size_t i = begin; i < end; ++i)
+							a[i] = b[i] + scalar * c[i];
+						break;
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete[] a;
+				delete[] b;
+				delete[] c;
+			}
+
+		private:
+
+			std::size_t _size;
+
+			float* a;
+			float* b;
+			float* c;
+
+	} ; // end class stream_kernel<Operation>
+
+#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_NEON)
+	// The widest register of the build, __m256 when AVX is enabled
+	typedef expression_template_simd::fixed_element_type peak_element;
+
+	using expression_template_simd::madd;
+	using expression_template_simd::splat;
+#else
+	typedef float peak_element;
+
+	INLINE float madd(float a, float b, float c)
+	{
+		return a + b * c;
+	}
+
+	template <typename Element>
+	INLINE Element splat(float value)
+	{
+		return value;
+	}
+#endif
+
+	// Independent multiply-add chains on registers, enough of them to cover
+	// the latency of a multiply followed by an add while the chains and the
+	// two constants still fit in the register file. Each thread runs its
+	// share of the passes on its own chains.
+	class peak_flops : public performance_test
+	{
+		public:
+
+			enum { chains = 8 } ;
+
+			void setup(std::size_t size)
+			{
+				_size = size;
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, 1, begin, end);
+
+				const peak_element scale = splat<peak_element>(0.999f);
+				const peak_element offset = splat<peak_element>(0.001f);
+
+				peak_element accumulators[chains];
+
+				for (int j = 0; j < chains; ++j)
+					accumulators[j] = splat<peak_element>((float)j);
+
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					for (int j = 0; j < chains; ++j)
+						accumulators[j] = madd(offset, accumulators[j], scale);
+				}
+
+				// Keep the chains live
+				for (int j = 1; j < chains; ++j)
+					accumulators[0] = madd(accumulators[0], accumulators[j], scale);
+
+				volatile float result = *reinterpret_cast<const float*>(&accumulators[0]);
+				(void)result;
+			}
+
+			void teardown()
+			{ }
+
+		private:
+
+			std::size_t _size;
+
+	} ; // end class peak_flops
+
+	const performance_test_info stream_infos[stream_operation_count] =
+	{
+		// Bytes are counted as STREAM does, without write allocation
+		{ "stream/copy",  &create_performance_test<stream_kernel<stream_copy> >,  2 * sizeof(float), 0 },
+		{ "stream/scale", &create_performance_test<stream_kernel<stream_scale> >, 2 * sizeof(float), 1 },
+		{ "stream/add",   &create_performance_test<stream_kernel<stream_add> >,   3 * sizeof(float), 1 },
+		{ "stream/triad", &create_performance_test<stream_kernel<stream_triad> >, 3 * sizeof(float), 2 }
+	};
+
+	// One element is a pass over every chain
+	const performance_test_info peak_flops_info =
+	{
+		"peak/madd",
+		&create_performance_test<peak_flops>,
+		0,
+		2.0 * peak_flops::chains * (sizeof(peak_element) / sizeof(float))
+	};
+}
+
+const performance_test_info& stream_info(stream_operation operation)
+{
+	return stream_infos[operation];
+}
+
+machine_peak measure_machine_peak(const benchmark_options& options)
+{
+	// STREAM asks for each array to be at least four times the caches
+	const system_info::cache_sizes caches = system_info::get_cache_sizes();
+	const std::size_t cache_values = (caches.l1 + caches.l2 + caches.l3) / sizeof(float);
+
+	benchmark_options stream_options;
+	stream_options.size = std::max<std::size_t>(4 * cache_values, 1 << 22);
+	stream_options.repeat = 10;
+	stream_options.warmup = 2;
+	stream_options.threads = options.threads;
+
+	machine_peak peak;
+
+	for (int i = 0; i < stream_operation_count; ++i)
+		peak.bandwidth[i] = run_benchmark(stream_infos[i], stream_options).gigabytes_per_second;
+
+	peak.gigabytes_per_second = *std::max_element(peak.bandwidth, peak.bandwidth + stream_operation_count);
+
+	benchmark_options flops_options;
+	flops_options.size = 1 << 20;
+	flops_options.repeat = 10;
+	flops_options.warmup = 2;
+	flops_options.threads = options.threads;
+
+	peak.gigaflops = run_benchmark(peak_flops_info, flops_options).gigaflops;
+
+	return peak;
+}
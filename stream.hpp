@@ -0,0 +1,34 @@
+#ifndef STREAM_HPP_INCLUDED
+#define STREAM_HPP_INCLUDED
+
+#include "benchmark.hpp"
+
+//---------------------------------------------------------------------
+// STREAM bandwidth reference
+//---------------------------------------------------------------------
+
+// The four kernels from McCalpin's STREAM benchmark
+//   copy   c[i] = a[i]
+//   scale  b[i] = s * c[i]
+//   add    c[i] = a[i] + b[i]
+//   triad  a[i] = b[i] + s * c[i]
+// They are not registered with the other kernels, they are run alongside
+// them to give the sustainable memory bandwidth.
+enum stream_operation
+{
+	stream_copy,
+	stream_scale,
+	stream_add,
+	stream_triad,
+	stream_operation_count
+} ;
+
+const performance_test_info& stream_info(stream_operation operation);
+
+// Measures the STREAM kernels on arrays well beyond the last level cache,
+// and the multiply-add rate of the widest enabled SIMD type on values held
+// in registers, both on the thread count of options. Nothing else in
+// options is used.
+machine_peak measure_machine_peak(const benchmark_options& options);
+
+#endif // end STREAM_HPP_INCLUDED
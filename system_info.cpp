@@ -0,0 +1,162 @@
+#include "system_info.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <vector>
+#elif __MACH__
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#include <unistd.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if !defined(_WIN32) && !defined(__MACH__)
+	// Reads one of the cache attributes exposed in sysfs
+	bool read_cache_attribute(int index, const char* attribute, char* value, int length)
+	{
+		char path[128];
+		std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/%s", index, attribute);
+
+		std::FILE* file = std::fopen(path, "r");
+
+		if (!file)
+			return false;
+
+		const bool read = (std::fgets(value, length, file) != 0);
+
+		std::fclose(file);
+
+		return read;
+	}
+
+	// Parses a size such as "32K"
+	std::size_t parse_cache_size(const char* value)
+	{
+		char* unit = 0;
+		std::size_t size = std::strtoul(value, &unit, 10);
+
+		if ((*unit == 'K') || (*unit == 'k'))
+			size *= 1024;
+		else if ((*unit == 'M') || (*unit == 'm'))
+			size *= 1024 * 1024;
+
+		return size;
+	}
+#endif
+}
+
+system_info::cache_sizes system_info::get_cache_sizes()
+{
+	cache_sizes caches;
+	caches.l1 = 0;
+	caches.l2 = 0;
+	caches.l3 = 0;
+
+#ifdef _WIN32
+	DWORD length = 0;
+	GetLogicalProcessorInformation(0, &length);
+
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+
+	if (!info.empty() && GetLogicalProcessorInformation(&info[0], &length))
+	{
+		for (std::size_t i = 0; i < info.size(); ++i)
+		{
+			if (info[i].Relationship != RelationCache)
+				continue;
+
+			const CACHE_DESCRIPTOR& cache = info[i].Cache;
+
+			if ((cache.Type != CacheData) && (cache.Type != CacheUnified))
+				continue;
+
+			if (cache.Level == 1)
+				caches.l1 = cache.Size;
+			else if (cache.Level == 2)
+				caches.l2 = cache.Size;
+			else if (cache.Level == 3)
+				caches.l3 = cache.Size;
+		}
+	}
+#elif __MACH__
+	uint64_t size = 0;
+	size_t length = sizeof(size);
+
+	if (sysctlbyname("hw.l1dcachesize", &size, &length, 0, 0) == 0)
+		caches.l1 = (std::size_t)size;
+	if (sysctlbyname("hw.l2cachesize", &size, &length, 0, 0) == 0)
+		caches.l2 = (std::size_t)size;
+	if (sysctlbyname("hw.l3cachesize", &size, &length, 0, 0) == 0)
+		caches.l3 = (std::size_t)size;
+#else
+	char type[32];
+	char level_value[32];
+	char size_value[32];
+
+	for (int index = 0; read_cache_attribute(index, "type", type, sizeof(type)); ++index)
+	{
+		if (std::strncmp(type, "Instruction", 11) == 0)
+			continue;
+
+		if (!read_cache_attribute(index, "level", level_value, sizeof(level_value)) ||
+		    !read_cache_attribute(index, "size", size_value, sizeof(size_value)))
+			continue;
+
+		const int level = std::atoi(level_value);
+		const std::size_t size = parse_cache_size(size_value);
+
+		if (level == 1)
+			caches.l1 = size;
+		else if (level == 2)
+			caches.l2 = size;
+		else if (level == 3)
+			caches.l3 = size;
+	}
+#endif
+
+	return caches;
+}
+
+uint64_t system_info::get_physical_memory()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+
+	return GlobalMemoryStatusEx(&status) ? (uint64_t)status.ullTotalPhys : 0;
+#elif __MACH__
+	uint64_t memory = 0;
+	size_t length = sizeof(memory);
+
+	return (sysctlbyname("hw.memsize", &memory, &length, 0, 0) == 0) ? memory : 0;
+#else
+	const long pages = sysconf(_SC_PHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGE_SIZE);
+
+	return ((pages > 0) && (page_size > 0)) ? (uint64_t)pages * (uint64_t)page_size : 0;
+#endif
+}
+
+std::string system_info::get_host_name()
+{
+	char name[256];
+
+#ifdef _WIN32
+	DWORD length = sizeof(name);
+
+	return GetComputerNameA(name, &length) ? std::string(name, length) : std::string();
+#else
+	if (gethostname(name, sizeof(name)) != 0)
+		return std::string();
+
+	name[sizeof(name) - 1] = '\0';
+
+	return name;
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef SYSTEM_INFO_HPP_INCLUDED
+#define SYSTEM_INFO_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+namespace system_info
+{
+	// Data cache sizes in bytes, zero when a level is not present or could
+	// not be determined
+	struct cache_sizes
+	{
+		std::size_t l1;
+		std::size_t l2;
+		std::size_t l3;
+
+	} ; // end struct cache_sizes
+
+	cache_sizes get_cache_sizes();
+
+	uint64_t get_physical_memory();
+
+	// Name of the machine, empty if it could not be determined
+	std::string get_host_name();
+}
+
+#endif // end SYSTEM_INFO_HPP_INCLUDED
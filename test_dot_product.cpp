@@ -1,484 +1,1485 @@
 #include "performance_test.hpp"
+#include <cmath>
+#include <new>
+#include <vector>
+
+namespace
+{
+	// Eight arrays read and one written per value, seven flops per value
+	const double bytes_per_element = 9 * sizeof(float);
+	const double flops_per_element = 7;
 
 //---------------------------------------------------------------------
 // valarray implementations
 //---------------------------------------------------------------------
 
-double time_naive_array(std::size_t size)
-{
-	using namespace naive_implementation;
-
-	// Setup the arrays
-	valarray<float> v1x(size, 1.0f);
-	valarray<float> v1y(size, 2.0f);
-	valarray<float> v1z(size, 3.0f);
-	valarray<float> v1w(size, 4.0f);
+	template <typename Array>
+	class dot_product_valarray : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				// Setup the arrays
+				v1x = new Array(size, 1.0f);
+				v1y = new Array(size, 2.0f);
+				v1z = new Array(size, 3.0f);
+				v1w = new Array(size, 4.0f);
+
+				v2x = new Array(size, 5.0f);
+				v2y = new Array(size, 6.0f);
+				v2z = new Array(size, 7.0f);
+				v2w = new Array(size, 8.0f);
+
+				dot_products = new Array(size);
+			}
+
+			void run()
+			{
+				// Compute the dot product
+				*dot_products =
+					*v1x * *v2x +
+					*v1y * *v2y +
+					*v1z * *v2z +
+					*v1w * *v2w;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete dot_products;
+
+				delete v1x;
+				delete v1y;
+				delete v1z;
+				delete v1w;
+
+				delete v2x;
+				delete v2y;
+				delete v2z;
+				delete v2w;
+			}
+
+		protected:
+
+			Array* v1x;
+			Array* v1y;
+			Array* v1z;
+			Array* v1w;
+
+			Array* v2x;
+			Array* v2y;
+			Array* v2z;
+			Array* v2w;
+
+			Array* dot_products;
+
+	} ; // end class dot_product_valarray<Array>
+
+	// Expression template arrays can evaluate a sub range of the expression,
+	// which lets the work be split between threads
+	template <typename Array>
+	class dot_product_valarray_partitioned : public dot_product_valarray<Array>
+	{
+		public:
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(this->dot_products->elements(), index, count, cache_line_size / sizeof(typename Array::element_type), begin, end);
+
+				this->dot_products->assign(
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w,
+					begin, end);
+			}
+
+	} ; // end class dot_product_valarray_partitioned<Array>
+
+	// Sums the dot products instead of storing them, in either reduction
+	// order, so the cost of a deterministic sum can be compared
+	template <typename Array, expression_template_simd::reduction_mode Mode>
+	class dot_product_valarray_sum : public dot_product_valarray<Array>
+	{
+		public:
 
-	valarray<float> v2x(size, 5.0f);
-	valarray<float> v2y(size, 6.0f);
-	valarray<float> v2z(size, 7.0f);
-	valarray<float> v2w(size, 8.0f);
+			void run()
+			{
+				total = expression_template_simd::sum(
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w,
+					Mode);
+			}
 
-	valarray<float> dot_products(size);
+			float total;
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+	} ; // end class dot_product_valarray_sum<Array, Mode>
 
-	// Compute the dot product
-	dot_products =
-		v1x * v2x +
-		v1y * v2y +
-		v1z * v2z +
-		v1w * v2w;
+	// One dot product feeding three outputs, recomputed by each of them
+	template <typename Array>
+	class dot_product_valarray_shared : public dot_product_valarray<Array>
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				dot_product_valarray<Array>::setup(size);
+
+				squares = new Array(size);
+				lengths = new Array(size);
+			}
+
+			void run()
+			{
+				*this->dot_products =
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w;
+
+				*squares = square(
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w);
+
+				*lengths = sqrt(
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w);
+			}
+
+			void teardown()
+			{
+				delete squares;
+				delete lengths;
+
+				dot_product_valarray<Array>::teardown();
+			}
+
+		protected:
+
+			Array* squares;
+			Array* lengths;
+
+	} ; // end class dot_product_valarray_shared<Array>
+
+	// The same outputs reading the dot product as a shared intermediate
+	template <typename Rep>
+	class dot_product_valarray_memo : public dot_product_valarray_shared<expression_template_simd::valarray<float, Rep> >
+	{
+		public:
 
-	// Stop the timer
-	clock.stop();
+			void setup(std::size_t size)
+			{
+				dot_product_valarray_shared<expression_template_simd::valarray<float, Rep> >::setup(size);
 
-	return clock.elapsed_time();
-}
+				graph = new expression_template_simd::memo_graph<float, Rep>();
 
-double time_expr_template_float(std::size_t size)
-{
-	using namespace expression_template;
+				add_outputs(graph->intermediate(
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w));
+			}
 
-	// Setup the arrays
-	valarray<float> v1x(size, 1.0f);
-	valarray<float> v1y(size, 2.0f);
-	valarray<float> v1z(size, 3.0f);
-	valarray<float> v1w(size, 4.0f);
+			void run()
+			{
+				graph->run();
+			}
 
-	valarray<float> v2x(size, 5.0f);
-	valarray<float> v2y(size, 6.0f);
-	valarray<float> v2z(size, 7.0f);
-	valarray<float> v2w(size, 8.0f);
+			void teardown()
+			{
+				delete graph;
 
-	valarray<float> dot_products(size);
+				dot_product_valarray_shared<expression_template_simd::valarray<float, Rep> >::teardown();
+			}
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+		protected:
 
-	// Compute the dot product
-	dot_products =
-		v1x * v2x +
-		v1y * v2y +
-		v1z * v2z +
-		v1w * v2w;
+			expression_template_simd::memo_graph<float, Rep>* graph;
 
-	// Stop the timer
-	clock.stop();
+		private:
 
-	return clock.elapsed_time();
-}
+			template <typename Memo>
+			void add_outputs(const expression_template_simd::valarray<float, Memo>& dot)
+			{
+				graph->output(*this->dot_products, dot);
+				graph->output(*this->squares, square(dot));
+				graph->output(*this->lengths, sqrt(dot));
+			}
 
-#ifdef USE_SSE
+	} ; // end class dot_product_valarray_memo<Rep>
 
-double time_expr_template_sse(std::size_t size)
-{
-	using namespace expression_template_simd;
-	typedef valarray<float> valarray_float;
+	// The memo outputs plus a copy of a plain array. The source is written
+	// after the output is added, so the copy must read it when the graph
+	// runs rather than when the output was added.
+	template <typename Rep>
+	class dot_product_valarray_memo_copy : public dot_product_valarray_memo<Rep>
+	{
+		public:
 
-	// Setup the arrays
-	valarray_float v1x(size, 1.0f);
-	valarray_float v1y(size, 2.0f);
-	valarray_float v1z(size, 3.0f);
-	valarray_float v1w(size, 4.0f);
+			typedef expression_template_simd::valarray<float, Rep> array_type;
 
-	valarray_float v2x(size, 5.0f);
-	valarray_float v2y(size, 6.0f);
-	valarray_float v2z(size, 7.0f);
-	valarray_float v2w(size, 8.0f);
+			void setup(std::size_t size)
+			{
+				dot_product_valarray_memo<Rep>::setup(size);
 
-	valarray_float dot_products(size);
+				sources = new array_type(size, 0.0f);
+				copies = new array_type(size);
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+				this->graph->output(*copies, *sources);
 
-	// Compute the dot product
-	dot_products =
-		v1x * v2x +
-		v1y * v2y +
-		v1z * v2z +
-		v1w * v2w;
+				*sources = *this->v1x + *this->v2x;
+			}
 
-	// Stop the timer
-	clock.stop();
+			bool verify()
+			{
+				const float length = std::sqrt(70.0f);
 
-	return clock.elapsed_time();
-}
+				for (std::size_t i = 0; i < this->dot_products->size(); ++i)
+				{
+					if (((*this->dot_products)[i] != 70.0f) || ((*this->squares)[i] != 4900.0f) || ((*copies)[i] != 6.0f))
+						return false;
 
-#else
+					if (std::fabs((*this->lengths)[i] - length) > 1e-3f * length)
+						return false;
+				}
 
-double time_expr_template_sse(std::size_t) { return 0.0; }
+				return true;
+			}
 
-#endif
+			void teardown()
+			{
+				delete sources;
+				delete copies;
 
-#ifdef USE_AVX
+				dot_product_valarray_memo<Rep>::teardown();
+			}
 
-double time_expr_template_avx(std::size_t size)
-{
-	using namespace expression_template_simd;
-	typedef valarray<float, valarray_rep_avx<float> > valarray_float;
+		private:
 
-	// Setup the arrays
-	valarray_float v1x(size, 1.0f);
-	valarray_float v1y(size, 2.0f);
-	valarray_float v1z(size, 3.0f);
-	valarray_float v1w(size, 4.0f);
+			array_type* sources;
+			array_type* copies;
 
-	valarray_float v2x(size, 5.0f);
-	valarray_float v2y(size, 6.0f);
-	valarray_float v2z(size, 7.0f);
-	valarray_float v2w(size, 8.0f);
+	} ; // end class dot_product_valarray_memo_copy<Rep>
 
-	valarray_float dot_products(size);
+#ifdef USE_SSE
+	// Int8 inputs and an int8 destination quantized on store. The results
+	// are near 70, so the destination covers a range without 0, and every
+	// value must come back within one step of the exact result.
+	template <typename Rep>
+	class dot_product_valarray_quantized : public dot_product_valarray_partitioned<expression_template_simd::valarray<float, Rep> >
+	{
+		public:
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+			void setup(std::size_t size)
+			{
+				dot_product_valarray_partitioned<expression_template_simd::valarray<float, Rep> >::setup(size);
 
-	// Compute the dot product
-	dot_products =
-		v1x * v2x +
-		v1y * v2y +
-		v1z * v2z +
-		v1w * v2w;
+				delete this->dot_products;
+				this->dot_products = new expression_template_simd::valarray<float, Rep>(Rep::from_range(size, 60.0f, 80.0f));
+			}
 
-	// Stop the timer
-	clock.stop();
+			bool verify()
+			{
+				const float step = this->dot_products->rep().scale();
 
-	return clock.elapsed_time();
-}
+				for (std::size_t i = 0; i < this->dot_products->size(); ++i)
+				{
+					if (std::fabs((*this->dot_products)[i] - 70.0f) > step)
+						return false;
+				}
 
-#else
+				return true;
+			}
 
-double time_expr_template_avx(std::size_t) { return 0.0; }
+	} ; // end class dot_product_valarray_quantized<Rep>
 
+	// The second vector is computed from the index by generators instead of
+	// being read from memory. The generators make the register type of the
+	// build, which is the SSE one when USE_SSE is defined.
+	template <typename Array>
+	class dot_product_valarray_generated : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				_size = size;
+
+				// Setup the arrays
+				v1x = new Array(size, 1.0f);
+				v1y = new Array(size, 2.0f);
+				v1z = new Array(size, 3.0f);
+				v1w = new Array(size, 4.0f);
+
+				dot_products = new Array(size);
+			}
+
+			void run()
+			{
+				// Compute the dot product
+				*dot_products =
+					*v1x * expression_template_simd::constant(_size, 5.0f) +
+					*v1y * expression_template_simd::iota(_size) +
+					*v1z * expression_template_simd::linspace(_size, 0.0f, 1.0f) +
+					*v1w * expression_template_simd::random_uniform(_size, 1);
+			}
+
+			// Checks every element against the generated values one at a
+			// time, which go through operator[] instead of operator()
+			bool verify()
+			{
+				const expression_template_simd::valarray<float, expression_template_simd::valarray_ramp<float> > ramp = expression_template_simd::iota(_size);
+				const expression_template_simd::valarray<float, expression_template_simd::valarray_ramp<float> > line = expression_template_simd::linspace(_size, 0.0f, 1.0f);
+				const expression_template_simd::valarray<float, expression_template_simd::valarray_random<float> > noise = expression_template_simd::random_uniform(_size, 1);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					const float expected = 5.0f + 2.0f * ramp[i] + 3.0f * line[i] + 4.0f * noise[i];
+
+					if (std::fabs((*dot_products)[i] - expected) > 1e-5f * expected)
+						return false;
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete dot_products;
+
+				delete v1x;
+				delete v1y;
+				delete v1z;
+				delete v1w;
+			}
+
+		private:
+
+			std::size_t _size;
+
+			Array* v1x;
+			Array* v1y;
+			Array* v1z;
+			Array* v1w;
+
+			Array* dot_products;
+
+	} ; // end class dot_product_valarray_generated<Array>
 #endif
 
-#ifdef USE_NEON
+	// Eight arrays read per value and nothing written
+	const double sum_bytes_per_element = 8 * sizeof(float);
+	const double sum_flops_per_element = 8;
 
-double time_expr_template_neon(std::size_t size)
-{
-	using namespace expression_template_simd;
-	typedef valarray<float, valarray_rep_neon<float> > valarray_float;
+	// Eight arrays read and three written per value, with the dot product
+	// counted once
+	const double shared_bytes_per_element = 11 * sizeof(float);
+	const double shared_flops_per_element = 9;
 
-	// Setup the arrays
-	valarray_float v1x(size, 1.0f);
-	valarray_float v1y(size, 2.0f);
-	valarray_float v1z(size, 3.0f);
-	valarray_float v1w(size, 4.0f);
+	// The shared outputs plus one array read and one written per value
+	const double memo_copy_bytes_per_element = 13 * sizeof(float);
 
-	valarray_float v2x(size, 5.0f);
-	valarray_float v2y(size, 6.0f);
-	valarray_float v2z(size, 7.0f);
-	valarray_float v2w(size, 8.0f);
+	register_performance_test naive_array(
+		"dot_product/naive_array",
+		&create_performance_test<dot_product_valarray<naive_implementation::valarray<float> > >,
+		bytes_per_element, flops_per_element);
 
-	valarray_float dot_products(size);
+	register_performance_test expr_template_float(
+		"dot_product/expr_template_float",
+		&create_performance_test<dot_product_valarray_partitioned<expression_template::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+
+#ifdef USE_SSE
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+	register_performance_test expr_template_sse(
+		"dot_product/expr_template_sse",
+		&create_performance_test<dot_product_valarray_partitioned<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
 
-	// Compute the dot product
-	dot_products =
-		v1x * v2x +
-		v1y * v2y +
-		v1z * v2z +
-		v1w * v2w;
+	register_performance_test expr_template_sse_sum(
+		"dot_product/expr_template_sse_sum",
+		&create_performance_test<dot_product_valarray_sum<expression_template_simd::valarray<float>, expression_template_simd::fast_reduction> >,
+		sum_bytes_per_element, sum_flops_per_element);
 
-	// Stop the timer
-	clock.stop();
+	register_performance_test expr_template_sse_sum_ordered(
+		"dot_product/expr_template_sse_sum_ordered",
+		&create_performance_test<dot_product_valarray_sum<expression_template_simd::valarray<float>, expression_template_simd::deterministic_reduction> >,
+		sum_bytes_per_element, sum_flops_per_element);
 
-	return clock.elapsed_time();
-}
+	// Eight arrays read and one written per value, in 8 bits each
+	const double quantized_bytes_per_element = 9 * sizeof(int8_t);
 
-#else
+	register_performance_test expr_template_sse_int8(
+		"dot_product/expr_template_sse_int8",
+		&create_performance_test<dot_product_valarray_quantized<expression_template_simd::valarray_rep_quantized<float> > >,
+		quantized_bytes_per_element, flops_per_element);
 
-double time_expr_template_neon(std::size_t) { return 0.0; }
+	// Four arrays read and one written per value
+	const double generated_bytes_per_element = 5 * sizeof(float);
+
+	register_performance_test expr_template_sse_generated(
+		"dot_product/expr_template_sse_generated",
+		&create_performance_test<dot_product_valarray_generated<expression_template_simd::valarray<float> > >,
+		generated_bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_sse_shared(
+		"dot_product/expr_template_sse_shared",
+		&create_performance_test<dot_product_valarray_shared<expression_template_simd::valarray<float> > >,
+		shared_bytes_per_element, shared_flops_per_element);
+
+	register_performance_test expr_template_sse_memo(
+		"dot_product/expr_template_sse_memo",
+		&create_performance_test<dot_product_valarray_memo<expression_template_simd::valarray_rep_sse<float> > >,
+		shared_bytes_per_element, shared_flops_per_element);
+
+	register_performance_test expr_template_sse_memo_copy(
+		"dot_product/expr_template_sse_memo_copy",
+		&create_performance_test<dot_product_valarray_memo_copy<expression_template_simd::valarray_rep_sse<float> > >,
+		memo_copy_bytes_per_element, shared_flops_per_element);
 
 #endif
 
-//---------------------------------------------------------------------
-// C array implementations
-//---------------------------------------------------------------------
+#if defined(USE_SSE) && defined(USE_THREADS)
 
-double time_float_arrays(std::size_t size)
-{
-	// Setup the arrays
-	float* v1x = new float[size];
-	float* v1y = new float[size];
-	float* v1z = new float[size];
-	float* v1w = new float[size];
-
-	float* v2x = new float[size];
-	float* v2y = new float[size];
-	float* v2z = new float[size];
-	float* v2w = new float[size];
-
-	for (std::size_t i = 0; i < size; ++i)
+	// The same values split into one large dot product and many small ones,
+	// all independent, assigned one after another or submitted together as
+	// a batch on the default scheduler
+	template <typename Array, bool Batched>
+	class dot_product_valarray_batch : public performance_test
+	{
+		public:
+
+			enum { small_count = 64 } ;
+
+			void setup(std::size_t size)
+			{
+				// Half of the values go to the large assignment, the rest are
+				// shared between the small ones
+				const std::size_t small_values = size / 2;
+
+				add(size - small_values);
+
+				for (std::size_t i = 0; i < small_count; ++i)
+					add((small_values / small_count) + ((i < small_values % small_count) ? 1 : 0));
+			}
+
+			void run()
+			{
+				if (Batched)
+				{
+					expression_template_simd::expression_batch batch(task_scheduler::get_default());
+
+					for (std::size_t i = 0; i < dot_products.size(); ++i)
+					{
+						batch.assign(*dot_products[i],
+							*v1x[i] * *v2x[i] +
+							*v1y[i] * *v2y[i] +
+							*v1z[i] * *v2z[i] +
+							*v1w[i] * *v2w[i]);
+					}
+
+					batch.wait();
+				}
+				else
+				{
+					for (std::size_t i = 0; i < dot_products.size(); ++i)
+					{
+						*dot_products[i] =
+							*v1x[i] * *v2x[i] +
+							*v1y[i] * *v2y[i] +
+							*v1z[i] * *v2z[i] +
+							*v1w[i] * *v2w[i];
+					}
+				}
+			}
+
+			bool verify()
+			{
+				for (std::size_t i = 0; i < dot_products.size(); ++i)
+				{
+					for (std::size_t j = 0; j < dot_products[i]->size(); ++j)
+					{
+						if ((*dot_products[i])[j] != 70.0f)
+							return false;
+					}
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				for (std::size_t i = 0; i < dot_products.size(); ++i)
+				{
+					delete dot_products[i];
+
+					delete v1x[i];
+					delete v1y[i];
+					delete v1z[i];
+					delete v1w[i];
+
+					delete v2x[i];
+					delete v2y[i];
+					delete v2z[i];
+					delete v2w[i];
+				}
+
+				dot_products.clear();
+
+				v1x.clear();
+				v1y.clear();
+				v1z.clear();
+				v1w.clear();
+
+				v2x.clear();
+				v2y.clear();
+				v2z.clear();
+				v2w.clear();
+			}
+
+		private:
+
+			void add(std::size_t size)
+			{
+				v1x.push_back(new Array(size, 1.0f));
+				v1y.push_back(new Array(size, 2.0f));
+				v1z.push_back(new Array(size, 3.0f));
+				v1w.push_back(new Array(size, 4.0f));
+
+				v2x.push_back(new Array(size, 5.0f));
+				v2y.push_back(new Array(size, 6.0f));
+				v2z.push_back(new Array(size, 7.0f));
+				v2w.push_back(new Array(size, 8.0f));
+
+				dot_products.push_back(new Array(size));
+			}
+
+			std::vector<Array*> v1x;
+			std::vector<Array*> v1y;
+			std::vector<Array*> v1z;
+			std::vector<Array*> v1w;
+
+			std::vector<Array*> v2x;
+			std::vector<Array*> v2y;
+			std::vector<Array*> v2z;
+			std::vector<Array*> v2w;
+
+			std::vector<Array*> dot_products;
+
+	} ; // end class dot_product_valarray_batch<Array, Batched>
+
+	// The dot product evaluated on the scheduler while the calling thread
+	// computes the lengths of the first vectors
+	template <typename Array>
+	class dot_product_valarray_async : public dot_product_valarray<Array>
 	{
-		v1x[i] = 1.0f;
-		v1y[i] = 2.0f;
-		v1z[i] = 3.0f;
-		v1w[i] = 4.0f;
+		public:
 
-		v2x[i] = 5.0f;
-		v2y[i] = 6.0f;
-		v2z[i] = 7.0f;
-		v2w[i] = 8.0f;
-	}
+			void setup(std::size_t size)
+			{
+				dot_product_valarray<Array>::setup(size);
 
-	float* dot_products = new float[size];
+				lengths = new Array(size);
+				_completed = true;
+			}
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+			void run()
+			{
+				const expression_template_simd::evaluation_future future = expression_template_simd::evaluate_async(
+					*this->dot_products,
+					*this->v1x * *this->v2x +
+					*this->v1y * *this->v2y +
+					*this->v1z * *this->v2z +
+					*this->v1w * *this->v2w);
 
-	// Compute the dot product
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		dot_products[i] = 
-			v1x[i] * v2x[i] +
-			v1y[i] * v2y[i] +
-			v1z[i] * v2z[i] +
-			v1w[i] * v2w[i];
-	}
+				*lengths = sqrt(
+					*this->v1x * *this->v1x +
+					*this->v1y * *this->v1y +
+					*this->v1z * *this->v1z +
+					*this->v1w * *this->v1w);
+
+				future.wait();
 
-	// Stop the timer
-	clock.stop();
+				_completed = _completed && future.poll();
+			}
 
-	// Cleanup the arrays
-	delete[] dot_products;
+			// Every future reported completion after wait(), and both
+			// results hold
+			bool verify()
+			{
+				if (!_completed)
+					return false;
 
-	delete[] v1x;
-	delete[] v1y;
-	delete[] v1z;
-	delete[] v1w;
+				const float length = std::sqrt(30.0f);
 
-	delete[] v2x;
-	delete[] v2y;
-	delete[] v2z;
-	delete[] v2w;
+				for (std::size_t i = 0; i < lengths->size(); ++i)
+				{
+					if (((*this->dot_products)[i] != 70.0f) || (std::fabs((*lengths)[i] - length) > 1e-3f * length))
+						return false;
+				}
 
-	return clock.elapsed_time();
-}
+				return true;
+			}
+
+			void teardown()
+			{
+				delete lengths;
+
+				dot_product_valarray<Array>::teardown();
+			}
+
+		private:
+
+			Array* lengths;
+			bool _completed;
+
+	} ; // end class dot_product_valarray_async<Array>
+
+	// Eight arrays read for the dot product and four for the lengths, two
+	// written, with seven and eight flops
+	const double async_bytes_per_element = 14 * sizeof(float);
+	const double async_flops_per_element = 15;
+
+	register_performance_test expr_template_sse_sequential(
+		"dot_product/expr_template_sse_sequential",
+		&create_performance_test<dot_product_valarray_batch<expression_template_simd::valarray<float>, false> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_sse_batch(
+		"dot_product/expr_template_sse_batch",
+		&create_performance_test<dot_product_valarray_batch<expression_template_simd::valarray<float>, true> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_sse_async(
+		"dot_product/expr_template_sse_async",
+		&create_performance_test<dot_product_valarray_async<expression_template_simd::valarray<float> > >,
+		async_bytes_per_element, async_flops_per_element);
+
+#endif
+
+#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_NEON)
+
+	// Many short vectors of N values each, held inline, covering the same
+	// number of values as the other kernels
+	template <std::size_t N>
+	class dot_product_fixed_valarray : public performance_test
+	{
+		public:
+
+			typedef expression_template_simd::fixed_valarray<float, N> array_type;
+
+			void setup(std::size_t size)
+			{
+				_count = (size / N) + ((size % N == 0) ? 0 : 1);
+
+				// Setup the arrays
+				v1x = create(1.0f);
+				v1y = create(2.0f);
+				v1z = create(3.0f);
+				v1w = create(4.0f);
+
+				v2x = create(5.0f);
+				v2y = create(6.0f);
+				v2z = create(7.0f);
+				v2w = create(8.0f);
+
+				dot_products = create(0.0f);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_count, index, count, 1, begin, end);
+
+				// Compute the dot products
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					dot_products[i] =
+						v1x[i] * v2x[i] +
+						v1y[i] * v2y[i] +
+						v1z[i] * v2z[i] +
+						v1w[i] * v2w[i];
+				}
+			}
+
+			bool verify()
+			{
+				for (std::size_t i = 0; i < _count; ++i)
+				{
+					for (std::size_t j = 0; j < N; ++j)
+					{
+						if (dot_products[i][j] != 70.0f)
+							return false;
+					}
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(dot_products);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+
+				_mm_free(v2x);
+				_mm_free(v2y);
+				_mm_free(v2z);
+				_mm_free(v2w);
+			}
+
+		private:
+
+			array_type* create(float value) const
+			{
+				array_type* arrays = (array_type*)_mm_malloc(_count * sizeof(array_type), sizeof(typename array_type::element_type));
+
+				for (std::size_t i = 0; i < _count; ++i)
+					new (&arrays[i]) array_type(value);
+
+				return arrays;
+			}
+
+			std::size_t _count;
+
+			array_type* v1x;
+			array_type* v1y;
+			array_type* v1z;
+			array_type* v1w;
+
+			array_type* v2x;
+			array_type* v2y;
+			array_type* v2z;
+			array_type* v2w;
+
+			array_type* dot_products;
+
+	} ; // end class dot_product_fixed_valarray<N>
+
+	register_performance_test expr_template_fixed_4(
+		"dot_product/expr_template_fixed_4",
+		&create_performance_test<dot_product_fixed_valarray<4> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_fixed_8(
+		"dot_product/expr_template_fixed_8",
+		&create_performance_test<dot_product_fixed_valarray<8> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_fixed_16(
+		"dot_product/expr_template_fixed_16",
+		&create_performance_test<dot_product_fixed_valarray<16> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_fixed_32(
+		"dot_product/expr_template_fixed_32",
+		&create_performance_test<dot_product_fixed_valarray<32> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_fixed_64(
+		"dot_product/expr_template_fixed_64",
+		&create_performance_test<dot_product_fixed_valarray<64> >,
+		bytes_per_element, flops_per_element);
+
+#endif
 
 #ifdef USE_SSE
 
-double time_sse_arrays(std::size_t elements)
-{
-	const std::size_t size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
-	const std::size_t alignment  = sizeof(__m128);
-	const std::size_t array_size = alignment * size;
-
-	// Setup the arrays
-	__m128* v1x = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v1y = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v1z = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v1w = (__m128*)_mm_malloc(array_size, alignment);
-
-	__m128* v2x = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v2y = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v2z = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v2w = (__m128*)_mm_malloc(array_size, alignment);
-	
-	for (std::size_t i = 0; i < size; ++i)
+	// Many short runtime sized vectors of Length values each, covering the
+	// same number of values as the other kernels. The small rep keeps the
+	// values inline while Length fits its capacity. Its inline buffer is
+	// only as aligned as new makes it, which covers SSE registers.
+	template <typename Array, std::size_t Length>
+	class dot_product_short_valarray : public performance_test
 	{
-		v1x[i] = _mm_set1_ps(1.0f);
-		v1y[i] = _mm_set1_ps(2.0f);
-		v1z[i] = _mm_set1_ps(3.0f);
-		v1w[i] = _mm_set1_ps(4.0f);
-
-		v2x[i] = _mm_set1_ps(5.0f);
-		v2y[i] = _mm_set1_ps(6.0f);
-		v2z[i] = _mm_set1_ps(7.0f);
-		v2w[i] = _mm_set1_ps(8.0f);
-	}
-	
-	__m128* dot_products = (__m128*)_mm_malloc(array_size, alignment);
-
-	// Begin the timer
-	timer clock;
-	clock.start();
-
-	// Compute the dot product
-	for (std::size_t i = 0; i < size; ++i)
+		public:
+
+			void setup(std::size_t size)
+			{
+				const std::size_t count = (size / Length) + ((size % Length == 0) ? 0 : 1);
+
+				// Setup the arrays
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					v1x.push_back(new Array(Length, 1.0f));
+					v1y.push_back(new Array(Length, 2.0f));
+					v1z.push_back(new Array(Length, 3.0f));
+					v1w.push_back(new Array(Length, 4.0f));
+
+					v2x.push_back(new Array(Length, 5.0f));
+					v2y.push_back(new Array(Length, 6.0f));
+					v2z.push_back(new Array(Length, 7.0f));
+					v2w.push_back(new Array(Length, 8.0f));
+
+					dot_products.push_back(new Array(Length));
+				}
+			}
+
+			void run()
+			{
+				// Compute the dot products
+				for (std::size_t i = 0; i < dot_products.size(); ++i)
+				{
+					*dot_products[i] =
+						*v1x[i] * *v2x[i] +
+						*v1y[i] * *v2y[i] +
+						*v1z[i] * *v2z[i] +
+						*v1w[i] * *v2w[i];
+				}
+			}
+
+			bool verify()
+			{
+				for (std::size_t i = 0; i < dot_products.size(); ++i)
+				{
+					for (std::size_t j = 0; j < Length; ++j)
+					{
+						if ((*dot_products[i])[j] != 70.0f)
+							return false;
+					}
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				for (std::size_t i = 0; i < dot_products.size(); ++i)
+				{
+					delete dot_products[i];
+
+					delete v1x[i];
+					delete v1y[i];
+					delete v1z[i];
+					delete v1w[i];
+
+					delete v2x[i];
+					delete v2y[i];
+					delete v2z[i];
+					delete v2w[i];
+				}
+
+				dot_products.clear();
+
+				v1x.clear();
+				v1y.clear();
+				v1z.clear();
+				v1w.clear();
+
+				v2x.clear();
+				v2y.clear();
+				v2z.clear();
+				v2w.clear();
+			}
+
+		protected:
+
+			std::vector<Array*> v1x;
+			std::vector<Array*> v1y;
+			std::vector<Array*> v1z;
+			std::vector<Array*> v1w;
+
+			std::vector<Array*> v2x;
+			std::vector<Array*> v2y;
+			std::vector<Array*> v2z;
+			std::vector<Array*> v2w;
+
+			std::vector<Array*> dot_products;
+
+	} ; // end class dot_product_short_valarray<Array, Length>
+
+	// The same dot products summed from two halves held in temporaries
+	// that are constructed on every run, so the cost of allocating short
+	// arrays is part of the timing
+	template <typename Array, std::size_t Length>
+	class dot_product_short_temporaries : public dot_product_short_valarray<Array, Length>
 	{
-		dot_products[i] = 
-			_mm_add_ps(
-				_mm_add_ps(_mm_mul_ps(v1x[i], v2x[i]), _mm_mul_ps(v1y[i], v2y[i])),
-				_mm_add_ps(_mm_mul_ps(v1z[i], v2z[i]), _mm_mul_ps(v1w[i], v2w[i])));
-	}
+		public:
 
-	// Stop the timer
-	clock.stop();
+			void run()
+			{
+				for (std::size_t i = 0; i < this->dot_products.size(); ++i)
+				{
+					Array first(Length);
+					Array second(Length);
 
-	// Cleanup the arrays
-	_mm_free(dot_products);
+					first = *this->v1x[i] * *this->v2x[i] + *this->v1y[i] * *this->v2y[i];
+					second = *this->v1z[i] * *this->v2z[i] + *this->v1w[i] * *this->v2w[i];
 
-	_mm_free(v1x);
-	_mm_free(v1y);
-	_mm_free(v1z);
-	_mm_free(v1w);
+					*this->dot_products[i] = first + second;
+				}
+			}
 
-	_mm_free(v2x);
-	_mm_free(v2y);
-	_mm_free(v2z);
-	_mm_free(v2w);
+	} ; // end class dot_product_short_temporaries<Array, Length>
 
-	return clock.elapsed_time();
-}
+	// Inline capacity for 64 values, so 1024 value arrays spill to the heap
+	typedef expression_template_simd::valarray<float, expression_template_simd::valarray_rep_small<float, 64> > small_valarray_float;
 
-#else
+	register_performance_test expr_template_heap_64(
+		"dot_product/expr_template_heap_64",
+		&create_performance_test<dot_product_short_valarray<expression_template_simd::valarray<float>, 64> >,
+		bytes_per_element, flops_per_element);
 
-double time_sse_arrays(std::size_t) { return 0.0; }
+	register_performance_test expr_template_small_inline_64(
+		"dot_product/expr_template_small_inline_64",
+		&create_performance_test<dot_product_short_valarray<small_valarray_float, 64> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_small_spilled_1024(
+		"dot_product/expr_template_small_spilled_1024",
+		&create_performance_test<dot_product_short_valarray<small_valarray_float, 1024> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_heap_temporaries_64(
+		"dot_product/expr_template_heap_temporaries_64",
+		&create_performance_test<dot_product_short_temporaries<expression_template_simd::valarray<float>, 64> >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_small_temporaries_64(
+		"dot_product/expr_template_small_temporaries_64",
+		&create_performance_test<dot_product_short_temporaries<small_valarray_float, 64> >,
+		bytes_per_element, flops_per_element);
 
 #endif
 
 #ifdef USE_AVX
 
-double time_avx_arrays(std::size_t elements)
-{
-	const std::size_t size = (elements / 8) + ((elements % 8 == 0) ? 0 : 1);
-	const std::size_t alignment  = sizeof(__m256);
-	const std::size_t array_size = alignment * size;
-
-	// Setup the arrays
-	__m256* v1x = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v1y = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v1z = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v1w = (__m256*)_mm_malloc(array_size, alignment);
-
-	__m256* v2x = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v2y = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v2z = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v2w = (__m256*)_mm_malloc(array_size, alignment);
-	
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		v1x[i] = _mm256_set1_ps(1.0f);
-		v1y[i] = _mm256_set1_ps(2.0f);
-		v1z[i] = _mm256_set1_ps(3.0f);
-		v1w[i] = _mm256_set1_ps(4.0f);
-
-		v2x[i] = _mm256_set1_ps(5.0f);
-		v2y[i] = _mm256_set1_ps(6.0f);
-		v2z[i] = _mm256_set1_ps(7.0f);
-		v2w[i] = _mm256_set1_ps(8.0f);
-	}
-	
-	__m256* dot_products = (__m256*)_mm_malloc(array_size, alignment);
-
-	// Begin the timer
-	timer clock;
-	clock.start();
-
-	// Compute the dot product
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		dot_products[i] = 
-			_mm256_add_ps(
-				_mm256_add_ps(_mm256_mul_ps(v1x[i], v2x[i]), _mm256_mul_ps(v1y[i], v2y[i])),
-				_mm256_add_ps(_mm256_mul_ps(v1z[i], v2z[i]), _mm256_mul_ps(v1w[i], v2w[i])));
-	}
+	register_performance_test expr_template_avx(
+		"dot_product/expr_template_avx",
+		&create_performance_test<dot_product_valarray_partitioned<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_avx_sum(
+		"dot_product/expr_template_avx_sum",
+		&create_performance_test<dot_product_valarray_sum<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> >, expression_template_simd::fast_reduction> >,
+		sum_bytes_per_element, sum_flops_per_element);
+
+	register_performance_test expr_template_avx_sum_ordered(
+		"dot_product/expr_template_avx_sum_ordered",
+		&create_performance_test<dot_product_valarray_sum<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> >, expression_template_simd::deterministic_reduction> >,
+		sum_bytes_per_element, sum_flops_per_element);
 
-	// Stop the timer
-	clock.stop();
+	register_performance_test expr_template_avx_shared(
+		"dot_product/expr_template_avx_shared",
+		&create_performance_test<dot_product_valarray_shared<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		shared_bytes_per_element, shared_flops_per_element);
 
-	// Cleanup the arrays
-	_mm_free(dot_products);
+	register_performance_test expr_template_avx_memo(
+		"dot_product/expr_template_avx_memo",
+		&create_performance_test<dot_product_valarray_memo<expression_template_simd::valarray_rep_avx<float> > >,
+		shared_bytes_per_element, shared_flops_per_element);
 
-	_mm_free(v1x);
-	_mm_free(v1y);
-	_mm_free(v1z);
-	_mm_free(v1w);
+	register_performance_test expr_template_avx_memo_copy(
+		"dot_product/expr_template_avx_memo_copy",
+		&create_performance_test<dot_product_valarray_memo_copy<expression_template_simd::valarray_rep_avx<float> > >,
+		memo_copy_bytes_per_element, shared_flops_per_element);
 
-	_mm_free(v2x);
-	_mm_free(v2y);
-	_mm_free(v2z);
-	_mm_free(v2w);
+#endif
+
+#ifdef USE_NEON
 
-	return clock.elapsed_time();
-}
+	register_performance_test expr_template_neon(
+		"dot_product/expr_template_neon",
+		&create_performance_test<dot_product_valarray_partitioned<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		bytes_per_element, flops_per_element);
 
-#else
+	register_performance_test expr_template_neon_sum(
+		"dot_product/expr_template_neon_sum",
+		&create_performance_test<dot_product_valarray_sum<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> >, expression_template_simd::fast_reduction> >,
+		sum_bytes_per_element, sum_flops_per_element);
 
-double time_avx_arrays(std::size_t) { return 0.0; }
+	register_performance_test expr_template_neon_sum_ordered(
+		"dot_product/expr_template_neon_sum_ordered",
+		&create_performance_test<dot_product_valarray_sum<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> >, expression_template_simd::deterministic_reduction> >,
+		sum_bytes_per_element, sum_flops_per_element);
+
+	register_performance_test expr_template_neon_shared(
+		"dot_product/expr_template_neon_shared",
+		&create_performance_test<dot_product_valarray_shared<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		shared_bytes_per_element, shared_flops_per_element);
+
+	register_performance_test expr_template_neon_memo(
+		"dot_product/expr_template_neon_memo",
+		&create_performance_test<dot_product_valarray_memo<expression_template_simd::valarray_rep_neon<float> > >,
+		shared_bytes_per_element, shared_flops_per_element);
+
+	register_performance_test expr_template_neon_memo_copy(
+		"dot_product/expr_template_neon_memo_copy",
+		&create_performance_test<dot_product_valarray_memo_copy<expression_template_simd::valarray_rep_neon<float> > >,
+		memo_copy_bytes_per_element, shared_flops_per_element);
 
 #endif
 
-#ifdef USE_NEON
+#ifdef USE_SSE
 
-double time_neon_arrays(std::size_t elements)
-{
-	const std::size_t size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
-	const std::size_t alignment  = sizeof(float32x4_t);
-	const std::size_t array_size = alignment * size;
-
-	// Setup the arrays
-	float32x4_t* v1x = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v1y = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v1z = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v1w = (float32x4_t*)_mm_malloc(array_size, alignment);
-
-	float32x4_t* v2x = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v2y = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v2z = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v2w = (float32x4_t*)_mm_malloc(array_size, alignment);
-	
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		v1x[i] = vdupq_n_f32(1.0f);
-		v1y[i] = vdupq_n_f32(2.0f);
-		v1z[i] = vdupq_n_f32(3.0f);
-		v1w[i] = vdupq_n_f32(4.0f);
-
-		v2x[i] = vdupq_n_f32(5.0f);
-		v2y[i] = vdupq_n_f32(6.0f);
-		v2z[i] = vdupq_n_f32(7.0f);
-		v2w[i] = vdupq_n_f32(8.0f);
-	}
-	
-	float32x4_t* dot_products = (float32x4_t*)_mm_malloc(array_size, alignment);
-
-	// Begin the timer
-	timer clock;
-	clock.start();
-
-	// Compute the dot product
-	for (std::size_t i = 0; i < size; ++i)
+	// Eight arrays read and one written per value, in 16 bits each
+	const double half_bytes_per_element = 9 * sizeof(uint16_t);
+
+#ifdef USE_F16C
+	register_performance_test expr_template_half_fp16(
+		"dot_product/expr_template_half_fp16",
+		&create_performance_test<dot_product_valarray_partitioned<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_half<float, expression_template_simd::half_fp16> > > >,
+		half_bytes_per_element, flops_per_element);
+#endif
+
+	register_performance_test expr_template_half_bf16(
+		"dot_product/expr_template_half_bf16",
+		&create_performance_test<dot_product_valarray_partitioned<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_half<float, expression_template_simd::half_bf16> > > >,
+		half_bytes_per_element, flops_per_element);
+
+#endif
+
+//---------------------------------------------------------------------
+// C array implementations
+//---------------------------------------------------------------------
+
+	class dot_product_float_arrays : public performance_test
 	{
-		dot_products[i] = 
-			vmlaq_f32(
-				vmlaq_f32(
-					vmlaq_f32(
-						vmulq_f32(v1x[i], v2x[i]), v1y[i], v2y[i]), v1z[i], v2z[i]), v1w[i], v2w[i]);
-	}
+		public:
+
+			void setup(std::size_t size)
+			{
+				_size = size;
+
+				// Setup the arrays
+				v1x = new float[size];
+				v1y = new float[size];
+				v1z = new float[size];
+				v1w = new float[size];
+
+				v2x = new float[size];
+				v2y = new float[size];
+				v2z = new float[size];
+				v2w = new float[size];
+
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					v1x[i] = 1.0f;
+					v1y[i] = 2.0f;
+					v1z[i] = 3.0f;
+					v1w[i] = 4.0f;
+
+					v2x[i] = 5.0f;
+					v2y[i] = 6.0f;
+					v2z[i] = 7.0f;
+					v2w[i] = 8.0f;
+				}
+
+				dot_products = new float[size];
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(float), begin, end);
+
+				// Compute the dot product
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					dot_products[i] =
+						v1x[i] * v2x[i] +
+						v1y[i] * v2y[i] +
+						v1z[i] * v2z[i] +
+						v1w[i] * v2w[i];
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete[] dot_products;
+
+				delete[] v1x;
+				delete[] v1y;
+				delete[] v1z;
+				delete[] v1w;
+
+				delete[] v2x;
+				delete[] v2y;
+				delete[] v2z;
+				delete[] v2w;
+			}
+
+		private:
+
+			std::size_t _size;
+
+			float* v1x;
+			float* v1y;
+			float* v1z;
+			float* v1w;
+
+			float* v2x;
+			float* v2y;
+			float* v2z;
+			float* v2w;
+
+			float* dot_products;
+
+	} ; // end class dot_product_float_arrays
+
+	register_performance_test float_arrays(
+		"dot_product/float_arrays",
+		&create_performance_test<dot_product_float_arrays>,
+		bytes_per_element, flops_per_element);
 
-	// Stop the timer
-	clock.stop();
+#ifdef USE_SSE
 
-	// Cleanup the arrays
-	_mm_free(dot_products);
+	class dot_product_sse_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
+
+				const std::size_t alignment  = sizeof(__m128);
+				const std::size_t array_size = alignment * _size;
+
+				// Setup the arrays
+				v1x = (__m128*)_mm_malloc(array_size, alignment);
+				v1y = (__m128*)_mm_malloc(array_size, alignment);
+				v1z = (__m128*)_mm_malloc(array_size, alignment);
+				v1w = (__m128*)_mm_malloc(array_size, alignment);
+
+				v2x = (__m128*)_mm_malloc(array_size, alignment);
+				v2y = (__m128*)_mm_malloc(array_size, alignment);
+				v2z = (__m128*)_mm_malloc(array_size, alignment);
+				v2w = (__m128*)_mm_malloc(array_size, alignment);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					v1x[i] = _mm_set1_ps(1.0f);
+					v1y[i] = _mm_set1_ps(2.0f);
+					v1z[i] = _mm_set1_ps(3.0f);
+					v1w[i] = _mm_set1_ps(4.0f);
+
+					v2x[i] = _mm_set1_ps(5.0f);
+					v2y[i] = _mm_set1_ps(6.0f);
+					v2z[i] = _mm_set1_ps(7.0f);
+					v2w[i] = _mm_set1_ps(8.0f);
+				}
+
+				dot_products = (__m128*)_mm_malloc(array_size, alignment);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(__m128), begin, end);
+
+				// Compute the dot product
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					dot_products[i] =
+						_mm_add_ps(
+							_mm_add_ps(_mm_mul_ps(v1x[i], v2x[i]), _mm_mul_ps(v1y[i], v2y[i])),
+							_mm_add_ps(_mm_mul_ps(v1z[i], v2z[i]), _mm_mul_ps(v1w[i], v2w[i])));
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(dot_products);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+
+				_mm_free(v2x);
+				_mm_free(v2y);
+				_mm_free(v2z);
+				_mm_free(v2w);
+			}
+
+		private:
+
+			std::size_t _size;
+
+			__m128* v1x;
+			__m128* v1y;
+			__m128* v1z;
+			__m128* v1w;
+
+			__m128* v2x;
+			__m128* v2y;
+			__m128* v2z;
+			__m128* v2w;
+
+			__m128* dot_products;
+
+	} ; // end class dot_product_sse_arrays
+
+	register_performance_test sse_arrays(
+		"dot_product/sse_arrays",
+		&create_performance_test<dot_product_sse_arrays>,
+		bytes_per_element, flops_per_element);
 
-	_mm_free(v1x);
-	_mm_free(v1y);
-	_mm_free(v1z);
-	_mm_free(v1w);
+#endif
 
-	_mm_free(v2x);
-	_mm_free(v2y);
-	_mm_free(v2z);
-	_mm_free(v2w);
+#ifdef USE_AVX
 
-	return clock.elapsed_time();
-}
+	class dot_product_avx_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_size = (elements / 8) + ((elements % 8 == 0) ? 0 : 1);
+
+				const std::size_t alignment  = sizeof(__m256);
+				const std::size_t array_size = alignment * _size;
+
+				// Setup the arrays
+				v1x = (__m256*)_mm_malloc(array_size, alignment);
+				v1y = (__m256*)_mm_malloc(array_size, alignment);
+				v1z = (__m256*)_mm_malloc(array_size, alignment);
+				v1w = (__m256*)_mm_malloc(array_size, alignment);
+
+				v2x = (__m256*)_mm_malloc(array_size, alignment);
+				v2y = (__m256*)_mm_malloc(array_size, alignment);
+				v2z = (__m256*)_mm_malloc(array_size, alignment);
+				v2w = (__m256*)_mm_malloc(array_size, alignment);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					v1x[i] = _mm256_set1_ps(1.0f);
+					v1y[i] = _mm256_set1_ps(2.0f);
+					v1z[i] = _mm256_set1_ps(3.0f);
+					v1w[i] = _mm256_set1_ps(4.0f);
+
+					v2x[i] = _mm256_set1_ps(5.0f);
+					v2y[i] = _mm256_set1_ps(6.0f);
+					v2z[i] = _mm256_set1_ps(7.0f);
+					v2w[i] = _mm256_set1_ps(8.0f);
+				}
+
+				dot_products = (__m256*)_mm_malloc(array_size, alignment);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(__m256), begin, end);
+
+				// Compute the dot product
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					dot_products[i] =
+						_mm256_add_ps(
+							_mm256_add_ps(_mm256_mul_ps(v1x[i], v2x[i]), _mm256_mul_ps(v1y[i], v2y[i])),
+							_mm256_add_ps(_mm256_mul_ps(v1z[i], v2z[i]), _mm256_mul_ps(v1w[i], v2w[i])));
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(dot_products);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+
+				_mm_free(v2x);
+				_mm_free(v2y);
+				_mm_free(v2z);
+				_mm_free(v2w);
+			}
+
+		private:
+
+			std::size_t _size;
+
+			__m256* v1x;
+			__m256* v1y;
+			__m256* v1z;
+			__m256* v1w;
+
+			__m256* v2x;
+			__m256* v2y;
+			__m256* v2z;
+			__m256* v2w;
+
+			__m256* dot_products;
+
+	} ; // end class dot_product_avx_arrays
+
+	register_performance_test avx_arrays(
+		"dot_product/avx_arrays",
+		&create_performance_test<dot_product_avx_arrays>,
+		bytes_per_element, flops_per_element);
 
-#else
+#endif
 
-double time_neon_arrays(std::size_t) { return 0.0; }
+#ifdef USE_NEON
+
+	class dot_product_neon_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
+
+				const std::size_t alignment  = sizeof(float32x4_t);
+				const std::size_t array_size = alignment * _size;
+
+				// Setup the arrays
+				v1x = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v1y = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v1z = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v1w = (float32x4_t*)_mm_malloc(array_size, alignment);
+
+				v2x = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v2y = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v2z = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v2w = (float32x4_t*)_mm_malloc(array_size, alignment);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					v1x[i] = vdupq_n_f32(1.0f);
+					v1y[i] = vdupq_n_f32(2.0f);
+					v1z[i] = vdupq_n_f32(3.0f);
+					v1w[i] = vdupq_n_f32(4.0f);
+
+					v2x[i] = vdupq_n_f32(5.0f);
+					v2y[i] = vdupq_n_f32(6.0f);
+					v2z[i] = vdupq_n_f32(7.0f);
+					v2w[i] = vdupq_n_f32(8.0f);
+				}
+
+				dot_products = (float32x4_t*)_mm_malloc(array_size, alignment);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(float32x4_t), begin, end);
+
+				// Compute the dot product
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					dot_products[i] =
+						vmlaq_f32(
+							vmlaq_f32(
+								vmlaq_f32(
+									vmulq_f32(v1x[i], v2x[i]), v1y[i], v2y[i]), v1z[i], v2z[i]), v1w[i], v2w[i]);
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(dot_products);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+
+				_mm_free(v2x);
+				_mm_free(v2y);
+				_mm_free(v2z);
+				_mm_free(v2w);
+			}
+
+		private:
+
+			std::size_t _size;
+
+			float32x4_t* v1x;
+			float32x4_t* v1y;
+			float32x4_t* v1z;
+			float32x4_t* v1w;
+
+			float32x4_t* v2x;
+			float32x4_t* v2y;
+			float32x4_t* v2z;
+			float32x4_t* v2w;
+
+			float32x4_t* dot_products;
+
+	} ; // end class dot_product_neon_arrays
+
+	register_performance_test neon_arrays(
+		"dot_product/neon_arrays",
+		&create_performance_test<dot_product_neon_arrays>,
+		bytes_per_element, flops_per_element);
 
 #endif
+
+} // end anonymous namespace
@@ -0,0 +1,418 @@
+#include "performance_test.hpp"
+#include <cmath>
+
+namespace
+{
+
+//---------------------------------------------------------------------
+// Expression shapes
+//---------------------------------------------------------------------
+
+	// Each shape is written once and evaluated over whole valarrays, over
+	// single floats inside a plain loop, and over SSE registers inside a
+	// plain loop, so the template code can be compared against the loops a
+	// compiler would see if written by hand.
+	//
+	// SHAPE(name, arrays read, flops per value, expression over a to h)
+	#define EXPRESSION_SHAPES(SHAPE) \
+		/* Depth and fan-in */ \
+		SHAPE(add_2,          2, 1, a + b) \
+		SHAPE(add_4_left,     4, 3, a + b + c + d) \
+		SHAPE(add_4_balanced, 4, 3, (a + b) + (c + d)) \
+		SHAPE(add_8_left,     8, 7, a + b + c + d + e + f + g + h) \
+		SHAPE(add_8_balanced, 8, 7, ((a + b) + (c + d)) + ((e + f) + (g + h))) \
+		SHAPE(mul_4,          4, 3, a * b * c * d) \
+		/* madd fusion, only a rhs product matches valarray_add<Op1, valarray_mul> */ \
+		SHAPE(madd_fused,     3, 2, c + a * b) \
+		SHAPE(madd_unfused,   3, 2, a * b + c) \
+		SHAPE(dot_8,          8, 7, a * b + c * d + e * f + g * h) \
+		/* Operand reuse */ \
+		SHAPE(reuse_square,   1, 1, a * a) \
+		SHAPE(reuse_4,        5, 7, a * b + a * c + a * d + a * e) \
+		SHAPE(reuse_power,    1, 7, a * a * a * a * a * a * a * a) \
+		/* Op mix */ \
+		SHAPE(length_2,       2, 4, sqrt(a * a + b * b)) \
+		SHAPE(sqrt_mix,       4, 5, sqrt(a) * b + sqrt(c) * d) \
+		SHAPE(deep_nested,    8, 9, sqrt(sqrt(a * b + c) * d + e) * f + g * h)
+
+	#define DECLARE_SHAPE(name, leaves, flops, expression) \
+		struct shape_##name \
+		{ \
+			template <typename Result, typename Value> \
+			static INLINE void evaluate(Result& out, \
+				const Value& a, const Value& b, const Value& c, const Value& d, \
+				const Value& e, const Value& f, const Value& g, const Value& h) \
+			{ \
+				using std::sqrt; \
+				(void)a; (void)b; (void)c; (void)d; \
+				(void)e; (void)f; (void)g; (void)h; \
+				out = expression; \
+			} \
+		} ;
+
+	EXPRESSION_SHAPES(DECLARE_SHAPE)
+
+	#undef DECLARE_SHAPE
+
+	// Every value of a shape over the inputs 1 to 8
+	template <typename Shape>
+	float expected_value()
+	{
+		float out;
+		Shape::evaluate(out, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f);
+
+		return out;
+	}
+
+	// The SIMD square roots are estimates good to about 12 bits, and
+	// deep_nested takes two of them in a row
+	INLINE bool matches(float value, float expected)
+	{
+		return std::fabs(value - expected) <= 5e-3f * std::fabs(expected);
+	}
+
+//---------------------------------------------------------------------
+// valarray implementations
+//---------------------------------------------------------------------
+
+	template <typename Array, typename Shape>
+	class shape_valarray : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				// Setup the arrays
+				a = new Array(size, 1.0f);
+				b = new Array(size, 2.0f);
+				c = new Array(size, 3.0f);
+				d = new Array(size, 4.0f);
+				e = new Array(size, 5.0f);
+				f = new Array(size, 6.0f);
+				g = new Array(size, 7.0f);
+				h = new Array(size, 8.0f);
+
+				result = new Array(size);
+			}
+
+			void run()
+			{
+				Shape::evaluate(*result, *a, *b, *c, *d, *e, *f, *g, *h);
+			}
+
+			bool verify()
+			{
+				const float expected = expected_value<Shape>();
+
+				for (std::size_t i = 0; i < result->size(); ++i)
+				{
+					if (!matches((*result)[i], expected))
+						return false;
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete result;
+
+				delete a;
+				delete b;
+				delete c;
+				delete d;
+				delete e;
+				delete f;
+				delete g;
+				delete h;
+			}
+
+		private:
+
+			Array* a;
+			Array* b;
+			Array* c;
+			Array* d;
+			Array* e;
+			Array* f;
+			Array* g;
+			Array* h;
+
+			Array* result;
+
+	} ; // end class shape_valarray<Array, Shape>
+
+//---------------------------------------------------------------------
+// C array implementations
+//---------------------------------------------------------------------
+
+	template <typename Shape>
+	class shape_float_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				_size = size;
+
+				// Setup the arrays
+				a = new float[size];
+				b = new float[size];
+				c = new float[size];
+				d = new float[size];
+				e = new float[size];
+				f = new float[size];
+				g = new float[size];
+				h = new float[size];
+
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					a[i] = 1.0f;
+					b[i] = 2.0f;
+					c[i] = 3.0f;
+					d[i] = 4.0f;
+					e[i] = 5.0f;
+					f[i] = 6.0f;
+					g[i] = 7.0f;
+					h[i] = 8.0f;
+				}
+
+				result = new float[size];
+			}
+
+			void run()
+			{
+				for (std::size_t i = 0; i < _size; ++i)
+					Shape::evaluate(result[i], a[i], b[i], c[i], d[i], e[i], f[i], g[i], h[i]);
+			}
+
+			bool verify()
+			{
+				const float expected = expected_value<Shape>();
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					if (!matches(result[i], expected))
+						return false;
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete[] result;
+
+				delete[] a;
+				delete[] b;
+				delete[] c;
+				delete[] d;
+				delete[] e;
+				delete[] f;
+				delete[] g;
+				delete[] h;
+			}
+
+		private:
+
+			std::size_t _size;
+
+			float* a;
+			float* b;
+			float* c;
+			float* d;
+			float* e;
+			float* f;
+			float* g;
+			float* h;
+
+			float* result;
+
+	} ; // end class shape_float_arrays<Shape>
+
+#ifdef USE_SSE
+
+	// One SSE register with the operations the shapes use, each a single
+	// intrinsic as in a loop written by hand. The square root is the same
+	// estimate the SSE valarray uses, so both compute the same values.
+	struct sse_value
+	{
+		__m128 value;
+
+	} ; // end struct sse_value
+
+	INLINE sse_value operator+ (const sse_value& a, const sse_value& b)
+	{
+		const sse_value result = { _mm_add_ps(a.value, b.value) };
+
+		return result;
+	}
+
+	INLINE sse_value operator* (const sse_value& a, const sse_value& b)
+	{
+		const sse_value result = { _mm_mul_ps(a.value, b.value) };
+
+		return result;
+	}
+
+	INLINE sse_value sqrt(const sse_value& a)
+	{
+		const sse_value result = { expression_template_simd::square_root(a.value) };
+
+		return result;
+	}
+
+	template <typename Shape>
+	class shape_sse_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_elements = elements;
+				_size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
+
+				// Setup the arrays
+				a = create(1.0f);
+				b = create(2.0f);
+				c = create(3.0f);
+				d = create(4.0f);
+				e = create(5.0f);
+				f = create(6.0f);
+				g = create(7.0f);
+				h = create(8.0f);
+
+				result = create(0.0f);
+			}
+
+			void run()
+			{
+				for (std::size_t i = 0; i < _size; ++i)
+					Shape::evaluate(result[i], a[i], b[i], c[i], d[i], e[i], f[i], g[i], h[i]);
+			}
+
+			bool verify()
+			{
+				const float expected = expected_value<Shape>();
+				const float* values = (const float*)result;
+
+				for (std::size_t i = 0; i < _elements; ++i)
+				{
+					if (!matches(values[i], expected))
+						return false;
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(result);
+
+				_mm_free(a);
+				_mm_free(b);
+				_mm_free(c);
+				_mm_free(d);
+				_mm_free(e);
+				_mm_free(f);
+				_mm_free(g);
+				_mm_free(h);
+			}
+
+		private:
+
+			sse_value* create(float value) const
+			{
+				sse_value* values = (sse_value*)_mm_malloc(_size * sizeof(sse_value), sizeof(__m128));
+
+				for (std::size_t i = 0; i < _size; ++i)
+					values[i].value = _mm_set1_ps(value);
+
+				return values;
+			}
+
+			std::size_t _elements;
+			std::size_t _size;
+
+			sse_value* a;
+			sse_value* b;
+			sse_value* c;
+			sse_value* d;
+			sse_value* e;
+			sse_value* f;
+			sse_value* g;
+			sse_value* h;
+
+			sse_value* result;
+
+	} ; // end class shape_sse_arrays<Shape>
+
+#endif
+
+//---------------------------------------------------------------------
+// Registration
+//---------------------------------------------------------------------
+
+	// One array written for each value
+	#define REGISTER_SHAPE(name, leaves, flops, kernel, test) \
+		register_performance_test name##_##kernel( \
+			"shapes/" #name "/" #kernel, \
+			&create_performance_test<test>, \
+			((leaves) + 1) * sizeof(float), flops);
+
+	#define REGISTER_VALARRAY(name, leaves, flops, kernel, Array) \
+		typedef shape_valarray<Array, shape_##name> name##_##kernel##_test; \
+		REGISTER_SHAPE(name, leaves, flops, kernel, name##_##kernel##_test)
+
+	#define REGISTER_FLOAT_ARRAYS(name, leaves, flops, expression) \
+		REGISTER_SHAPE(name, leaves, flops, float_arrays, shape_float_arrays<shape_##name>)
+
+	typedef expression_template::valarray<float> float_valarray;
+
+	#define REGISTER_EXPR_TEMPLATE_FLOAT(name, leaves, flops, expression) \
+		REGISTER_VALARRAY(name, leaves, flops, expr_template_float, float_valarray)
+
+	EXPRESSION_SHAPES(REGISTER_FLOAT_ARRAYS)
+	EXPRESSION_SHAPES(REGISTER_EXPR_TEMPLATE_FLOAT)
+
+#ifdef USE_SSE
+
+	#define REGISTER_SSE_ARRAYS(name, leaves, flops, expression) \
+		REGISTER_SHAPE(name, leaves, flops, sse_arrays, shape_sse_arrays<shape_##name>)
+
+	typedef expression_template_simd::valarray<float> sse_valarray;
+
+	#define REGISTER_EXPR_TEMPLATE_SSE(name, leaves, flops, expression) \
+		REGISTER_VALARRAY(name, leaves, flops, expr_template_sse, sse_valarray)
+
+	EXPRESSION_SHAPES(REGISTER_SSE_ARRAYS)
+	EXPRESSION_SHAPES(REGISTER_EXPR_TEMPLATE_SSE)
+
+#endif
+
+#ifdef USE_AVX
+
+	typedef expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > avx_valarray;
+
+	#define REGISTER_EXPR_TEMPLATE_AVX(name, leaves, flops, expression) \
+		REGISTER_VALARRAY(name, leaves, flops, expr_template_avx, avx_valarray)
+
+	EXPRESSION_SHAPES(REGISTER_EXPR_TEMPLATE_AVX)
+
+#endif
+
+#ifdef USE_NEON
+
+	typedef expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > neon_valarray;
+
+	#define REGISTER_EXPR_TEMPLATE_NEON(name, leaves, flops, expression) \
+		REGISTER_VALARRAY(name, leaves, flops, expr_template_neon, neon_valarray)
+
+	EXPRESSION_SHAPES(REGISTER_EXPR_TEMPLATE_NEON)
+
+#endif
+
+} // end anonymous namespace
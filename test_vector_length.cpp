@@ -1,430 +1,1048 @@
 #include "performance_test.hpp"
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// Four arrays read and one written per value, eight flops per value
+	const double bytes_per_element = 5 * sizeof(float);
+	const double flops_per_element = 8;
+
+	// An incremental run recomputes one tracked block whatever the array
+	// size, so rates scaled by the size would be meaningless. Those kernels
+	// report time per run only.
+	const double incremental_bytes_per_element = 0;
+	const double incremental_flops_per_element = 0;
 
 //---------------------------------------------------------------------
 // valarray implementations
 //---------------------------------------------------------------------
 
-double time_naive_array(std::size_t size)
-{
-	using namespace naive_implementation;
-
-	// Setup the arrays
-	valarray<float> v1x(size, 1.0f);
-	valarray<float> v1y(size, 2.0f);
-	valarray<float> v1z(size, 3.0f);
-	valarray<float> v1w(size, 4.0f);
-
-	valarray<float> lengths(size);
+	template <typename Array>
+	class vector_length_valarray : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				// Setup the arrays
+				v1x = new Array(size, 1.0f);
+				v1y = new Array(size, 2.0f);
+				v1z = new Array(size, 3.0f);
+				v1w = new Array(size, 4.0f);
+
+				lengths = new Array(size);
+			}
+
+			void run()
+			{
+				// Compute the length
+				*lengths =
+					sqrt(
+						*v1x * *v1x +
+						*v1y * *v1y +
+						*v1z * *v1z +
+						*v1w * *v1w
+					);
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete lengths;
+
+				delete v1x;
+				delete v1y;
+				delete v1z;
+				delete v1w;
+			}
+
+		protected:
+
+			Array* v1x;
+			Array* v1y;
+			Array* v1z;
+			Array* v1w;
+
+			Array* lengths;
+
+	} ; // end class vector_length_valarray<Array>
+
+	// Expression template arrays can evaluate a sub range of the expression,
+	// which lets the work be split between threads
+	template <typename Array>
+	class vector_length_valarray_partitioned : public vector_length_valarray<Array>
+	{
+		public:
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(this->lengths->elements(), index, count, cache_line_size / sizeof(typename Array::element_type), begin, end);
+
+				this->lengths->assign(
+					sqrt(
+						*this->v1x * *this->v1x +
+						*this->v1y * *this->v1y +
+						*this->v1z * *this->v1z +
+						*this->v1w * *this->v1w
+					),
+					begin, end);
+			}
+
+	} ; // end class vector_length_valarray_partitioned<Array>
+
+#ifdef USE_THREADS
+	// The sum of squares and the square root run as two pipelined stages,
+	// passing chunks of squared lengths between them
+	template <typename Array>
+	class squared_length_stage : public expression_template_simd::pipeline_stage<Array>
+	{
+		public:
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+			squared_length_stage(const Array& x, const Array& y, const Array& z, const Array& w)
+				: v1x(x)
+				, v1y(y)
+				, v1z(z)
+				, v1w(w)
+			{ }
 
-	// Compute the length
-	lengths =
-		sqrt(
-			v1x * v1x +
-			v1y * v1y +
-			v1z * v1z +
-			v1w * v1w
-		);
+			void process(const Array&, Array& output, std::size_t begin, std::size_t end)
+			{
+				using expression_template_simd::window;
 
-	// Stop the timer
-	clock.stop();
+				const std::size_t count = output.elements();
 
-	return clock.elapsed_time();
-}
+				output.assign(
+					window(v1x, begin, count) * window(v1x, begin, count) +
+					window(v1y, begin, count) * window(v1y, begin, count) +
+					window(v1z, begin, count) * window(v1z, begin, count) +
+					window(v1w, begin, count) * window(v1w, begin, count),
+					0, end - begin);
+			}
 
-double time_expr_template_float(std::size_t size)
-{
-	using namespace expression_template;
+		private:
 
-	// Setup the arrays
-	valarray<float> v1x(size, 1.0f);
-	valarray<float> v1y(size, 2.0f);
-	valarray<float> v1z(size, 3.0f);
-	valarray<float> v1w(size, 4.0f);
+			const Array& v1x;
+			const Array& v1y;
+			const Array& v1z;
+			const Array& v1w;
 
-	valarray<float> lengths(size);
+	} ; // end class squared_length_stage<Array>
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+	template <typename Array>
+	class square_root_stage : public expression_template_simd::pipeline_stage<Array>
+	{
+		public:
 
-	// Compute the length
-	lengths =
-		sqrt(
-			v1x * v1x +
-			v1y * v1y +
-			v1z * v1z +
-			v1w * v1w
-		);
+			explicit square_root_stage(Array& lengths)
+				: _lengths(lengths)
+			{ }
 
-	// Stop the timer
-	clock.stop();
+			void process(const Array& input, Array&, std::size_t begin, std::size_t end)
+			{
+				_lengths.assign(sqrt(expression_template_simd::placed(input, begin, _lengths.elements())), begin, end);
+			}
 
-	return clock.elapsed_time();
-}
+		private:
 
-#ifdef USE_SSE
+			Array& _lengths;
 
-double time_expr_template_sse(std::size_t size)
-{
-	using namespace expression_template_simd;
-	typedef valarray<float> valarray_float;
+	} ; // end class square_root_stage<Array>
 
-	// Setup the arrays
-	valarray_float v1x(size, 1.0f);
-	valarray_float v1y(size, 2.0f);
-	valarray_float v1z(size, 3.0f);
-	valarray_float v1w(size, 4.0f);
+	template <typename Array>
+	class vector_length_valarray_pipelined : public vector_length_valarray<Array>
+	{
+		public:
 
-	valarray_float lengths(size);
+			void setup(std::size_t size)
+			{
+				vector_length_valarray<Array>::setup(size);
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+				_pipeline = new expression_template_simd::stage_pipeline<Array>(this->lengths->elements());
+				_pipeline->add_stage(new squared_length_stage<Array>(*this->v1x, *this->v1y, *this->v1z, *this->v1w));
+				_pipeline->add_stage(new square_root_stage<Array>(*this->lengths));
+			}
 
-	// Compute the length
-	lengths =
-		sqrt(
-			v1x * v1x +
-			v1y * v1y +
-			v1z * v1z +
-			v1w * v1w
-		);
+			void run()
+			{
+				_pipeline->run();
+			}
 
-	// Stop the timer
-	clock.stop();
+			void teardown()
+			{
+				delete _pipeline;
 
-	return clock.elapsed_time();
-}
+				vector_length_valarray<Array>::teardown();
+			}
 
-#else
+		private:
 
-double time_expr_template_sse(std::size_t) { return 0.0; }
+			expression_template_simd::stage_pipeline<Array>* _pipeline;
 
+	} ; // end class vector_length_valarray_pipelined<Array>
 #endif
 
-#ifdef USE_AVX
+	// The squares written as such and the sum rebuilt as a balanced tree of
+	// multiply-adds before it is evaluated
+	template <typename Array>
+	class vector_length_valarray_rewritten : public vector_length_valarray<Array>
+	{
+		public:
+
+			void run()
+			{
+				*this->lengths =
+					rewritten(
+						sqrt(
+							square(*this->v1x) +
+							square(*this->v1y) +
+							square(*this->v1z) +
+							square(*this->v1w)
+						)
+					);
+			}
+
+	} ; // end class vector_length_valarray_rewritten<Array>
+
+	// The same lengths written with the zero terms and unit factors that
+	// generated code tends to produce. The rewrite drops them, so the timed
+	// expression should run as fast as the plain one, and give the result
+	// of the expression as written.
+	template <typename Array>
+	class vector_length_valarray_identities : public vector_length_valarray<Array>
+	{
+		public:
+
+			typedef typename Array::element_type element_type;
+
+			void setup(std::size_t size)
+			{
+				vector_length_valarray<Array>::setup(size);
+
+				using expression_template_simd::zeros;
+				using expression_template_simd::ones;
+
+				const std::size_t values = this->lengths->size();
+
+				*this->lengths =
+					sqrt(
+						zeros<element_type>(values) +
+						square(*this->v1x) * ones<element_type>(values) +
+						square(*this->v1y) +
+						ones<element_type>(values) * square(*this->v1z) +
+						square(*this->v1w) +
+						zeros<element_type>(values)
+					);
+
+				const float* lengths = (const float*)this->lengths->data();
+				_expected.assign(lengths, lengths + values);
+			}
+
+			void run()
+			{
+				using expression_template_simd::zeros;
+				using expression_template_simd::ones;
+
+				const std::size_t values = this->lengths->size();
+
+				*this->lengths =
+					rewritten(
+						sqrt(
+							zeros<element_type>(values) +
+							square(*this->v1x) * ones<element_type>(values) +
+							square(*this->v1y) +
+							ones<element_type>(values) * square(*this->v1z) +
+							square(*this->v1w) +
+							zeros<element_type>(values)
+						)
+					);
+			}
+
+			bool verify()
+			{
+				const float* values = (const float*)this->lengths->data();
+
+				for (std::size_t i = 0; i < _expected.size(); ++i)
+				{
+					// The balanced sum may round differently in the last bits
+					if (std::fabs(_expected[i] - values[i]) > 1e-5f * std::fabs(_expected[i]))
+					{
+						std::cerr << "vector_length: rewritten identities give " << values[i] << " instead of " << _expected[i] << " at " << i << "\n";
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				_expected.clear();
+
+				vector_length_valarray<Array>::teardown();
+			}
+
+		private:
+
+			std::vector<float> _expected;
+
+	} ; // end class vector_length_valarray_identities<Array>
+
+	// One element of one input is written between runs, and a cached
+	// expression recomputes only the block that reads it. The written value
+	// alternates, so each refresh has a new length to compute.
+	template <typename Array>
+	class vector_length_valarray_incremental : public vector_length_valarray<Array>
+	{
+		public:
+
+			typedef typename Array::element_type element_type;
+
+			void setup(std::size_t size)
+			{
+				vector_length_valarray<Array>::setup(size);
+
+				_cache = new expression_template_simd::cached_expression(
+					*this->lengths,
+					sqrt(
+						*this->v1x * *this->v1x +
+						*this->v1y * *this->v1y +
+						*this->v1z * *this->v1z +
+						*this->v1w * *this->v1w
+					));
+
+				_cache->refresh();
+				_position = 0;
+				_runs = 0;
+			}
+
+			void run()
+			{
+				const float value = (_runs++ & 1) ? 1.0f : 5.0f;
+
+				Array& x = *this->v1x;
+				x(_position) = expression_template_simd::splat<element_type>(value);
+
+				_position = (_position + 97) % x.elements();
+
+				_cache->refresh();
+			}
+
+			// The refreshed lengths must match a full evaluation
+			bool verify()
+			{
+				const Array& x = *this->v1x;
+				const Array& y = *this->v1y;
+				const Array& z = *this->v1z;
+				const Array& w = *this->v1w;
+
+				Array expected(this->lengths->size());
+				expected = sqrt(x * x + y * y + z * z + w * w);
+
+				for (std::size_t i = 0; i < expected.size(); ++i)
+				{
+					if ((*this->lengths)[i] != expected[i])
+					{
+						std::cerr << "vector_length: incremental length is " << (*this->lengths)[i] << " instead of " << expected[i] << " at " << i << "\n";
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+			void teardown()
+			{
+				delete _cache;
+
+				vector_length_valarray<Array>::teardown();
+			}
+
+		private:
+
+			expression_template_simd::cached_expression* _cache;
+			std::size_t _position;
+			std::size_t _runs;
+
+	} ; // end class vector_length_valarray_incremental<Array>
+
+#if defined(USE_SSE) && defined(USE_THREADS)
+	// Each run publishes the lengths plus the version number as a new
+	// snapshot, while reader threads check that every snapshot they pin
+	// holds a single value. A buffer reclaimed while a reader still held it
+	// would be overwritten by a later version and read as a mix.
+	template <typename Array>
+	class vector_length_valarray_snapshot : public vector_length_valarray<Array>
+	{
+		public:
+
+			typedef expression_template_simd::snapshot_valarray<float> snapshot_type;
+
+			enum { reader_count = 3, samples = 1024 } ;
+
+			void setup(std::size_t size)
+			{
+				vector_length_valarray<Array>::setup(size);
+
+				_snapshot = new snapshot_type(size);
+				_stop = 0;
+				_torn = 0;
+
+				for (std::size_t i = 0; i < reader_count; ++i)
+					_readers[i].start(&read_entry, this);
+			}
+
+			void run()
+			{
+				_snapshot->publish(
+					sqrt(
+						*this->v1x * *this->v1x +
+						*this->v1y * *this->v1y +
+						*this->v1z * *this->v1z +
+						*this->v1w * *this->v1w
+					) + expression_template_simd::constant(_snapshot->size(), (float)_snapshot->version()));
+			}
+
+			bool verify()
+			{
+				return threading::fetch_add(&_torn, 0) == 0;
+			}
+
+			void teardown()
+			{
+				threading::fetch_add(&_stop, 1);
+
+				for (std::size_t i = 0; i < reader_count; ++i)
+					_readers[i].join();
+
+				delete _snapshot;
+
+				vector_length_valarray<Array>::teardown();
+			}
+
+		private:
+
+			static void read_entry(void* context)
+			{
+				((vector_length_valarray_snapshot*)context)->read();
+			}
+
+			void read()
+			{
+				const std::size_t size = _snapshot->size();
+				const std::size_t stride = (size > samples) ? size / samples : 1;
+
+				while ((size > 0) && (threading::fetch_add(&_stop, 0) == 0))
+				{
+					const snapshot_type::read_guard guard(*_snapshot);
+
+					const float first = (*guard)[0];
+
+					for (std::size_t i = stride; i < size; i += stride)
+					{
+						if ((*guard)[i] != first)
+						{
+							threading::fetch_add(&_torn, 1);
+							break;
+						}
+					}
+
+					if ((*guard)[size - 1] != first)
+						threading::fetch_add(&_torn, 1);
+				}
+			}
+
+			snapshot_type* _snapshot;
+			threading::thread _readers[reader_count];
+			volatile std::size_t _stop;
+			volatile std::size_t _torn;
+
+	} ; // end class vector_length_valarray_snapshot<Array>
+#endif
 
-double time_expr_template_avx(std::size_t size)
-{
-	using namespace expression_template_simd;
-	typedef valarray<float, valarray_rep_avx<float> > valarray_float;
+	// The same formula parsed at run time and run by the interpreter. The
+	// timed result is checked against the expression template, allowing for
+	// the SSE square root being an estimate.
+	template <typename Array>
+	class vector_length_formula : public vector_length_valarray<Array>
+	{
+		public:
 
-	// Setup the arrays
-	valarray_float v1x(size, 1.0f);
-	valarray_float v1y(size, 2.0f);
-	valarray_float v1z(size, 3.0f);
-	valarray_float v1w(size, 4.0f);
+			void setup(std::size_t size)
+			{
+				vector_length_valarray<Array>::setup(size);
 
-	valarray_float lengths(size);
+				std::vector<std::string> names;
+				names.push_back("x");
+				names.push_back("y");
+				names.push_back("z");
+				names.push_back("w");
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+				std::string error;
+				_compiled = _program.compile("sqrt(x*x + y*y + z*z + w*w)", names, error);
 
-	// Compute the length
-	lengths =
-		sqrt(
-			v1x * v1x +
-			v1y * v1y +
-			v1z * v1z +
-			v1w * v1w
-		);
+				if (!_compiled)
+					std::cerr << "vector_length: formula does not compile: " << error << "\n";
 
-	// Stop the timer
-	clock.stop();
+				_inputs.push_back(this->v1x);
+				_inputs.push_back(this->v1y);
+				_inputs.push_back(this->v1z);
+				_inputs.push_back(this->v1w);
 
-	return clock.elapsed_time();
-}
+				vector_length_valarray<Array>::run();
 
-#else
+				const float* values = (const float*)this->lengths->data();
+				_expected.assign(values, values + size);
+			}
 
-double time_expr_template_avx(std::size_t) { return 0.0; }
+			void run()
+			{
+				if (_compiled)
+					formula::evaluate(_program, *this->lengths, _inputs);
+			}
 
-#endif
+			bool verify()
+			{
+				if (!_compiled)
+					return false;
 
-#ifdef USE_NEON
+				const float* values = (const float*)this->lengths->data();
 
-double time_expr_template_neon(std::size_t size)
-{
-	using namespace expression_template_simd;
-	typedef valarray<float, valarray_rep_neon<float> > valarray_float;
+				for (std::size_t i = 0; i < _expected.size(); ++i)
+				{
+					if (std::fabs(_expected[i] - values[i]) > 1e-3f * std::fabs(_expected[i]))
+					{
+						std::cerr << "vector_length: formula gives " << values[i] << " instead of " << _expected[i] << " at " << i << "\n";
+						return false;
+					}
+				}
 
-	// Setup the arrays
-	valarray_float v1x(size, 1.0f);
-	valarray_float v1y(size, 2.0f);
-	valarray_float v1z(size, 3.0f);
-	valarray_float v1w(size, 4.0f);
+				return true;
+			}
 
-	valarray_float lengths(size);
+			void teardown()
+			{
+				_inputs.clear();
+				_expected.clear();
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+				vector_length_valarray<Array>::teardown();
+			}
 
-	// Compute the length
-	lengths =
-		sqrt(
-			v1x * v1x +
-			v1y * v1y +
-			v1z * v1z +
-			v1w * v1w
-		);
+		protected:
 
-	// Stop the timer
-	clock.stop();
+			formula::program _program;
+			std::vector<const Array*> _inputs;
+			std::vector<float> _expected;
+			bool _compiled;
 
-	return clock.elapsed_time();
-}
+	} ; // end class vector_length_formula<Array>
 
-#else
+#ifdef USE_JIT
+	// The formula translated to native code
+	template <typename Array>
+	class vector_length_formula_jit : public vector_length_formula<Array>
+	{
+		public:
 
-double time_expr_template_neon(std::size_t) { return 0.0; }
+			void run()
+			{
+				if (this->_compiled)
+					formula::evaluate_jit(this->_program, *this->lengths, this->_inputs);
+			}
 
+	} ; // end class vector_length_formula_jit<Array>
 #endif
 
-//---------------------------------------------------------------------
-// C array implementations
-//---------------------------------------------------------------------
+	register_performance_test naive_array(
+		"vector_length/naive_array",
+		&create_performance_test<vector_length_valarray<naive_implementation::valarray<float> > >,
+		bytes_per_element, flops_per_element);
 
-double time_float_arrays(std::size_t size)
-{
-	// Setup the arrays
-	float* v1x = new float[size];
-	float* v1y = new float[size];
-	float* v1z = new float[size];
-	float* v1w = new float[size];
+	register_performance_test expr_template_float(
+		"vector_length/expr_template_float",
+		&create_performance_test<vector_length_valarray_partitioned<expression_template::valarray<float> > >,
+		bytes_per_element, flops_per_element);
 
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		v1x[i] = 1.0f;
-		v1y[i] = 2.0f;
-		v1z[i] = 3.0f;
-		v1w[i] = 4.0f;
-	}
+#ifdef USE_SSE
 
-	float* lengths = new float[size];
+	register_performance_test expr_template_sse(
+		"vector_length/expr_template_sse",
+		&create_performance_test<vector_length_valarray_partitioned<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_sse_rewritten(
+		"vector_length/expr_template_sse_rewritten",
+		&create_performance_test<vector_length_valarray_rewritten<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_sse_identities(
+		"vector_length/expr_template_sse_identities",
+		&create_performance_test<vector_length_valarray_identities<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_sse_incremental(
+		"vector_length/expr_template_sse_incremental",
+		&create_performance_test<vector_length_valarray_incremental<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_tracked<float, expression_template_simd::valarray_rep_sse<float> > > > >,
+		incremental_bytes_per_element, incremental_flops_per_element);
+
+	register_performance_test formula_sse(
+		"vector_length/formula_sse",
+		&create_performance_test<vector_length_formula<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+
+#ifdef USE_JIT
+	register_performance_test formula_jit_sse(
+		"vector_length/formula_jit_sse",
+		&create_performance_test<vector_length_formula_jit<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+#endif
 
-	// Begin the timer
-	timer clock;
-	clock.start();
+#ifdef USE_THREADS
+	register_performance_test expr_template_sse_pipelined(
+		"vector_length/expr_template_sse_pipelined",
+		&create_performance_test<vector_length_valarray_pipelined<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
 
-	// Compute the length
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		lengths[i] =
-			std::sqrt(
-				v1x[i] * v1x[i] +
-				v1y[i] * v1y[i] +
-				v1z[i] * v1z[i] +
-				v1w[i] * v1w[i]
-			);
-	}
+	register_performance_test expr_template_sse_snapshot(
+		"vector_length/expr_template_sse_snapshot",
+		&create_performance_test<vector_length_valarray_snapshot<expression_template_simd::valarray<float> > >,
+		bytes_per_element, flops_per_element);
+#endif
 
-	// Stop the timer
-	clock.stop();
+#endif
 
-	// Cleanup the arrays
-	delete[] lengths;
+#ifdef USE_AVX
 
-	delete[] v1x;
-	delete[] v1y;
-	delete[] v1z;
-	delete[] v1w;
+	register_performance_test expr_template_avx(
+		"vector_length/expr_template_avx",
+		&create_performance_test<vector_length_valarray_partitioned<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_avx_rewritten(
+		"vector_length/expr_template_avx_rewritten",
+		&create_performance_test<vector_length_valarray_rewritten<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_avx_identities(
+		"vector_length/expr_template_avx_identities",
+		&create_performance_test<vector_length_valarray_identities<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_avx_incremental(
+		"vector_length/expr_template_avx_incremental",
+		&create_performance_test<vector_length_valarray_incremental<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_tracked<float, expression_template_simd::valarray_rep_avx<float> > > > >,
+		incremental_bytes_per_element, incremental_flops_per_element);
+
+	register_performance_test formula_avx(
+		"vector_length/formula_avx",
+		&create_performance_test<vector_length_formula<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+
+#ifdef USE_JIT
+	register_performance_test formula_jit_avx(
+		"vector_length/formula_jit_avx",
+		&create_performance_test<vector_length_formula_jit<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+#endif
 
-	return clock.elapsed_time();
-}
+#ifdef USE_THREADS
+	register_performance_test expr_template_avx_pipelined(
+		"vector_length/expr_template_avx_pipelined",
+		&create_performance_test<vector_length_valarray_pipelined<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_avx<float> > > >,
+		bytes_per_element, flops_per_element);
+#endif
 
-#ifdef USE_SSE
+#endif
 
-double time_sse_arrays(std::size_t elements)
-{
-	const std::size_t size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
-	const std::size_t alignment  = sizeof(__m128);
-	const std::size_t array_size = alignment * size;
-
-	// Setup the arrays
-	__m128* v1x = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v1y = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v1z = (__m128*)_mm_malloc(array_size, alignment);
-	__m128* v1w = (__m128*)_mm_malloc(array_size, alignment);
-	
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		v1x[i] = _mm_set1_ps(1.0f);
-		v1y[i] = _mm_set1_ps(2.0f);
-		v1z[i] = _mm_set1_ps(3.0f);
-		v1w[i] = _mm_set1_ps(4.0f);
-	}
-	
-	__m128* lengths = (__m128*)_mm_malloc(array_size, alignment);
-
-	// Begin the timer
-	timer clock;
-	clock.start();
-
-	// Compute the length
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		lengths[i] = 
-			_mm_sqrt_ps(
-				_mm_add_ps(
-					_mm_add_ps(_mm_mul_ps(v1x[i], v1x[i]), _mm_mul_ps(v1y[i], v1y[i])),
-					_mm_add_ps(_mm_mul_ps(v1z[i], v1z[i]), _mm_mul_ps(v1w[i], v1w[i]))));
-	}
+#ifdef USE_NEON
 
-	// Stop the timer
-	clock.stop();
+	register_performance_test expr_template_neon(
+		"vector_length/expr_template_neon",
+		&create_performance_test<vector_length_valarray_partitioned<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_neon_rewritten(
+		"vector_length/expr_template_neon_rewritten",
+		&create_performance_test<vector_length_valarray_rewritten<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_neon_identities(
+		"vector_length/expr_template_neon_identities",
+		&create_performance_test<vector_length_valarray_identities<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		bytes_per_element, flops_per_element);
+
+	register_performance_test expr_template_neon_incremental(
+		"vector_length/expr_template_neon_incremental",
+		&create_performance_test<vector_length_valarray_incremental<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_tracked<float, expression_template_simd::valarray_rep_neon<float> > > > >,
+		incremental_bytes_per_element, incremental_flops_per_element);
+
+	register_performance_test formula_neon(
+		"vector_length/formula_neon",
+		&create_performance_test<vector_length_formula<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		bytes_per_element, flops_per_element);
+
+#ifdef USE_THREADS
+	register_performance_test expr_template_neon_pipelined(
+		"vector_length/expr_template_neon_pipelined",
+		&create_performance_test<vector_length_valarray_pipelined<expression_template_simd::valarray<float, expression_template_simd::valarray_rep_neon<float> > > >,
+		bytes_per_element, flops_per_element);
+#endif
 
-	// Cleanup the arrays
-	_mm_free(lengths);
+#endif
 
-	_mm_free(v1x);
-	_mm_free(v1y);
-	_mm_free(v1z);
-	_mm_free(v1w);
+//---------------------------------------------------------------------
+// C array implementations
+//---------------------------------------------------------------------
 
-	return clock.elapsed_time();
-}
+	class vector_length_float_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t size)
+			{
+				_size = size;
+
+				// Setup the arrays
+				v1x = new float[size];
+				v1y = new float[size];
+				v1z = new float[size];
+				v1w = new float[size];
+
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					v1x[i] = 1.0f;
+					v1y[i] = 2.0f;
+					v1z[i] = 3.0f;
+					v1w[i] = 4.0f;
+				}
+
+				lengths = new float[size];
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(float), begin, end);
+
+				// Compute the length
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					lengths[i] =
+						std::sqrt(
+							v1x[i] * v1x[i] +
+							v1y[i] * v1y[i] +
+							v1z[i] * v1z[i] +
+							v1w[i] * v1w[i]
+						);
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				delete[] lengths;
+
+				delete[] v1x;
+				delete[] v1y;
+				delete[] v1z;
+				delete[] v1w;
+			}
+
+		private:
+
+			std::size_t _size;
+
+			float* v1x;
+			float* v1y;
+			float* v1z;
+			float* v1w;
+
+			float* lengths;
+
+	} ; // end class vector_length_float_arrays
+
+	register_performance_test float_arrays(
+		"vector_length/float_arrays",
+		&create_performance_test<vector_length_float_arrays>,
+		bytes_per_element, flops_per_element);
 
-#else
+#ifdef USE_SSE
 
-double time_sse_arrays(std::size_t) { return 0.0; }
+	class vector_length_sse_arrays : public performance_test
+	{
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
+
+				const std::size_t alignment  = sizeof(__m128);
+				const std::size_t array_size = alignment * _size;
+
+				// Setup the arrays
+				v1x = (__m128*)_mm_malloc(array_size, alignment);
+				v1y = (__m128*)_mm_malloc(array_size, alignment);
+				v1z = (__m128*)_mm_malloc(array_size, alignment);
+				v1w = (__m128*)_mm_malloc(array_size, alignment);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					v1x[i] = _mm_set1_ps(1.0f);
+					v1y[i] = _mm_set1_ps(2.0f);
+					v1z[i] = _mm_set1_ps(3.0f);
+					v1w[i] = _mm_set1_ps(4.0f);
+				}
+
+				lengths = (__m128*)_mm_malloc(array_size, alignment);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(__m128), begin, end);
+
+				// Compute the length
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					lengths[i] =
+						_mm_sqrt_ps(
+							_mm_add_ps(
+								_mm_add_ps(_mm_mul_ps(v1x[i], v1x[i]), _mm_mul_ps(v1y[i], v1y[i])),
+								_mm_add_ps(_mm_mul_ps(v1z[i], v1z[i]), _mm_mul_ps(v1w[i], v1w[i]))));
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(lengths);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+			}
+
+		private:
+
+			std::size_t _size;
+
+			__m128* v1x;
+			__m128* v1y;
+			__m128* v1z;
+			__m128* v1w;
+
+			__m128* lengths;
+
+	} ; // end class vector_length_sse_arrays
+
+	register_performance_test sse_arrays(
+		"vector_length/sse_arrays",
+		&create_performance_test<vector_length_sse_arrays>,
+		bytes_per_element, flops_per_element);
 
 #endif
 
 #ifdef USE_AVX
 
-double time_avx_arrays(std::size_t elements)
-{
-	const std::size_t size = (elements / 8) + ((elements % 8 == 0) ? 0 : 1);
-	const std::size_t alignment  = sizeof(__m256);
-	const std::size_t array_size = alignment * size;
-
-	// Setup the arrays
-	__m256* v1x = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v1y = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v1z = (__m256*)_mm_malloc(array_size, alignment);
-	__m256* v1w = (__m256*)_mm_malloc(array_size, alignment);
-	
-	for (std::size_t i = 0; i < size; ++i)
+	class vector_length_avx_arrays : public performance_test
 	{
-		v1x[i] = _mm256_set1_ps(1.0f);
-		v1y[i] = _mm256_set1_ps(2.0f);
-		v1z[i] = _mm256_set1_ps(3.0f);
-		v1w[i] = _mm256_set1_ps(4.0f);
-	}
-	
-	__m256* lengths = (__m256*)_mm_malloc(array_size, alignment);
-
-	// Begin the timer
-	timer clock;
-	clock.start();
-
-	// Compute the length
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		lengths[i] = 
-			_mm256_sqrt_ps(
-				_mm256_add_ps(
-					_mm256_add_ps(_mm256_mul_ps(v1x[i], v1x[i]), _mm256_mul_ps(v1y[i], v1y[i])),
-					_mm256_add_ps(_mm256_mul_ps(v1z[i], v1z[i]), _mm256_mul_ps(v1w[i], v1w[i]))));
-	}
-
-	// Stop the timer
-	clock.stop();
-
-	// Cleanup the arrays
-	_mm_free(lengths);
-
-	_mm_free(v1x);
-	_mm_free(v1y);
-	_mm_free(v1z);
-	_mm_free(v1w);
-
-	return clock.elapsed_time();
-}
-
-#else
-
-double time_avx_arrays(std::size_t) { return 0.0; }
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_size = (elements / 8) + ((elements % 8 == 0) ? 0 : 1);
+
+				const std::size_t alignment  = sizeof(__m256);
+				const std::size_t array_size = alignment * _size;
+
+				// Setup the arrays
+				v1x = (__m256*)_mm_malloc(array_size, alignment);
+				v1y = (__m256*)_mm_malloc(array_size, alignment);
+				v1z = (__m256*)_mm_malloc(array_size, alignment);
+				v1w = (__m256*)_mm_malloc(array_size, alignment);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					v1x[i] = _mm256_set1_ps(1.0f);
+					v1y[i] = _mm256_set1_ps(2.0f);
+					v1z[i] = _mm256_set1_ps(3.0f);
+					v1w[i] = _mm256_set1_ps(4.0f);
+				}
+
+				lengths = (__m256*)_mm_malloc(array_size, alignment);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(__m256), begin, end);
+
+				// Compute the length
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					lengths[i] =
+						_mm256_sqrt_ps(
+							_mm256_add_ps(
+								_mm256_add_ps(_mm256_mul_ps(v1x[i], v1x[i]), _mm256_mul_ps(v1y[i], v1y[i])),
+								_mm256_add_ps(_mm256_mul_ps(v1z[i], v1z[i]), _mm256_mul_ps(v1w[i], v1w[i]))));
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(lengths);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+			}
+
+		private:
+
+			std::size_t _size;
+
+			__m256* v1x;
+			__m256* v1y;
+			__m256* v1z;
+			__m256* v1w;
+
+			__m256* lengths;
+
+	} ; // end class vector_length_avx_arrays
+
+	register_performance_test avx_arrays(
+		"vector_length/avx_arrays",
+		&create_performance_test<vector_length_avx_arrays>,
+		bytes_per_element, flops_per_element);
 
 #endif
 
 #ifdef USE_NEON
 
-double time_neon_arrays(std::size_t elements)
-{
-	const std::size_t size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
-	const std::size_t alignment  = sizeof(float32x4_t);
-	const std::size_t array_size = alignment * size;
-
-	// Setup the arrays
-	float32x4_t* v1x = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v1y = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v1z = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v1w = (float32x4_t*)_mm_malloc(array_size, alignment);
-
-	float32x4_t* v2x = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v2y = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v2z = (float32x4_t*)_mm_malloc(array_size, alignment);
-	float32x4_t* v2w = (float32x4_t*)_mm_malloc(array_size, alignment);
-	
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		v1x[i] = vdupq_n_f32(1.0f);
-		v1y[i] = vdupq_n_f32(2.0f);
-		v1z[i] = vdupq_n_f32(3.0f);
-		v1w[i] = vdupq_n_f32(4.0f);
-
-		v2x[i] = vdupq_n_f32(5.0f);
-		v2y[i] = vdupq_n_f32(6.0f);
-		v2z[i] = vdupq_n_f32(7.0f);
-		v2w[i] = vdupq_n_f32(8.0f);
-	}
-	
-	float32x4_t* lengths = (float32x4_t*)_mm_malloc(array_size, alignment);
-
-	// Begin the timer
-	timer clock;
-	clock.start();
-
-	// Compute the dot product
-	for (std::size_t i = 0; i < size; ++i)
+	class vector_length_neon_arrays : public performance_test
 	{
-		const float32x4_t length_squared = 
-			vmlaq_f32(
-				vmlaq_f32(
-					vmlaq_f32(
-						vmulq_f32(v1x[i], v2x[i]), v1y[i], v2y[i]), v1z[i], v2z[i]), v1w[i], v2w[i]);
-
-		lengths[i] = vmulq_f32(length_squared, vrsqrteq_f32(length_squared));
-	}
-
-	// Stop the timer
-	clock.stop();
-
-	// Cleanup the arrays
-	_mm_free(lengths);
-
-	_mm_free(v1x);
-	_mm_free(v1y);
-	_mm_free(v1z);
-	_mm_free(v1w);
-
-	_mm_free(v2x);
-	_mm_free(v2y);
-	_mm_free(v2z);
-	_mm_free(v2w);
-
-	return clock.elapsed_time();
-}
-
-#else
-
-double time_neon_arrays(std::size_t) { return 0.0; }
+		public:
+
+			void setup(std::size_t elements)
+			{
+				_size = (elements / 4) + ((elements % 4 == 0) ? 0 : 1);
+
+				const std::size_t alignment  = sizeof(float32x4_t);
+				const std::size_t array_size = alignment * _size;
+
+				// Setup the arrays
+				v1x = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v1y = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v1z = (float32x4_t*)_mm_malloc(array_size, alignment);
+				v1w = (float32x4_t*)_mm_malloc(array_size, alignment);
+
+				for (std::size_t i = 0; i < _size; ++i)
+				{
+					v1x[i] = vdupq_n_f32(1.0f);
+					v1y[i] = vdupq_n_f32(2.0f);
+					v1z[i] = vdupq_n_f32(3.0f);
+					v1w[i] = vdupq_n_f32(4.0f);
+				}
+
+				lengths = (float32x4_t*)_mm_malloc(array_size, alignment);
+			}
+
+			void run()
+			{
+				run_partition(0, 1);
+			}
+
+			bool supports_partition() const
+			{
+				return true;
+			}
+
+			void run_partition(std::size_t index, std::size_t count)
+			{
+				std::size_t begin, end;
+				partition(_size, index, count, cache_line_size / sizeof(float32x4_t), begin, end);
+
+				// Compute the length
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					const float32x4_t length_squared =
+						vmlaq_f32(
+							vmlaq_f32(
+								vmlaq_f32(
+									vmulq_f32(v1x[i], v1x[i]), v1y[i], v1y[i]), v1z[i], v1z[i]), v1w[i], v1w[i]);
+
+					lengths[i] = vmulq_f32(length_squared, vrsqrteq_f32(length_squared));
+				}
+			}
+
+			void teardown()
+			{
+				// Cleanup the arrays
+				_mm_free(lengths);
+
+				_mm_free(v1x);
+				_mm_free(v1y);
+				_mm_free(v1z);
+				_mm_free(v1w);
+			}
+
+		private:
+
+			std::size_t _size;
+
+			float32x4_t* v1x;
+			float32x4_t* v1y;
+			float32x4_t* v1z;
+			float32x4_t* v1w;
+
+			float32x4_t* lengths;
+
+	} ; // end class vector_length_neon_arrays
+
+	register_performance_test neon_arrays(
+		"vector_length/neon_arrays",
+		&create_performance_test<vector_length_neon_arrays>,
+		bytes_per_element, flops_per_element);
 
 #endif
+
+} // end anonymous namespace
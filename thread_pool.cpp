@@ -0,0 +1,115 @@
+#include "thread_pool.hpp"
+
+thread_pool::thread_pool(std::size_t count, bool pin)
+	: _count((count > 0) ? count : 1)
+	, _pin(pin)
+	, _affinity(0)
+	, _task(0)
+	, _context(0)
+	, _generation(0)
+	, _pending(0)
+	, _exit(false)
+{
+	// Threads are pinned to the processors the process may use, in order
+	const std::vector<std::size_t> processors = threading::allowed_processors();
+
+	// The calling thread gets its own affinity back when the pool goes
+	if (_pin)
+	{
+		_affinity = threading::save_affinity();
+		threading::set_affinity(processors[0]);
+	}
+
+	// Filled before any thread starts so the entries never move
+	_starts.resize(_count);
+
+	for (std::size_t i = 1; i < _count; ++i)
+	{
+		_starts[i].pool = this;
+		_starts[i].index = i;
+		_starts[i].processor = processors[i % processors.size()];
+
+		threading::thread* worker = new threading::thread();
+		worker->start(&thread_pool::worker_entry, &_starts[i]);
+
+		_threads.push_back(worker);
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		threading::scoped_lock lock(_lock);
+
+		_exit = true;
+		_wake.notify_all();
+	}
+
+	for (std::size_t i = 0; i < _threads.size(); ++i)
+		delete _threads[i];
+
+	threading::restore_affinity(_affinity);
+}
+
+void thread_pool::run(task_function task, void* context)
+{
+	{
+		threading::scoped_lock lock(_lock);
+
+		_task = task;
+		_context = context;
+		_pending = _count - 1;
+		++_generation;
+
+		_wake.notify_all();
+	}
+
+	task(context, 0, _count);
+
+	threading::scoped_lock lock(_lock);
+
+	while (_pending > 0)
+		_finished.wait(_lock);
+}
+
+void thread_pool::worker_entry(void* context)
+{
+	const worker_start* start = (const worker_start*)context;
+
+	start->pool->worker(start->index);
+}
+
+void thread_pool::worker(std::size_t index)
+{
+	if (_pin)
+		threading::set_affinity(_starts[index].processor);
+
+	std::size_t generation = 0;
+
+	for (;;)
+	{
+		task_function task;
+		void* context;
+
+		{
+			threading::scoped_lock lock(_lock);
+
+			while ((_generation == generation) && !_exit)
+				_wake.wait(_lock);
+
+			if (_exit)
+				return;
+
+			generation = _generation;
+			task = _task;
+			context = _context;
+		}
+
+		task(context, index, _count);
+
+		threading::scoped_lock lock(_lock);
+
+		if (--_pending == 0)
+			_finished.notify_one();
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef THREAD_POOL_HPP_INCLUDED
+#define THREAD_POOL_HPP_INCLUDED
+
+#include "threading.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------
+// Fork-join thread pool
+//---------------------------------------------------------------------
+
+// A fixed set of threads that run the same task together. The calling
+// thread takes part as index 0, so a pool of one thread runs the task
+// inline. When pinned, thread i is bound to logical processor i, and the
+// calling thread is unpinned again when the pool is destroyed, which must
+// happen on the same thread.
+class thread_pool
+{
+	public:
+
+		typedef void (*task_function)(void* context, std::size_t index, std::size_t count);
+
+		explicit thread_pool(std::size_t count, bool pin = true);
+
+		~thread_pool();
+
+		std::size_t size() const
+		{
+			return _count;
+		}
+
+		// Runs task once on every thread and returns when all have finished
+		void run(task_function task, void* context);
+
+	private:
+
+		thread_pool(const thread_pool&);
+		thread_pool& operator= (const thread_pool&);
+
+		struct worker_start
+		{
+			thread_pool* pool;
+			std::size_t index;
+			std::size_t processor;
+		} ;
+
+		static void worker_entry(void* context);
+
+		void worker(std::size_t index);
+
+		std::size_t _count;
+		bool _pin;
+		// Affinity of the calling thread before it was pinned
+		void* _affinity;
+
+		std::vector<worker_start> _starts;
+		std::vector<threading::thread*> _threads;
+
+		threading::mutex _lock;
+		threading::condition _wake;
+		threading::condition _finished;
+
+		task_function _task;
+		void* _context;
+		std::size_t _generation;
+		std::size_t _pending;
+		bool _exit;
+
+} ; // end class thread_pool
+
+#endif // end THREAD_POOL_HPP_INCLUDED
@@ -0,0 +1,389 @@
+#include "threading.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+std::size_t threading::hardware_concurrency()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return info.dwNumberOfProcessors;
+#else
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0) ? (std::size_t)count : 1;
+#endif
+}
+
+std::vector<std::size_t> threading::allowed_processors()
+{
+	std::vector<std::size_t> processors;
+
+#ifdef _WIN32
+	DWORD_PTR process, system;
+
+	if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system))
+	{
+		for (std::size_t i = 0; i < sizeof(process) * 8; ++i)
+		{
+			if (process & ((DWORD_PTR)1 << i))
+				processors.push_back(i);
+		}
+	}
+#elif __linux__
+	cpu_set_t set;
+
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+	{
+		for (std::size_t i = 0; i < CPU_SETSIZE; ++i)
+		{
+			if (CPU_ISSET(i, &set))
+				processors.push_back(i);
+		}
+	}
+#endif
+
+	if (processors.empty())
+	{
+		for (std::size_t i = 0, count = hardware_concurrency(); i < count; ++i)
+			processors.push_back(i);
+	}
+
+	return processors;
+}
+
+bool threading::set_affinity(std::size_t processor)
+{
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << processor) != 0;
+#elif __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor, &set);
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+void* threading::save_affinity()
+{
+#ifdef _WIN32
+	DWORD_PTR process, system;
+
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &process, &system))
+		return 0;
+
+	// The previous mask is only returned by setting a new one
+	const DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), process);
+
+	if (previous == 0)
+		return 0;
+
+	SetThreadAffinityMask(GetCurrentThread(), previous);
+
+	return new DWORD_PTR(previous);
+#elif __linux__
+	cpu_set_t* set = new cpu_set_t;
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(*set), set) != 0)
+	{
+		delete set;
+		return 0;
+	}
+
+	return set;
+#else
+	return 0;
+#endif
+}
+
+void threading::restore_affinity(void* saved)
+{
+	if (!saved)
+		return;
+
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), *(DWORD_PTR*)saved);
+
+	delete (DWORD_PTR*)saved;
+#elif __linux__
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*)saved);
+
+	delete (cpu_set_t*)saved;
+#endif
+}
+
+void* threading::compare_exchange(void* volatile* target, void* exchange, void* comparand)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchangePointer(target, exchange, comparand);
+#else
+	return __sync_val_compare_and_swap(target, comparand, exchange);
+#endif
+}
+
+std::size_t threading::compare_exchange(volatile std::size_t* target, std::size_t exchange, std::size_t comparand)
+{
+#if defined(_WIN64)
+	return (std::size_t)InterlockedCompareExchange64((volatile LONG64*)target, (LONG64)exchange, (LONG64)comparand);
+#elif defined(_WIN32)
+	return (std::size_t)InterlockedCompareExchange((volatile LONG*)target, (LONG)exchange, (LONG)comparand);
+#else
+	return __sync_val_compare_and_swap(target, comparand, exchange);
+#endif
+}
+
+std::size_t threading::fetch_add(volatile std::size_t* target, std::size_t value)
+{
+#if defined(_WIN64)
+	return (std::size_t)InterlockedExchangeAdd64((volatile LONG64*)target, (LONG64)value);
+#elif defined(_WIN32)
+	return (std::size_t)InterlockedExchangeAdd((volatile LONG*)target, (LONG)value);
+#else
+	return __sync_fetch_and_add(target, value);
+#endif
+}
+
+std::size_t threading::load_acquire(const volatile std::size_t* source)
+{
+#ifdef _WIN32
+	// Volatile reads have acquire semantics under Visual C++
+	const std::size_t value = *source;
+	_ReadWriteBarrier();
+
+	return value;
+#else
+	return __atomic_load_n(source, __ATOMIC_ACQUIRE);
+#endif
+}
+
+uint64_t threading::load(const volatile uint64_t* source)
+{
+#if defined(_WIN64)
+	return *source;
+#elif defined(_WIN32)
+	return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)source, 0, 0);
+#else
+	return __atomic_load_n(source, __ATOMIC_RELAXED);
+#endif
+}
+
+void threading::store(volatile uint64_t* target, uint64_t value)
+{
+#if defined(_WIN64)
+	*target = value;
+#elif defined(_WIN32)
+	InterlockedExchange64((volatile LONG64*)target, (LONG64)value);
+#else
+	__atomic_store_n(target, value, __ATOMIC_RELAXED);
+#endif
+}
+
+void threading::yield()
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+void threading::memory_fence()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+//---------------------------------------------------------------------
+// mutex
+//---------------------------------------------------------------------
+
+threading::mutex::mutex()
+{
+#ifdef _WIN32
+	CRITICAL_SECTION* section = new CRITICAL_SECTION;
+	InitializeCriticalSection(section);
+	_handle = section;
+#else
+	pthread_mutex_t* handle = new pthread_mutex_t;
+	pthread_mutex_init(handle, 0);
+	_handle = handle;
+#endif
+}
+
+threading::mutex::~mutex()
+{
+#ifdef _WIN32
+	DeleteCriticalSection((CRITICAL_SECTION*)_handle);
+	delete (CRITICAL_SECTION*)_handle;
+#else
+	pthread_mutex_destroy((pthread_mutex_t*)_handle);
+	delete (pthread_mutex_t*)_handle;
+#endif
+}
+
+void threading::mutex::lock()
+{
+#ifdef _WIN32
+	EnterCriticalSection((CRITICAL_SECTION*)_handle);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)_handle);
+#endif
+}
+
+void threading::mutex::unlock()
+{
+#ifdef _WIN32
+	LeaveCriticalSection((CRITICAL_SECTION*)_handle);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)_handle);
+#endif
+}
+
+//---------------------------------------------------------------------
+// condition
+//---------------------------------------------------------------------
+
+threading::condition::condition()
+{
+#ifdef _WIN32
+	CONDITION_VARIABLE* variable = new CONDITION_VARIABLE;
+	InitializeConditionVariable(variable);
+	_handle = variable;
+#else
+	pthread_cond_t* handle = new pthread_cond_t;
+	pthread_cond_init(handle, 0);
+	_handle = handle;
+#endif
+}
+
+threading::condition::~condition()
+{
+#ifdef _WIN32
+	delete (CONDITION_VARIABLE*)_handle;
+#else
+	pthread_cond_destroy((pthread_cond_t*)_handle);
+	delete (pthread_cond_t*)_handle;
+#endif
+}
+
+void threading::condition::wait(mutex& lock)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS((CONDITION_VARIABLE*)_handle, (CRITICAL_SECTION*)lock._handle, INFINITE);
+#else
+	pthread_cond_wait((pthread_cond_t*)_handle, (pthread_mutex_t*)lock._handle);
+#endif
+}
+
+void threading::condition::notify_one()
+{
+#ifdef _WIN32
+	WakeConditionVariable((CONDITION_VARIABLE*)_handle);
+#else
+	pthread_cond_signal((pthread_cond_t*)_handle);
+#endif
+}
+
+void threading::condition::notify_all()
+{
+#ifdef _WIN32
+	WakeAllConditionVariable((CONDITION_VARIABLE*)_handle);
+#else
+	pthread_cond_broadcast((pthread_cond_t*)_handle);
+#endif
+}
+
+//---------------------------------------------------------------------
+// thread
+//---------------------------------------------------------------------
+
+namespace
+{
+	struct thread_start
+	{
+		threading::thread_function function;
+		void* context;
+	} ;
+
+#ifdef _WIN32
+	DWORD WINAPI thread_entry(LPVOID parameter)
+#else
+	void* thread_entry(void* parameter)
+#endif
+	{
+		thread_start start = *(thread_start*)parameter;
+		delete (thread_start*)parameter;
+
+		start.function(start.context);
+
+		return 0;
+	}
+}
+
+threading::thread::thread()
+	: _handle(0)
+{ }
+
+threading::thread::~thread()
+{
+	join();
+}
+
+bool threading::thread::start(thread_function function, void* context)
+{
+	if (_handle)
+		return false;
+
+	thread_start* start = new thread_start;
+	start->function = function;
+	start->context = context;
+
+#ifdef _WIN32
+	_handle = CreateThread(0, 0, &thread_entry, start, 0, 0);
+#else
+	pthread_t* handle = new pthread_t;
+
+	if (pthread_create(handle, 0, &thread_entry, start) == 0)
+	{
+		_handle = handle;
+	}
+	else
+	{
+		delete handle;
+	}
+#endif
+
+	if (!_handle)
+		delete start;
+
+	return _handle != 0;
+}
+
+void threading::thread::join()
+{
+	if (!_handle)
+		return;
+
+#ifdef _WIN32
+	WaitForSingleObject((HANDLE)_handle, INFINITE);
+	CloseHandle((HANDLE)_handle);
+#else
+	pthread_join(*(pthread_t*)_handle, 0);
+	delete (pthread_t*)_handle;
+#endif
+
+	_handle = 0;
+}
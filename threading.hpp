@@ -0,0 +1,156 @@
+#ifndef THREADING_HPP_INCLUDED
+#define THREADING_HPP_INCLUDED
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Native threading primitives
+//---------------------------------------------------------------------
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace threading
+{
+	// Number of logical processors available to the process
+	std::size_t hardware_concurrency();
+
+	// Ids of the logical processors the process may run on, which need
+	// not start at 0 or be contiguous under cpusets or taskset. All of
+	// 0 to hardware_concurrency() - 1 when the platform cannot tell.
+	std::vector<std::size_t> allowed_processors();
+
+	// Pins the calling thread to a single logical processor. Returns false
+	// when the platform does not support it (Mac OS X) or the call failed.
+	bool set_affinity(std::size_t processor);
+
+	// Returns the processors the calling thread may run on, for
+	// restore_affinity(). Null when the platform does not support it.
+	void* save_affinity();
+
+	// Gives the calling thread back an affinity from save_affinity() and
+	// frees it. Does nothing when saved is null.
+	void restore_affinity(void* saved);
+
+	// Stores exchange in target if it still holds comparand, returning the
+	// value target held before the call
+	void* compare_exchange(void* volatile* target, void* exchange, void* comparand);
+
+	// Stores exchange in target if it still holds comparand, returning the
+	// value target held before the call
+	std::size_t compare_exchange(volatile std::size_t* target, std::size_t exchange, std::size_t comparand);
+
+	// Adds value to target, returning the value target held before the call
+	std::size_t fetch_add(volatile std::size_t* target, std::size_t value);
+
+	// Reads source without a locked instruction. No load or store after the
+	// call is moved ahead of it.
+	std::size_t load_acquire(const volatile std::size_t* source);
+
+	// Reads and writes a 64 bit value in one piece, also on 32 bit targets.
+	// Neither orders other memory accesses.
+	uint64_t load(const volatile uint64_t* source);
+	void store(volatile uint64_t* target, uint64_t value);
+
+	// Gives up the rest of the calling thread's time slice
+	void yield();
+
+	// Orders every load and store before the call ahead of those after it
+	void memory_fence();
+
+	class mutex
+	{
+		public:
+
+			mutex();
+			~mutex();
+
+			void lock();
+			void unlock();
+
+		private:
+
+			friend class condition;
+
+			mutex(const mutex&);
+			mutex& operator= (const mutex&);
+
+			void* _handle;
+
+	} ; // end class mutex
+
+	class scoped_lock
+	{
+		public:
+
+			explicit scoped_lock(mutex& lock)
+				: _lock(lock)
+			{
+				_lock.lock();
+			}
+
+			~scoped_lock()
+			{
+				_lock.unlock();
+			}
+
+		private:
+
+			scoped_lock(const scoped_lock&);
+			scoped_lock& operator= (const scoped_lock&);
+
+			mutex& _lock;
+
+	} ; // end class scoped_lock
+
+	class condition
+	{
+		public:
+
+			condition();
+			~condition();
+
+			// The mutex must be held by the caller
+			void wait(mutex& lock);
+
+			void notify_one();
+			void notify_all();
+
+		private:
+
+			condition(const condition&);
+			condition& operator= (const condition&);
+
+			void* _handle;
+
+	} ; // end class condition
+
+	typedef void (*thread_function)(void* context);
+
+	class thread
+	{
+		public:
+
+			thread();
+			~thread();
+
+			bool start(thread_function function, void* context);
+
+			void join();
+
+		private:
+
+			thread(const thread&);
+			thread& operator= (const thread&);
+
+			void* _handle;
+
+	} ; // end class thread
+}
+
+#endif // end THREADING_HPP_INCLUDED
@@ -7,28 +7,131 @@
 #include <mach/mach.h>
 #else
 #include <time.h>
-#include <sys/timeb.h>
+#endif
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_CYCLE_COUNTER
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 namespace
 {
 	double __secondsPerCycle = 0.0;
+	uint64_t __overhead = 0;
+	system_time::clock_source __source = system_time::default_clock;
 #ifdef __MACH__
 	clock_serv_t __cs;
 #endif
+
+#if !defined(_WIN32) && !defined(__MACH__)
+	inline uint64_t get_monotonic_time()
+	{
+		timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+		return (uint64_t)ts.tv_sec * 1000000000LL + (uint64_t)ts.tv_nsec;
+	}
+#endif
+
+#ifdef HAS_CYCLE_COUNTER
+	inline uint64_t get_cycle_count()
+	{
+		unsigned int aux;
+		return __rdtscp(&aux);
+	}
+
+	// The TSC has to tick at a constant rate through frequency and power
+	// state changes and rdtscp has to be available
+	bool has_invariant_tsc()
+	{
+		unsigned int eax, ebx, ecx, edx;
+
+		if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 27)))
+			return false;
+
+		if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+			return false;
+
+		return (edx & (1 << 8)) != 0;
+	}
+
+	// Measures the TSC rate against the monotonic clock
+	double calibrate_cycle_counter()
+	{
+		const uint64_t interval = 20000000; // 20ms
+
+		const uint64_t start_time = get_monotonic_time();
+		const uint64_t start_cycles = get_cycle_count();
+
+		uint64_t stop_time;
+
+		do
+		{
+			stop_time = get_monotonic_time();
+		} while (stop_time - start_time < interval);
+
+		const uint64_t stop_cycles = get_cycle_count();
+
+		return (1e-9 * (stop_time - start_time)) / (double)(stop_cycles - start_cycles);
+	}
+#endif
+
+	uint64_t measure_overhead()
+	{
+		uint64_t minimum = ~(uint64_t)0;
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			const uint64_t start = system_time::get_time();
+			const uint64_t stop = system_time::get_time();
+
+			if (stop - start < minimum)
+				minimum = stop - start;
+		}
+
+		return minimum;
+	}
 }
 
-void system_time::initialize()
+void system_time::initialize(clock_source source)
 {
+	__source = default_clock;
+
 #ifdef _WIN32
 	LARGE_INTEGER frequency;
 	QueryPerformanceFrequency(&frequency);
 
 	__secondsPerCycle = 1.0 / frequency.QuadPart;
+#elif __MACH__
+	host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &__cs);
+	__secondsPerCycle = 1e-9;
 #else
-	host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &__cs);
 	__secondsPerCycle = 1e-9;
+
+#ifdef HAS_CYCLE_COUNTER
+	if ((source == cycle_counter) && has_invariant_tsc())
+	{
+		__secondsPerCycle = calibrate_cycle_counter();
+		__source = cycle_counter;
+	}
 #endif
+#endif
+
+	// Must come last as it goes through the selected clock
+	__overhead = measure_overhead();
 }
 
 void system_time::terminate()
@@ -47,15 +150,268 @@ uint64_t system_time::get_time()
 #elif __MACH__
 	mach_timespec_t ts;
 	clock_get_time(__cs, &ts);
-	return (uint64_t)ts.tv_sec * 1000000LL + (uint64_t)ts.tv_nsec / 1000LL;
+	return (uint64_t)ts.tv_sec * 1000000000LL + (uint64_t)ts.tv_nsec;
 #else
-	timespec ts;
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	return (uint64_t)ts.tv_sec * 1000000LL + (uint64_t)ts.tv_nsec / 1000LL;
+#ifdef HAS_CYCLE_COUNTER
+	if (__source == cycle_counter)
+		return get_cycle_count();
 #endif
+	return get_monotonic_time();
+#endif
+}
+
+system_time::clock_source system_time::get_clock_source()
+{
+	return __source;
+}
+
+double system_time::get_resolution()
+{
+	return __secondsPerCycle;
+}
+
+uint64_t system_time::get_overhead()
+{
+	return __overhead;
 }
 
 double timer::elapsed_time() const
 {
-	return __secondsPerCycle * (_stop_time - _start_time);
+	const uint64_t ticks = _stop_time - _start_time;
+
+	return __secondsPerCycle * ((ticks > __overhead) ? ticks - __overhead : 0);
+}
+
+//---------------------------------------------------------------------
+// Hardware counters
+//---------------------------------------------------------------------
+
+#ifdef __linux__
+
+class counter_group
+{
+	public:
+
+		enum { event_count = 6 } ;
+
+		counter_group()
+			: _leader(-1)
+		{
+			std::memset(&_counters, 0, sizeof(_counters));
+
+			for (int i = 0; i < event_count; ++i)
+				_fds[i] = -1;
+
+			const uint64_t l1_read_miss =
+				PERF_COUNT_HW_CACHE_L1D |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			const uint64_t llc_read_miss =
+				PERF_COUNT_HW_CACHE_LL |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			const uint64_t dtlb_read_miss =
+				PERF_COUNT_HW_CACHE_DTLB |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+			// The cycle counter leads the group, the rest are optional
+			_leader = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+
+			if (_leader < 0)
+			{
+				_error = std::string("perf_event_open failed: ") + std::strerror(errno);
+
+				if ((errno == EACCES) || (errno == EPERM))
+					_error += ", see /proc/sys/kernel/perf_event_paranoid";
+				else if ((errno == ENOENT) || (errno == EOPNOTSUPP))
+					_error += ", the processor exposes no hardware events";
+
+				return;
+			}
+
+			_fds[0] = _leader;
+			_fds[1] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, _leader);
+			_fds[2] = open(PERF_TYPE_HW_CACHE, l1_read_miss, _leader);
+			_fds[3] = open(PERF_TYPE_HW_CACHE, llc_read_miss, _leader);
+			_fds[4] = open(PERF_TYPE_HW_CACHE, dtlb_read_miss, _leader);
+			_fds[5] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, _leader);
+		}
+
+		~counter_group()
+		{
+			for (int i = 0; i < event_count; ++i)
+			{
+				if (_fds[i] >= 0)
+					close(_fds[i]);
+			}
+		}
+
+		bool valid() const
+		{
+			return _leader >= 0;
+		}
+
+		const std::string& error() const
+		{
+			return _error;
+		}
+
+		void start()
+		{
+			ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+
+		void stop()
+		{
+			ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+			// Inherited counters cannot be read as a group, so each event is
+			// read on its own as value, time enabled, time running
+			uint64_t values[event_count];
+
+			for (int i = 0; i < event_count; ++i)
+			{
+				uint64_t data[3];
+
+				if ((_fds[i] < 0) || (read(_fds[i], data, sizeof(data)) < (ssize_t)sizeof(data)))
+				{
+					values[i] = 0;
+					continue;
+				}
+
+				// Scale up if the kernel had to multiplex the counters
+				const double scale = (data[2] > 0) ? (double)data[1] / data[2] : 1.0;
+
+				values[i] = (uint64_t)(data[0] * scale);
+			}
+
+			_counters.cycles        = values[0];
+			_counters.instructions  = values[1];
+			_counters.l1_misses     = values[2];
+			_counters.llc_misses    = values[3];
+			_counters.dtlb_misses   = values[4];
+			_counters.branch_misses = values[5];
+		}
+
+		const performance_counters& counters() const
+		{
+			return _counters;
+		}
+
+	private:
+
+		static int open(uint32_t type, uint64_t config, int group)
+		{
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.disabled = (group < 0) ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// Threads started after the counters are opened are counted too
+			attr.inherit = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+		}
+
+		int _leader;
+		int _fds[event_count];
+		performance_counters _counters;
+		std::string _error;
+
+} ; // end class counter_group
+
+#else
+
+class counter_group
+{
+	public:
+
+		bool valid() const
+		{
+			return false;
+		}
+
+		std::string error() const
+		{
+			return "hardware counters need Linux perf events";
+		}
+
+		void start()
+		{ }
+
+		void stop()
+		{ }
+
+		const performance_counters& counters() const
+		{
+			return _counters;
+		}
+
+	private:
+
+		performance_counters _counters;
+
+} ; // end class counter_group
+
+#endif
+
+timer::timer(bool use_counters)
+: _start_time(0)
+, _stop_time(0)
+, _counters(0)
+{
+	if (!use_counters)
+		return;
+
+	_counters = new counter_group();
+
+	if (!_counters->valid())
+	{
+		delete _counters;
+		_counters = 0;
+	}
+}
+
+timer::~timer()
+{
+	delete _counters;
+}
+
+bool timer::has_counters() const
+{
+	return _counters != 0;
+}
+
+std::string timer::counters_error()
+{
+	const counter_group group;
+
+	return group.valid() ? std::string() : group.error();
+}
+
+performance_counters timer::counters() const
+{
+	if (_counters)
+		return _counters->counters();
+
+	performance_counters none = { 0, 0, 0, 0, 0, 0 };
+
+	return none;
+}
+
+void timer::start_counters()
+{
+	_counters->start();
+}
+
+void timer::stop_counters()
+{
+	_counters->stop();
 }
@@ -2,16 +2,48 @@
 #define TIMER_HPP_INCLUDED
 
 #include <stdint.h>
+#include <string>
 
 namespace system_time
 {
-	void initialize();
+	enum clock_source
+	{
+		default_clock,
+		// Invariant TSC read with rdtscp, falls back to the default clock
+		// when the processor does not provide one. Linux x86 only.
+		cycle_counter
+	} ;
+
+	void initialize(clock_source source = default_clock);
 	
 	void terminate();
 
 	uint64_t get_time();
+
+	clock_source get_clock_source();
+
+	// Seconds per tick of get_time()
+	double get_resolution();
+
+	// Smallest measured cost of two back to back calls to get_time(), in
+	// ticks. This is removed from every timer interval.
+	uint64_t get_overhead();
 }
 
+// Hardware event counts captured between timer::start() and timer::stop()
+struct performance_counters
+{
+	uint64_t cycles;
+	uint64_t instructions;
+	uint64_t l1_misses;
+	uint64_t llc_misses;
+	uint64_t dtlb_misses;
+	uint64_t branch_misses;
+
+} ; // end struct performance_counters
+
+class counter_group;
+
 class timer
 {
 	public:
@@ -19,24 +51,55 @@ class timer
 		inline timer()
 		: _start_time(0)
 		, _stop_time(0)
+		, _counters(0)
 		{ }
 
+		// Optionally opens a group of hardware counters that are enabled
+		// for the same interval as the clock. Only supported on Linux,
+		// through perf_event_open. Threads started after the timer is
+		// created are counted with the calling thread.
+		explicit timer(bool use_counters);
+
+		~timer();
+
 		inline void start()
 		{
+			if (_counters)
+				start_counters();
+
 			_start_time = system_time::get_time();
 		}
 
 		inline void stop()
 		{
 			_stop_time = system_time::get_time();
+
+			if (_counters)
+				stop_counters();
 		}
 
 		double elapsed_time() const;
 
+		bool has_counters() const;
+
+		// Opens a counter group and returns why it could not be, or an
+		// empty string when counters are available
+		static std::string counters_error();
+
+		// Counts from the last start()/stop() interval
+		performance_counters counters() const;
+
 	private:
 
+		timer(const timer&);
+		timer& operator= (const timer&);
+
+		void start_counters();
+		void stop_counters();
+
 		uint64_t _start_time;
 		uint64_t _stop_time;
+		counter_group* _counters;
 
 } ; // end class timer
 
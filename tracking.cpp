@@ -0,0 +1,92 @@
+#include "config.hpp"
+#include <algorithm>
+
+// The arrays are only there with a SIMD instruction set
+#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_NEON)
+
+std::size_t expression_template_simd::cached_expression::refresh()
+{
+	const std::size_t block_elements = (std::size_t)1 << tracking_block_shift;
+	const std::size_t blocks = (_elements + block_elements - 1) >> tracking_block_shift;
+
+	std::size_t evaluated = 0;
+
+	// The changed blocks come from the write logs of the inputs, so a small
+	// change costs no more than the blocks it touched. Otherwise the stamps
+	// of every block are compared.
+	_changed.clear();
+
+	bool logged = !_stale && _tracked;
+
+	for (std::size_t i = 0; logged && (i < _inputs.size()); ++i)
+		logged = _inputs[i]->changed_blocks(_seen[i], _changed);
+
+	if (logged)
+	{
+		std::sort(_changed.begin(), _changed.end());
+		_changed.erase(std::unique(_changed.begin(), _changed.end()), _changed.end());
+
+		// Runs of changed blocks are evaluated together
+		for (std::size_t i = 0; i < _changed.size(); )
+		{
+			std::size_t last = i;
+
+			while ((last + 1 < _changed.size()) && (_changed[last + 1] == _changed[last] + 1))
+				++last;
+
+			const std::size_t end = (_changed[last] + 1) * block_elements;
+
+			_evaluator->evaluate(_changed[i] * block_elements, (end < _elements) ? end : _elements);
+
+			evaluated += last + 1 - i;
+			i = last + 1;
+		}
+	}
+	else
+	{
+		std::size_t first = 0;
+		bool dirty_run = false;
+
+		for (std::size_t block = 0; block <= blocks; ++block)
+		{
+			bool dirty = false;
+
+			if (block < blocks)
+			{
+				dirty = _stale || !_tracked;
+
+				for (std::size_t i = 0; !dirty && (i < _inputs.size()); ++i)
+					dirty = _inputs[i]->block_version(block) > _seen[i];
+			}
+
+			if (dirty && !dirty_run)
+			{
+				first = block;
+				dirty_run = true;
+			}
+			else if (!dirty && dirty_run)
+			{
+				const std::size_t end = block * block_elements;
+
+				_evaluator->evaluate(first * block_elements, (end < _elements) ? end : _elements);
+
+				evaluated += block - first;
+				dirty_run = false;
+			}
+		}
+	}
+
+	for (std::size_t i = 0; i < _inputs.size(); ++i)
+		_seen[i] = _inputs[i]->advance();
+
+	_stale = false;
+
+	return evaluated;
+}
+
+void expression_template_simd::cached_expression::invalidate()
+{
+	_stale = true;
+}
+
+#endif
@@ -0,0 +1,479 @@
+#ifndef TRACKING_HPP_INCLUDED
+#define TRACKING_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+//---------------------------------------------------------------------
+// Incremental recomputation
+//---------------------------------------------------------------------
+
+// Arrays that remember which blocks were written, and expressions that
+// only recompute the blocks of their destination whose inputs changed.
+// Writes and refreshes are expected on one thread.
+namespace expression_template_simd
+{
+	enum
+	{
+		// Elements in each tracked block are 1 << tracking_block_shift
+		tracking_block_shift = 8
+	} ;
+
+	// Version stamps of the blocks of an array. A write stamps its block
+	// with the current version, and a reader that has seen everything up to
+	// version v calls advance() so that later writes are stamped above v.
+	// The first write to a block in each version is also logged, so that a
+	// reader can find the changed blocks without looking at every stamp.
+	// The log holds at most one entry per block. When it fills up it is
+	// emptied, and readers that have not caught up look at every stamp.
+	class valarray_tracking
+	{
+		public:
+
+			explicit valarray_tracking(std::size_t elements)
+				: _version(1)
+				, _versions((elements + (1 << tracking_block_shift) - 1) >> tracking_block_shift, 1)
+				, _log_first(1)
+			{ }
+
+			INLINE std::size_t blocks() const
+			{
+				return _versions.size();
+			}
+
+			INLINE std::size_t block_version(std::size_t block) const
+			{
+				return _versions[block];
+			}
+
+			INLINE void mark(std::size_t element)
+			{
+				stamp(element >> tracking_block_shift);
+			}
+
+			// Elements [begin, end)
+			void mark(std::size_t begin, std::size_t end)
+			{
+				if (begin >= end)
+					return;
+
+				for (std::size_t block = begin >> tracking_block_shift; block <= ((end - 1) >> tracking_block_shift); ++block)
+					stamp(block);
+			}
+
+			void mark_all()
+			{
+				for (std::size_t block = 0; block < _versions.size(); ++block)
+					_versions[block] = _version;
+
+				drop_log();
+			}
+
+			// Appends the blocks written after version seen, possibly more
+			// than once. Returns false if the log no longer reaches back that
+			// far, and the stamps have to be compared instead.
+			bool changed_blocks(std::size_t seen, std::vector<std::size_t>& blocks) const
+			{
+				if (seen + 1 < _log_first)
+					return false;
+
+				// Entries are logged in version order
+				for (std::size_t i = _log.size(); (i > 0) && (_log[i - 1].version > seen); --i)
+					blocks.push_back(_log[i - 1].block);
+
+				return true;
+			}
+
+			// Returns the version every write so far is stamped at or below.
+			// Readers only hold a const array, and the version is not part
+			// of its value.
+			std::size_t advance() const
+			{
+				return _version++;
+			}
+
+		private:
+
+			struct log_entry
+			{
+				std::size_t block;
+				std::size_t version;
+			} ;
+
+			INLINE void stamp(std::size_t block)
+			{
+				if (_versions[block] == _version)
+					return;
+
+				_versions[block] = _version;
+
+				if (_log.size() == _versions.size())
+				{
+					drop_log();
+					return;
+				}
+
+				const log_entry entry = { block, _version };
+				_log.push_back(entry);
+			}
+
+			// Forgets the logged writes. Changes up to the current version
+			// can then only be found from the stamps.
+			void drop_log()
+			{
+				_log.clear();
+				_log_first = _version + 1;
+			}
+
+			mutable std::size_t _version;
+			std::vector<std::size_t> _versions;
+			// Every write stamped at or above _log_first is logged
+			std::vector<log_entry> _log;
+			std::size_t _log_first;
+
+	} ; // end class valarray_tracking
+
+	// Rep that stamps the block of every element written through it. Writes
+	// through data() cannot be seen, so the non-const data() stamps every
+	// block.
+	template <typename Real, typename Rep = valarray_rep_sse<Real> >
+	class valarray_rep_tracked : public valarray_tracking
+	{
+		public:
+
+			typedef Real value_type;
+			typedef typename Rep::element_type element_type;
+
+			INLINE valarray_rep_tracked(std::size_t size)
+				: valarray_tracking(element_count(size))
+				, _rep(size)
+			{ }
+
+			INLINE valarray_rep_tracked(std::size_t size, value_type value)
+				: valarray_tracking(element_count(size))
+				, _rep(size, value)
+			{ }
+
+			INLINE element_type operator() (std::size_t i) const
+			{
+				return _rep(i);
+			}
+
+			INLINE element_type& operator() (std::size_t i)
+			{
+				mark(i);
+
+				return _rep(i);
+			}
+
+			INLINE value_type operator[] (std::size_t i) const
+			{
+				return _rep[i];
+			}
+
+			INLINE std::size_t size() const
+			{
+				return _rep.size();
+			}
+
+			INLINE std::size_t elements() const
+			{
+				return _rep.elements();
+			}
+
+			INLINE const element_type* data() const
+			{
+				return _rep.data();
+			}
+
+			INLINE element_type* data()
+			{
+				mark_all();
+
+				return _rep.data();
+			}
+
+			// The array without tracking, for writers that stamp the blocks
+			// themselves
+			INLINE Rep& untracked()
+			{
+				return _rep;
+			}
+
+		private:
+
+			static std::size_t element_count(std::size_t size)
+			{
+				const std::size_t lanes = sizeof(element_type) / sizeof(value_type);
+
+				return (size + lanes - 1) / lanes;
+			}
+
+			Rep _rep;
+
+	} ; // end class valarray_rep_tracked<Real, Rep>
+
+	// Whole arrays go through the loop of the inner rep
+	template <typename Real, typename Rep>
+	struct valarray_assign<valarray_rep_tracked<Real, Rep> >
+	{
+		template <typename Src>
+		static INLINE void apply(valarray_rep_tracked<Real, Rep>& dest, const Src& src)
+		{
+			valarray_assign<Rep>::apply(dest.untracked(), src);
+
+			dest.mark_all();
+		}
+
+	} ; // end valarray_assign<valarray_rep_tracked<Real, Rep> >
+
+	// Gathers the tracked arrays an expression reads. Returns false if it
+	// reads a leaf whose changes cannot be seen, or maps elements to other
+	// indices.
+	template <typename Op>
+	struct valarray_dependencies
+	{
+		static INLINE bool collect(const Op&, std::vector<const valarray_tracking*>&)
+		{
+			return false;
+		}
+
+	} ; // end valarray_dependencies<Op>
+
+	template <typename Real, typename Rep>
+	struct valarray_dependencies<valarray_rep_tracked<Real, Rep> >
+	{
+		static INLINE bool collect(const valarray_rep_tracked<Real, Rep>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			inputs.push_back(&op);
+
+			return true;
+		}
+
+	} ; // end valarray_dependencies<valarray_rep_tracked<Real, Rep> >
+
+	// Generated values never change
+	template <typename Real, typename Element>
+	struct valarray_dependencies<valarray_constant<Real, Element> >
+	{
+		static INLINE bool collect(const valarray_constant<Real, Element>&, std::vector<const valarray_tracking*>&)
+		{
+			return true;
+		}
+
+	} ; // end valarray_dependencies<valarray_constant<Real, Element> >
+
+	template <typename Real, int Value, typename Element>
+	struct valarray_dependencies<valarray_literal<Real, Value, Element> >
+	{
+		static INLINE bool collect(const valarray_literal<Real, Value, Element>&, std::vector<const valarray_tracking*>&)
+		{
+			return true;
+		}
+
+	} ; // end valarray_dependencies<valarray_literal<Real, Value, Element> >
+
+	template <typename Real, typename Element>
+	struct valarray_dependencies<valarray_ramp<Real, Element> >
+	{
+		static INLINE bool collect(const valarray_ramp<Real, Element>&, std::vector<const valarray_tracking*>&)
+		{
+			return true;
+		}
+
+	} ; // end valarray_dependencies<valarray_ramp<Real, Element> >
+
+	template <typename Real, typename Element>
+	struct valarray_dependencies<valarray_random<Real, Element> >
+	{
+		static INLINE bool collect(const valarray_random<Real, Element>&, std::vector<const valarray_tracking*>&)
+		{
+			return true;
+		}
+
+	} ; // end valarray_dependencies<valarray_random<Real, Element> >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_dependencies<valarray_add<Real, Op1, Op2> >
+	{
+		static INLINE bool collect(const valarray_add<Real, Op1, Op2>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Op1>::collect(op._op1, inputs) && valarray_dependencies<Op2>::collect(op._op2, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_add<Real, Op1, Op2> >
+
+	template <typename Real, typename Op1, typename Op2, typename Op3>
+	struct valarray_dependencies<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+	{
+		static INLINE bool collect(const valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> >& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Op1>::collect(op._op1, inputs) && valarray_dependencies<Op2>::collect(op._op2, inputs) && valarray_dependencies<Op3>::collect(op._op3, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_add<Real, Op1, valarray_mul<Real, Op2, Op3> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_dependencies<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+	{
+		static INLINE bool collect(const valarray_add<Real, Op1, valarray_square<Real, Op2> >& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Op1>::collect(op._op1, inputs) && valarray_dependencies<Op2>::collect(op._op2, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_add<Real, Op1, valarray_square<Real, Op2> > >
+
+	template <typename Real, typename Op1, typename Op2>
+	struct valarray_dependencies<valarray_mul<Real, Op1, Op2> >
+	{
+		static INLINE bool collect(const valarray_mul<Real, Op1, Op2>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Op1>::collect(op._op1, inputs) && valarray_dependencies<Op2>::collect(op._op2, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_mul<Real, Op1, Op2> >
+
+	template <typename Real, typename Op>
+	struct valarray_dependencies<valarray_sqrt<Real, Op> >
+	{
+		static INLINE bool collect(const valarray_sqrt<Real, Op>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Op>::collect(op._op, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_sqrt<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct valarray_dependencies<valarray_square<Real, Op> >
+	{
+		static INLINE bool collect(const valarray_square<Real, Op>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<Op>::collect(op._op, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_square<Real, Op> >
+
+	template <typename Real, typename Op>
+	struct valarray_dependencies<valarray_rewritten<Real, Op> >
+	{
+		static INLINE bool collect(const valarray_rewritten<Real, Op>& op, std::vector<const valarray_tracking*>& inputs)
+		{
+			return valarray_dependencies<typename valarray_rewritten<Real, Op>::node_type>::collect(op._node, inputs);
+		}
+
+	} ; // end valarray_dependencies<valarray_rewritten<Real, Op> >
+
+	// Evaluates a range of elements of one expression into its destination
+	class cached_evaluator
+	{
+		public:
+
+			virtual ~cached_evaluator()
+			{ }
+
+			virtual void evaluate(std::size_t begin, std::size_t end) = 0;
+
+	} ; // end class cached_evaluator
+
+	template <typename Real, typename Rep, typename Src>
+	class cached_evaluator_impl : public cached_evaluator
+	{
+		public:
+
+			cached_evaluator_impl(valarray<Real, Rep>& dest, const Src& src)
+				: _dest(dest)
+				, _src(src)
+			{ }
+
+			void evaluate(std::size_t begin, std::size_t end)
+			{
+				for (std::size_t i = begin; i < end; ++i)
+					_dest(i) = _src(i);
+			}
+
+		private:
+
+			valarray<Real, Rep>& _dest;
+			typename valarray_operand<Src>::type _src;
+
+	} ; // end class cached_evaluator_impl<Real, Rep, Src>
+
+	// An assignment that is kept and refreshed. Each refresh evaluates
+	// only the blocks of the destination where a tracked input was written
+	// since the last one. Expressions that read untracked arrays are
+	// evaluated in full every time. The destination must not be an input,
+	// and must outlive the cache like the inputs.
+	class cached_expression
+	{
+		public:
+
+			template <typename Real, typename Rep, typename Src>
+			cached_expression(valarray<Real, Rep>& dest, const valarray<Real, Src>& src)
+				: _evaluator(new cached_evaluator_impl<Real, Rep, Src>(dest, src.rep()))
+				, _elements(dest.elements())
+				, _stale(true)
+			{
+				assert(dest.elements() == src.elements());
+
+				_tracked = valarray_dependencies<Src>::collect(src.rep(), _inputs);
+				_seen.resize(_inputs.size(), 0);
+
+				for (std::size_t i = 0; i < _inputs.size(); ++i)
+					assert((const void*)_inputs[i] != (const void*)&dest.rep());
+			}
+
+			~cached_expression()
+			{
+				delete _evaluator;
+			}
+
+			// Evaluates what changed, everything on the first call. Returns
+			// the number of blocks evaluated.
+			std::size_t refresh();
+
+			// Makes the next refresh evaluate everything
+			void invalidate();
+
+		private:
+
+			cached_expression(const cached_expression&);
+			cached_expression& operator= (const cached_expression&);
+
+			cached_evaluator* _evaluator;
+			std::size_t _elements;
+			// Everything is evaluated by the next refresh
+			bool _stale;
+			bool _tracked;
+			std::vector<const valarray_tracking*> _inputs;
+			// Version of each input seen by the last refresh
+			std::vector<std::size_t> _seen;
+			// Blocks to evaluate, kept between refreshes to reuse its memory
+			std::vector<std::size_t> _changed;
+
+	} ; // end class cached_expression
+
+} // end namespace expression_template_simd
+
+#ifdef USE_PROFILING
+
+namespace profiling
+{
+	template <typename Real, typename Rep>
+	struct expression_signature<expression_template_simd::valarray_rep_tracked<Real, Rep> >
+	{
+		enum { bytes_per_value = expression_signature<Rep>::bytes_per_value } ;
+
+		static void append(std::string& signature)
+		{
+			signature += "tracked(";
+			expression_signature<Rep>::append(signature);
+			signature += ")";
+		}
+
+	} ; // end struct expression_signature<valarray_rep_tracked<Real, Rep> >
+}
+
+#endif
+
+#endif // end TRACKING_HPP_INCLUDED
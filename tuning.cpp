@@ -0,0 +1,196 @@
+#include "config.hpp"
+#include "tuning.hpp"
+#include "system_info.hpp"
+#include "threading.hpp"
+#ifdef USE_THREADS
+#include "thread_pool.hpp"
+#endif
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	tuning::tuning_profile __profile;
+	bool __loaded = false;
+
+	// Non-zero once the profile is stored. The first assignments can come
+	// from several threads at once, so the load happens under the lock, and
+	// the flag is only touched atomically. Once set, readers only pay for
+	// an acquire load.
+	volatile std::size_t __initialized = 0;
+	threading::mutex __initialize_lock;
+
+#ifdef USE_THREADS
+	// The pool is only created, used or deleted by the thread that holds
+	// the busy flag
+	thread_pool* __pool = 0;
+	void* volatile __pool_busy = 0;
+#endif
+
+	void initialize()
+	{
+		if (threading::load_acquire(&__initialized) != 0)
+			return;
+
+		threading::scoped_lock lock(__initialize_lock);
+
+		if (threading::load_acquire(&__initialized) != 0)
+			return;
+
+		tuning::tuning_profile profile;
+
+		if (tuning::read_profile(tuning::get_profile_path().c_str(), profile) && (profile.host == system_info::get_host_name()))
+		{
+			__profile = profile;
+			__loaded = true;
+		}
+
+		threading::fetch_add(&__initialized, 1);
+	}
+}
+
+tuning::tuning_profile::tuning_profile()
+	: block_size(4096)
+	, unroll(1)
+	, threads(1)
+	, parallel_threshold((std::size_t)-1)
+	, streaming_threshold((std::size_t)-1)
+{ }
+
+const tuning::tuning_profile& tuning::get_profile()
+{
+	initialize();
+
+	return __profile;
+}
+
+void tuning::set_profile(const tuning_profile& profile)
+{
+	initialize();
+
+#ifdef USE_THREADS
+	// Wait for an expression still running on the old pool
+	while (threading::compare_exchange(&__pool_busy, (void*)1, 0) != 0)
+		threading::yield();
+
+	if (__pool && (__pool->size() != profile.threads))
+	{
+		delete __pool;
+		__pool = 0;
+	}
+
+	__profile = profile;
+
+	release_thread_pool();
+#else
+	__profile = profile;
+#endif
+}
+
+std::string tuning::get_profile_path()
+{
+	const char* path = std::getenv("EXPRESSION_TUNING_PROFILE");
+
+	return (path && *path) ? path : "tuning_profile.txt";
+}
+
+bool tuning::is_profile_loaded()
+{
+	initialize();
+
+	return __loaded;
+}
+
+bool tuning::read_profile(const char* path, tuning_profile& profile)
+{
+	std::ifstream in(path);
+
+	if (!in)
+		return false;
+
+	std::string line;
+
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		std::string key;
+
+		if (!(fields >> key) || (key[0] == '#'))
+			continue;
+
+		if (key == "host")
+			fields >> profile.host;
+		else if (key == "block_size")
+			fields >> profile.block_size;
+		else if (key == "unroll")
+		{
+			fields >> profile.unroll;
+
+			// Only these unroll factors have an evaluation loop
+			if ((profile.unroll != 1) && (profile.unroll != 2) && (profile.unroll != 4) && (profile.unroll != 8))
+				return false;
+		}
+		else if (key == "threads")
+			fields >> profile.threads;
+		else if (key == "parallel_threshold")
+			fields >> profile.parallel_threshold;
+		else if (key == "streaming_threshold")
+			fields >> profile.streaming_threshold;
+		else
+			return false;
+
+		if (fields.fail())
+			return false;
+	}
+
+	return (profile.block_size > 0) && (profile.threads > 0);
+}
+
+bool tuning::write_profile(const char* path, const tuning_profile& profile)
+{
+	std::ofstream out(path);
+
+	if (!out)
+		return false;
+
+	out << "# Expression evaluation tuning profile, written by the autotuner\n\n"
+	    << "host " << profile.host << "\n"
+	    << "block_size " << profile.block_size << "\n"
+	    << "unroll " << profile.unroll << "\n"
+	    << "threads " << profile.threads << "\n"
+	    << "parallel_threshold " << profile.parallel_threshold << "\n"
+	    << "streaming_threshold " << profile.streaming_threshold << "\n";
+
+	return out.good();
+}
+
+thread_pool* tuning::acquire_thread_pool()
+{
+#ifdef USE_THREADS
+	// Expressions evaluated inside a task, or on two threads at once, run
+	// on the calling thread rather than waiting for the pool
+	if (threading::compare_exchange(&__pool_busy, (void*)1, 0) != 0)
+		return 0;
+
+	if (__profile.threads <= 1)
+	{
+		release_thread_pool();
+		return 0;
+	}
+
+	if (!__pool)
+		__pool = new thread_pool(__profile.threads, false);
+
+	return __pool;
+#else
+	return 0;
+#endif
+}
+
+void tuning::release_thread_pool()
+{
+#ifdef USE_THREADS
+	threading::compare_exchange(&__pool_busy, 0, (void*)1);
+#endif
+}
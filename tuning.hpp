@@ -0,0 +1,67 @@
+#ifndef TUNING_HPP_INCLUDED
+#define TUNING_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+class thread_pool;
+
+//---------------------------------------------------------------------
+// Evaluation tuning
+//---------------------------------------------------------------------
+
+// Parameters of the evaluation loop that depend on the machine. The
+// defaults reproduce the plain single threaded loop. A profile written by
+// the autotuner is loaded the first time one is asked for, from the path
+// in the EXPRESSION_TUNING_PROFILE environment variable or from
+// tuning_profile.txt in the working directory.
+namespace tuning
+{
+	struct tuning_profile
+	{
+		// Host the profile was tuned on, a profile from another host is
+		// not loaded
+		std::string host;
+		// SIMD elements handed out to a thread at a time
+		std::size_t block_size;
+		// Elements evaluated per loop iteration, 1, 2, 4 or 8
+		std::size_t unroll;
+		// Threads used to evaluate large expressions
+		std::size_t threads;
+		// Values in an expression before it is split between threads
+		std::size_t parallel_threshold;
+		// Bytes written by an expression before stores bypass the cache
+		std::size_t streaming_threshold;
+
+		tuning_profile();
+
+	} ; // end struct tuning_profile
+
+	// The active profile, loading it on first use
+	const tuning_profile& get_profile();
+
+	// Replaces the active profile, used by the autotuner. Waits for an
+	// expression running on the pool before replacing it, but the other
+	// settings are not safe to change while expressions are being
+	// evaluated.
+	void set_profile(const tuning_profile& profile);
+
+	// Path the profile is loaded from
+	std::string get_profile_path();
+
+	// True if the active profile came from a file
+	bool is_profile_loaded();
+
+	bool read_profile(const char* path, tuning_profile& profile);
+
+	bool write_profile(const char* path, const tuning_profile& profile);
+
+	// Pool with the profile's thread count, or null when the profile is
+	// single threaded or the pool is already in use by another expression.
+	// Every successful acquire must be followed by a release.
+	thread_pool* acquire_thread_pool();
+
+	void release_thread_pool();
+}
+
+#endif // end TUNING_HPP_INCLUDED